@@ -34,6 +34,7 @@
 #include "qemu/atomic.h"
 #include "qemu/atomic128.h"
 #include "translate-all.h"
+#include "tb-spec.h"
 #include "trace/trace-root.h"
 #include "trace/mem.h"
 #ifdef CONFIG_PLUGIN
@@ -304,10 +305,11 @@ static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
     }
 }
 
-void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                      size_t *pcoalesced)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, coalesced = 0;
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -315,10 +317,40 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
         full += qatomic_read(&env_tlb(env)->c.full_flush_count);
         part += qatomic_read(&env_tlb(env)->c.part_flush_count);
         elide += qatomic_read(&env_tlb(env)->c.elide_flush_count);
+        coalesced += qatomic_read(&env_tlb(env)->c.coalesced_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *pcoalesced = coalesced;
+}
+
+void tlb_slow_path_counts(size_t *ploads, size_t *pstores, size_t *pmisses,
+                          size_t *pcross, size_t *pcross_ram)
+{
+    CPUState *cpu;
+    size_t loads = 0, stores = 0, misses = 0, cross = 0, cross_ram = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        loads += qatomic_read(&env_tlb(env)->c.slow_load_count);
+        stores += qatomic_read(&env_tlb(env)->c.slow_store_count);
+        misses += qatomic_read(&env_tlb(env)->c.slow_miss_count);
+        cross += qatomic_read(&env_tlb(env)->c.slow_cross_count);
+        cross_ram += qatomic_read(&env_tlb(env)->c.slow_cross_ram_count);
+    }
+    *ploads = loads;
+    *pstores = stores;
+    *pmisses = misses;
+    *pcross = cross;
+    *pcross_ram = cross_ram;
+}
+
+/* Statistics are only written by the vCPU that owns the tlb. */
+static inline void tlb_stat_inc(size_t *stat)
+{
+    qatomic_set(stat, *stat + 1);
 }
 
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
@@ -495,6 +527,276 @@ static void tlb_flush_page_locked(CPUArchState *env, int midx,
     }
 }
 
+static inline bool tlb_hit_range_mask(target_ulong tlb_addr, target_ulong addr,
+                                      target_ulong len, target_ulong mask)
+{
+    return tlb_addr != -1 &&
+           (tlb_addr & mask & TARGET_PAGE_MASK) - addr < len;
+}
+
+/*
+ * Called with tlb_c.lock held.
+ * Flush the victim tlb entries for any page of the range, in a single
+ * pass over the table rather than one pass per page.
+ */
+static void tlb_flush_vtlb_range_locked(CPUArchState *env, int mmu_idx,
+                                        target_ulong addr, target_ulong len,
+                                        target_ulong mask)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+    int k;
+
+    assert_cpu_is_self(env_cpu(env));
+    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        CPUTLBEntry *te = &d->vtable[k];
+
+        if (tlb_hit_range_mask(te->addr_read, addr, len, mask) ||
+            tlb_hit_range_mask(tlb_addr_write(te), addr, len, mask) ||
+            tlb_hit_range_mask(te->addr_code, addr, len, mask)) {
+            memset(te, -1, sizeof(*te));
+            tlb_n_used_entries_dec(env, mmu_idx);
+        }
+    }
+}
+
+static void tlb_flush_range_locked(CPUArchState *env, int midx,
+                                   target_ulong addr, target_ulong len,
+                                   unsigned bits)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    target_ulong mask = MAKE_64BIT_MASK(0, bits);
+    target_ulong lp_end = d->large_page_addr | ~d->large_page_mask;
+    target_ulong i;
+
+    /*
+     * If @bits is smaller than the tlb size, there may be multiple entries
+     * within the TLB; otherwise all addresses that match under @mask hit
+     * the same TLB entry.
+     *
+     * TODO: Perhaps allow bits to be a few bits less than the size.
+     * For now, just flush the entire TLB.
+     *
+     * If the range has more pages than the TLB has entries, it is
+     * cheaper to flush the entire TLB than to look up each page.
+     * A @len of 0 stands for the whole address space.
+     */
+    if (mask < f->mask || (len - 1) >> TARGET_PAGE_BITS >= tlb_n_entries(f)) {
+        tlb_debug("forcing full flush midx %d ("
+                  TARGET_FMT_lx "+" TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                  midx, addr, len, mask);
+        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        return;
+    }
+
+    /* Check if we need to flush due to large pages.  */
+    if (addr <= lp_end && addr + len - 1 >= d->large_page_addr) {
+        tlb_debug("forcing full flush midx %d ("
+                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                  midx, d->large_page_addr, d->large_page_mask);
+        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        return;
+    }
+
+    for (i = 0; i < len; i += TARGET_PAGE_SIZE) {
+        target_ulong page = addr + i;
+
+        if (tlb_flush_entry_mask_locked(tlb_entry(env, midx, page),
+                                        page, mask)) {
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    tlb_flush_vtlb_range_locked(env, midx, addr & mask, len, mask);
+}
+
+typedef struct {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+    uint16_t bits;
+} TLBFlushRangeData;
+
+/* A single page, with all address bits significant. */
+#define TLB_FLUSH_PAGE_DATA(ADDR, IDXMAP) \
+    ((TLBFlushRangeData) { (ADDR), TARGET_PAGE_SIZE, (IDXMAP), \
+                           TARGET_LONG_BITS })
+
+/**
+ * tlb_flush_range_by_mmuidx_async_0:
+ * @cpu: cpu on which to flush
+ * @d: page aligned range, set of mmu_idx and significant bits to flush
+ *
+ * Helper for tlb_flush_range_by_mmuidx and friends, flush the pages
+ * of the range from the tlbs indicated by @d.idxmap from @cpu.
+ */
+static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
+                                              TLBFlushRangeData d)
+{
+    CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    tlb_debug("range addr:" TARGET_FMT_lx "+" TARGET_FMT_lx
+              "/%u mmu_map:0x%x\n", d.addr, d.len, d.bits, d.idxmap);
+
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if ((d.idxmap >> mmu_idx) & 1) {
+            tlb_flush_range_locked(env, mmu_idx, d.addr, d.len, d.bits);
+        }
+    }
+    qemu_spin_unlock(&env_tlb(env)->c.lock);
+
+    tb_flush_jmp_cache_range(cpu, d.addr, d.len);
+}
+
+static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
+                                              run_on_cpu_data data)
+{
+    TLBFlushRangeData *d = data.host_ptr;
+
+    tlb_flush_range_by_mmuidx_async_0(cpu, *d);
+    g_free(d);
+}
+
+/**
+ * tlb_flush_pending_async_work:
+ * @cpu: cpu on which to flush
+ * @data: unused
+ *
+ * Run all of the flushes that other vCPUs queued for @cpu with
+ * tlb_flush_range_queue since the last time this ran.
+ */
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBCommon *c = &env_tlb(env)->c;
+    CPUTLBFlushRange pending[CPU_TLB_FLUSH_RANGES];
+    unsigned int i, n;
+    uint16_t full;
+
+    qemu_spin_lock(&c->lock);
+    n = c->nb_pending;
+    memcpy(pending, c->pending, n * sizeof(pending[0]));
+    full = c->pending_full;
+    c->nb_pending = 0;
+    c->pending_full = 0;
+    c->pending_queued = false;
+    qemu_spin_unlock(&c->lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        TLBFlushRangeData d = {
+            .addr = pending[i].addr,
+            .len = pending[i].len,
+            .idxmap = pending[i].idxmap & ~full,
+            .bits = pending[i].bits,
+        };
+
+        if (d.idxmap) {
+            tlb_flush_range_by_mmuidx_async_0(cpu, d);
+        }
+    }
+}
+
+/**
+ * tlb_flush_range_queue:
+ * @cpu: cpu on which to flush, other than the current one
+ * @d: page aligned range, set of mmu_idx and significant bits to flush
+ *
+ * Queue the flush of @d for @cpu, merging it with the flushes that are
+ * already waiting for @cpu, so that a storm of page flushes costs @cpu
+ * a single work item rather than one per page.  Flushes only drop
+ * entries, and @cpu does not run guest code until it has run its queued
+ * work, so that running this one along with earlier ones is fine.
+ */
+static void tlb_flush_range_queue(CPUState *cpu, TLBFlushRangeData d)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBCommon *c = &env_tlb(env)->c;
+    bool queue;
+    unsigned int i;
+
+    qemu_spin_lock(&c->lock);
+    for (i = 0; i < c->nb_pending; i++) {
+        CPUTLBFlushRange *r = &c->pending[i];
+        target_ulong r_end = r->addr + r->len - 1;
+        target_ulong d_end = d.addr + d.len - 1;
+
+        /* merge with a range that overlaps or abuts this one */
+        if (r->idxmap == d.idxmap && r->bits == d.bits &&
+            (d.addr <= r_end || d.addr == r_end + 1) &&
+            (r->addr <= d_end || r->addr == d_end + 1)) {
+            r->addr = MIN(r->addr, d.addr);
+            r->len = MAX(r_end, d_end) - r->addr + 1;
+            break;
+        }
+    }
+    if (i == c->nb_pending) {
+        if (i < CPU_TLB_FLUSH_RANGES) {
+            c->pending[c->nb_pending++] = (CPUTLBFlushRange) {
+                .addr = d.addr,
+                .len = d.len,
+                .idxmap = d.idxmap,
+                .bits = d.bits,
+            };
+        } else {
+            c->pending_full |= d.idxmap;
+        }
+    }
+    queue = !c->pending_queued;
+    if (queue) {
+        c->pending_queued = true;
+    } else {
+        qatomic_set(&c->coalesced_flush_count, c->coalesced_flush_count + 1);
+    }
+    qemu_spin_unlock(&c->lock);
+
+    if (queue) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async_work, RUN_ON_CPU_NULL);
+    }
+}
+
+/* Queue the flush of @d for every vCPU but @src_cpu. */
+static void tlb_flush_range_queue_others(CPUState *src_cpu,
+                                         TLBFlushRangeData d)
+{
+    CPUState *dst_cpu;
+
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_range_queue(dst_cpu, d);
+        }
+    }
+}
+
+/*
+ * Page align the range into @d.  Returns false if the flush devolves
+ * to a flush of the whole of each mmu_idx instead.
+ */
+static bool tlb_flush_range_data(TLBFlushRangeData *d, target_ulong addr,
+                                 target_ulong len, uint16_t idxmap,
+                                 unsigned bits)
+{
+    target_ulong end = addr + len - 1;
+
+    /* If no page bits are significant, or the range wraps around. */
+    if (bits < TARGET_PAGE_BITS || end < addr) {
+        return false;
+    }
+
+    d->addr = addr & TARGET_PAGE_MASK;
+    d->len = (end | ~TARGET_PAGE_MASK) - d->addr + 1;
+    d->idxmap = idxmap;
+    d->bits = MIN(bits, TARGET_LONG_BITS);
+
+    /* A range that covers the whole address space wraps its length. */
+    return d->len != 0;
+}
+
 /**
  * tlb_flush_page_by_mmuidx_async_0:
  * @cpu: cpu on which to flush
@@ -579,22 +881,8 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        tlb_flush_range_queue(cpu, TLB_FLUSH_PAGE_DATA(addr, idxmap));
     }
 }
 
@@ -611,30 +899,7 @@ void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
-    }
-
+    tlb_flush_range_queue_others(src_cpu, TLB_FLUSH_PAGE_DATA(addr, idxmap));
     tlb_flush_page_by_mmuidx_async_0(src_cpu, addr, idxmap);
 }
 
@@ -652,31 +917,21 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    tlb_flush_range_queue_others(src_cpu, TLB_FLUSH_PAGE_DATA(addr, idxmap));
+
     /*
      * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
+     * Most targets have only a few mmu_idx.  In the case where
+     * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
+     * allocating memory for this operation.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
+        /* Otherwise allocate a structure, freed by the worker.  */
         d->addr = addr;
         d->idxmap = idxmap;
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
@@ -689,144 +944,64 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
-static void tlb_flush_page_bits_locked(CPUArchState *env, int midx,
-                                       target_ulong page, unsigned bits)
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap,
+                               unsigned bits)
 {
-    CPUTLBDesc *d = &env_tlb(env)->d[midx];
-    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
-    target_ulong mask = MAKE_64BIT_MASK(0, bits);
+    TLBFlushRangeData d;
 
-    /*
-     * If @bits is smaller than the tlb size, there may be multiple entries
-     * within the TLB; otherwise all addresses that match under @mask hit
-     * the same TLB entry.
-     *
-     * TODO: Perhaps allow bits to be a few bits less than the size.
-     * For now, just flush the entire TLB.
-     */
-    if (mask < f->mask) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, page, mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-        return;
-    }
-
-    /* Check if we need to flush due to large pages.  */
-    if ((page & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+    if (!tlb_flush_range_data(&d, addr, len, idxmap, bits)) {
+        tlb_flush_by_mmuidx(cpu, idxmap);
         return;
     }
 
-    if (tlb_flush_entry_mask_locked(tlb_entry(env, midx, page), page, mask)) {
-        tlb_n_used_entries_dec(env, midx);
+    if (qemu_cpu_is_self(cpu)) {
+        tlb_flush_range_by_mmuidx_async_0(cpu, d);
+    } else {
+        tlb_flush_range_queue(cpu, d);
     }
-    tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
 }
 
-typedef struct {
-    target_ulong addr;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushPageBitsByMMUIdxData;
-
-static void
-tlb_flush_page_bits_by_mmuidx_async_0(CPUState *cpu,
-                                      TLBFlushPageBitsByMMUIdxData d)
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
+                                        target_ulong addr, target_ulong len,
+                                        uint16_t idxmap, unsigned bits)
 {
-    CPUArchState *env = cpu->env_ptr;
-    int mmu_idx;
-
-    assert_cpu_is_self(cpu);
-
-    tlb_debug("page addr:" TARGET_FMT_lx "/%u mmu_map:0x%x\n",
-              d.addr, d.bits, d.idxmap);
+    TLBFlushRangeData d;
 
-    qemu_spin_lock(&env_tlb(env)->c.lock);
-    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        if ((d.idxmap >> mmu_idx) & 1) {
-            tlb_flush_page_bits_locked(env, mmu_idx, d.addr, d.bits);
-        }
+    if (!tlb_flush_range_data(&d, addr, len, idxmap, bits)) {
+        tlb_flush_by_mmuidx_all_cpus(src_cpu, idxmap);
+        return;
     }
-    qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-    tb_flush_jmp_cache(cpu, d.addr);
+    tlb_flush_range_queue_others(src_cpu, d);
+    tlb_flush_range_by_mmuidx_async_0(src_cpu, d);
 }
 
-static bool encode_pbm_to_runon(run_on_cpu_data *out,
-                                TLBFlushPageBitsByMMUIdxData d)
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap,
+                                               unsigned bits)
 {
-    /* We need 6 bits to hold to hold @bits up to 63. */
-    if (d.idxmap <= MAKE_64BIT_MASK(0, TARGET_PAGE_BITS - 6)) {
-        *out = RUN_ON_CPU_TARGET_PTR(d.addr | (d.idxmap << 6) | d.bits);
-        return true;
-    }
-    return false;
-}
+    TLBFlushRangeData d, *p;
 
-static TLBFlushPageBitsByMMUIdxData
-decode_runon_to_pbm(run_on_cpu_data data)
-{
-    target_ulong addr_map_bits = (target_ulong) data.target_ptr;
-    return (TLBFlushPageBitsByMMUIdxData){
-        .addr = addr_map_bits & TARGET_PAGE_MASK,
-        .idxmap = (addr_map_bits & ~TARGET_PAGE_MASK) >> 6,
-        .bits = addr_map_bits & 0x3f
-    };
-}
+    if (!tlb_flush_range_data(&d, addr, len, idxmap, bits)) {
+        tlb_flush_by_mmuidx_all_cpus_synced(src_cpu, idxmap);
+        return;
+    }
 
-static void tlb_flush_page_bits_by_mmuidx_async_1(CPUState *cpu,
-                                                  run_on_cpu_data runon)
-{
-    tlb_flush_page_bits_by_mmuidx_async_0(cpu, decode_runon_to_pbm(runon));
-}
+    tlb_flush_range_queue_others(src_cpu, d);
 
-static void tlb_flush_page_bits_by_mmuidx_async_2(CPUState *cpu,
-                                                  run_on_cpu_data data)
-{
-    TLBFlushPageBitsByMMUIdxData *d = data.host_ptr;
-    tlb_flush_page_bits_by_mmuidx_async_0(cpu, *d);
-    g_free(d);
+    p = g_new(TLBFlushRangeData, 1);
+    *p = d;
+    async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
+                          RUN_ON_CPU_HOST_PTR(p));
 }
 
 void tlb_flush_page_bits_by_mmuidx(CPUState *cpu, target_ulong addr,
                                    uint16_t idxmap, unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
-
-    /* If all bits are significant, this devolves to tlb_flush_page. */
-    if (bits >= TARGET_LONG_BITS) {
-        tlb_flush_page_by_mmuidx(cpu, addr, idxmap);
-        return;
-    }
-    /* If no page bits are significant, this devolves to tlb_flush. */
-    if (bits < TARGET_PAGE_BITS) {
-        tlb_flush_by_mmuidx(cpu, idxmap);
-        return;
-    }
-
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (qemu_cpu_is_self(cpu)) {
-        tlb_flush_page_bits_by_mmuidx_async_0(cpu, d);
-    } else if (encode_pbm_to_runon(&runon, d)) {
-        async_run_on_cpu(cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-    } else {
-        TLBFlushPageBitsByMMUIdxData *p
-            = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        *p = d;
-        async_run_on_cpu(cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(p));
-    }
+    tlb_flush_range_by_mmuidx(cpu, addr, TARGET_PAGE_SIZE, idxmap, bits);
 }
 
 void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *src_cpu,
@@ -834,44 +1009,8 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *src_cpu,
                                             uint16_t idxmap,
                                             unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
-
-    /* If all bits are significant, this devolves to tlb_flush_page. */
-    if (bits >= TARGET_LONG_BITS) {
-        tlb_flush_page_by_mmuidx_all_cpus(src_cpu, addr, idxmap);
-        return;
-    }
-    /* If no page bits are significant, this devolves to tlb_flush. */
-    if (bits < TARGET_PAGE_BITS) {
-        tlb_flush_by_mmuidx_all_cpus(src_cpu, idxmap);
-        return;
-    }
-
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (encode_pbm_to_runon(&runon, d)) {
-        flush_all_helper(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageBitsByMMUIdxData *p;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-                *p = d;
-                async_run_on_cpu(dst_cpu,
-                                 tlb_flush_page_bits_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(p));
-            }
-        }
-    }
-
-    tlb_flush_page_bits_by_mmuidx_async_0(src_cpu, d);
+    tlb_flush_range_by_mmuidx_all_cpus(src_cpu, addr, TARGET_PAGE_SIZE,
+                                       idxmap, bits);
 }
 
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
@@ -879,48 +1018,8 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                    uint16_t idxmap,
                                                    unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
-
-    /* If all bits are significant, this devolves to tlb_flush_page. */
-    if (bits >= TARGET_LONG_BITS) {
-        tlb_flush_page_by_mmuidx_all_cpus_synced(src_cpu, addr, idxmap);
-        return;
-    }
-    /* If no page bits are significant, this devolves to tlb_flush. */
-    if (bits < TARGET_PAGE_BITS) {
-        tlb_flush_by_mmuidx_all_cpus_synced(src_cpu, idxmap);
-        return;
-    }
-
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (encode_pbm_to_runon(&runon, d)) {
-        flush_all_helper(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1,
-                              runon);
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageBitsByMMUIdxData *p;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-                *p = d;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(p));
-            }
-        }
-
-        p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-        *p = d;
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(p));
-    }
+    tlb_flush_range_by_mmuidx_all_cpus_synced(src_cpu, addr, TARGET_PAGE_SIZE,
+                                              idxmap, bits);
 }
 
 /* update the TLBs so that writes to code in the virtual page 'addr'
@@ -1809,6 +1908,33 @@ load_memop(const void *haddr, MemOp op)
     }
 }
 
+/*
+ * For a load of @size bytes at @addr that crosses into the next page,
+ * whose first page is in the TLB at @entry: if both pages are plain RAM
+ * in the TLB, copy the bytes from both pages to @buf and return true.
+ * This saves a full load through each page, which is common enough for
+ * guests that do not care about alignment, e.g. in memcpy().
+ */
+static bool __attribute__((noinline))
+load_cross_page_ram(CPUArchState *env, target_ulong addr, size_t size,
+                    uintptr_t mmu_idx, CPUTLBEntry *entry, size_t tlb_off,
+                    uint8_t *buf)
+{
+    target_ulong page2 = (addr + size) & TARGET_PAGE_MASK;
+    size_t size2 = (addr + size) & ~TARGET_PAGE_MASK;
+    size_t size1 = size - size2;
+    CPUTLBEntry *entry2 = tlb_entry(env, mmu_idx, page2);
+
+    /* This also checks that no flags are set for either page.  */
+    if (tlb_read_ofs(entry, tlb_off) != (addr & TARGET_PAGE_MASK) ||
+        tlb_read_ofs(entry2, tlb_off) != page2) {
+        return false;
+    }
+    memcpy(buf, (void *)((uintptr_t)addr + entry->addend), size1);
+    memcpy(buf + size1, (void *)((uintptr_t)page2 + entry2->addend), size2);
+    return true;
+}
+
 static inline uint64_t QEMU_ALWAYS_INLINE
 load_helper(CPUArchState *env, target_ulong addr, TCGMemOpIdx oi,
             uintptr_t retaddr, MemOp op, bool code_read,
@@ -1827,6 +1953,10 @@ load_helper(CPUArchState *env, target_ulong addr, TCGMemOpIdx oi,
     uint64_t res;
     size_t size = memop_size(op);
 
+    if (!code_read) {
+        tlb_stat_inc(&env_tlb(env)->c.slow_load_count);
+    }
+
     /* Handle CPU specific unaligned behaviour */
     if (addr & ((1 << a_bits) - 1)) {
         cpu_unaligned_access(env_cpu(env), addr, access_type,
@@ -1835,6 +1965,9 @@ load_helper(CPUArchState *env, target_ulong addr, TCGMemOpIdx oi,
 
     /* If the TLB entry is for a different page, reload and try again.  */
     if (!tlb_hit(tlb_addr, addr)) {
+        if (!code_read) {
+            tlb_stat_inc(&env_tlb(env)->c.slow_miss_count);
+        }
         if (!victim_tlb_hit(env, mmu_idx, index, tlb_off,
                             addr & TARGET_PAGE_MASK)) {
             tlb_fill(env_cpu(env), addr, size,
@@ -1893,6 +2026,18 @@ load_helper(CPUArchState *env, target_ulong addr, TCGMemOpIdx oi,
         target_ulong addr1, addr2;
         uint64_t r1, r2;
         unsigned shift;
+        uint8_t buf[8];
+
+        if (!code_read) {
+            tlb_stat_inc(&env_tlb(env)->c.slow_cross_count);
+        }
+        if (load_cross_page_ram(env, addr, size, mmu_idx, entry,
+                                tlb_off, buf)) {
+            if (!code_read) {
+                tlb_stat_inc(&env_tlb(env)->c.slow_cross_ram_count);
+            }
+            return load_memop(buf, op);
+        }
     do_unaligned_access:
         addr1 = addr & ~((target_ulong)size - 1);
         addr2 = addr1 + size;
@@ -2319,6 +2464,24 @@ store_helper_unaligned(CPUArchState *env, target_ulong addr, uint64_t val,
                              BP_MEM_WRITE, retaddr);
     }
 
+    /*
+     * When both pages are plain RAM, store the bytes directly rather
+     * than through one call of helper_ret_stb_mmu per byte.
+     */
+    if (tlb_addr == (addr & TARGET_PAGE_MASK) && tlb_addr2 == page2) {
+        uint8_t buf[8];
+        size_t size1 = size - size2;
+
+        for (i = 0; i < size; ++i) {
+            buf[i] = val >> (big_endian ? (size - 1 - i) * 8 : i * 8);
+        }
+        memcpy((void *)((uintptr_t)addr + entry->addend), buf, size1);
+        memcpy((void *)((uintptr_t)page2 + entry2->addend), buf + size1,
+               size2);
+        tlb_stat_inc(&env_tlb(env)->c.slow_cross_ram_count);
+        return;
+    }
+
     /*
      * XXX: not efficient, but simple.
      * This loop must go in the forward direction to avoid issues
@@ -2353,6 +2516,8 @@ store_helper(CPUArchState *env, target_ulong addr, uint64_t val,
     void *haddr;
     size_t size = memop_size(op);
 
+    tlb_stat_inc(&env_tlb(env)->c.slow_store_count);
+
     /* Handle CPU specific unaligned behaviour */
     if (addr & ((1 << a_bits) - 1)) {
         cpu_unaligned_access(env_cpu(env), addr, MMU_DATA_STORE,
@@ -2361,6 +2526,7 @@ store_helper(CPUArchState *env, target_ulong addr, uint64_t val,
 
     /* If the TLB entry is for a different page, reload and try again.  */
     if (!tlb_hit(tlb_addr, addr)) {
+        tlb_stat_inc(&env_tlb(env)->c.slow_miss_count);
         if (!victim_tlb_hit(env, mmu_idx, index, tlb_off,
             addr & TARGET_PAGE_MASK)) {
             tlb_fill(env_cpu(env), addr, size, MMU_DATA_STORE,
@@ -2428,6 +2594,7 @@ store_helper(CPUArchState *env, target_ulong addr, uint64_t val,
     if (size > 1
         && unlikely((addr & ~TARGET_PAGE_MASK) + size - 1
                      >= TARGET_PAGE_SIZE)) {
+        tlb_stat_inc(&env_tlb(env)->c.slow_cross_count);
     do_unaligned_access:
         store_helper_unaligned(env, addr, val, retaddr, size,
                                mmu_idx, memop_big_endian(op));
@@ -2687,6 +2854,10 @@ static uint64_t full_ldub_code(CPUArchState *env, target_ulong addr,
 uint32_t cpu_ldub_code(CPUArchState *env, abi_ptr addr)
 {
     TCGMemOpIdx oi = make_memop_idx(MO_UB, cpu_mmu_index(env, true));
+
+    if (unlikely(tb_spec_code)) {
+        return ldub_p(tb_spec_code_ptr(addr, 1));
+    }
     return full_ldub_code(env, addr, oi, 0);
 }
 
@@ -2699,6 +2870,10 @@ static uint64_t full_lduw_code(CPUArchState *env, target_ulong addr,
 uint32_t cpu_lduw_code(CPUArchState *env, abi_ptr addr)
 {
     TCGMemOpIdx oi = make_memop_idx(MO_TEUW, cpu_mmu_index(env, true));
+
+    if (unlikely(tb_spec_code)) {
+        return lduw_p(tb_spec_code_ptr(addr, 2));
+    }
     return full_lduw_code(env, addr, oi, 0);
 }
 
@@ -2711,6 +2886,10 @@ static uint64_t full_ldl_code(CPUArchState *env, target_ulong addr,
 uint32_t cpu_ldl_code(CPUArchState *env, abi_ptr addr)
 {
     TCGMemOpIdx oi = make_memop_idx(MO_TEUL, cpu_mmu_index(env, true));
+
+    if (unlikely(tb_spec_code)) {
+        return ldl_p(tb_spec_code_ptr(addr, 4));
+    }
     return full_ldl_code(env, addr, oi, 0);
 }
 
@@ -2723,5 +2902,9 @@ static uint64_t full_ldq_code(CPUArchState *env, target_ulong addr,
 uint64_t cpu_ldq_code(CPUArchState *env, abi_ptr addr)
 {
     TCGMemOpIdx oi = make_memop_idx(MO_TEQ, cpu_mmu_index(env, true));
+
+    if (unlikely(tb_spec_code)) {
+        return ldq_p(tb_spec_code_ptr(addr, 8));
+    }
     return full_ldq_code(env, addr, oi, 0);
 }
@@ -0,0 +1,487 @@
+/*
+ * Persistent translation block cache
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * The host code generated by TCG is not position independent: it embeds
+ * the address of its own TranslationBlock, of helpers and of some host
+ * objects.  Rather than relocating it, cached TBs are copied back to the
+ * very address they were generated at, which only works when the QEMU
+ * binary, its command line and the host address space layout are the
+ * same as in the run that saved them (e.g. repeated CI runs with ASLR
+ * disabled).  Anything else makes the whole file be ignored.
+ *
+ * A cached TB is only used once the guest code it was generated from has
+ * been compared byte for byte against guest memory, and is used at most
+ * once: afterwards it lives on as a regular TB, and is saved again from
+ * the region trees on exit.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu-version.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/ram_addr.h"
+#include "exec/tb-hash.h"
+#include "tcg/tcg.h"
+#include "qemu/error-report.h"
+#include "qemu/plugin.h"
+#include "qemu/rcu.h"
+#include "sysemu/sysemu.h"
+#include "translate-all.h"
+#include "tb-pcache.h"
+#include "trace.h"
+
+#define TB_PCACHE_MAGIC "QEMUTBC1"
+#define TB_PCACHE_CONFIG_LEN 32
+
+typedef struct TBPCacheHeader {
+    char magic[8];
+    /* SHA-256 of the QEMU version, binary and command line */
+    uint8_t config[TB_PCACHE_CONFIG_LEN];
+    uint64_t text;          /* host address of tb_gen_code() */
+    uint64_t buffer;        /* host address of the code_gen_buffer */
+    uint64_t buffer_size;
+    uint64_t env;           /* host address of the first CPU's env */
+    uint64_t nb_records;
+} TBPCacheHeader;
+
+/*
+ * Each record is followed by the guest code the TB was generated from and
+ * by the TB itself (TranslationBlock, host code and search data), both
+ * padded to 8 bytes.
+ */
+typedef struct TBPCacheRecord {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t phys_pc;
+    uint64_t phys_page2;
+    uint64_t blob;          /* host address of the TranslationBlock */
+    uint32_t blob_size;
+    uint32_t guest_size;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    uint32_t padding;
+} TBPCacheRecord;
+
+static struct {
+    QemuMutex lock;
+    char *path;
+    bool disabled;
+    uint8_t config[TB_PCACHE_CONFIG_LEN];
+    Notifier exit_notifier;
+
+    /* fields protected by the lock */
+    GMappedFile *file;
+    GHashTable *index;      /* records not taken yet */
+    uint64_t env;
+    bool env_checked;
+} pcache;
+
+/* number of entries in pcache.index, readable without the lock */
+static unsigned int pcache_pending;
+
+static const uint8_t *tb_pcache_guest(const TBPCacheRecord *r)
+{
+    return (const uint8_t *)(r + 1);
+}
+
+static const uint8_t *tb_pcache_blob(const TBPCacheRecord *r)
+{
+    return tb_pcache_guest(r) + ROUND_UP(r->guest_size, 8);
+}
+
+static size_t tb_pcache_record_size(const TBPCacheRecord *r)
+{
+    return sizeof(*r) + ROUND_UP(r->guest_size, 8) + ROUND_UP(r->blob_size, 8);
+}
+
+static guint tb_pcache_hash(gconstpointer key)
+{
+    const TBPCacheRecord *r = key;
+
+    return tb_hash_func(r->phys_pc, r->pc, r->flags, r->cflags & CF_HASH_MASK,
+                        r->trace_vcpu_dstate);
+}
+
+static gboolean tb_pcache_equal(gconstpointer a, gconstpointer b)
+{
+    const TBPCacheRecord *ra = a;
+    const TBPCacheRecord *rb = b;
+
+    return ra->pc == rb->pc &&
+           ra->cs_base == rb->cs_base &&
+           ra->phys_pc == rb->phys_pc &&
+           ra->flags == rb->flags &&
+           (ra->cflags & CF_HASH_MASK) == (rb->cflags & CF_HASH_MASK) &&
+           ra->trace_vcpu_dstate == rb->trace_vcpu_dstate;
+}
+
+static bool tb_pcache_config(uint8_t *digest)
+{
+    GChecksum *cs;
+    gsize len = TB_PCACHE_CONFIG_LEN;
+    gchar *cmdline;
+    gsize cmdline_len;
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) < 0 ||
+        !g_file_get_contents("/proc/self/cmdline", &cmdline, &cmdline_len,
+                             NULL)) {
+        return false;
+    }
+
+    cs = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(cs, (const guchar *)QEMU_FULL_VERSION,
+                      sizeof(QEMU_FULL_VERSION));
+    g_checksum_update(cs, (const guchar *)TARGET_NAME, sizeof(TARGET_NAME));
+    g_checksum_update(cs, (const guchar *)&st.st_size, sizeof(st.st_size));
+    g_checksum_update(cs, (const guchar *)&st.st_mtime, sizeof(st.st_mtime));
+    g_checksum_update(cs, (const guchar *)cmdline, cmdline_len);
+    g_checksum_get_digest(cs, digest, &len);
+    g_checksum_free(cs);
+    g_free(cmdline);
+    return true;
+}
+
+/* Length of the part of [pc, pc + size) that lies on the first page */
+static size_t tb_pcache_page1_len(target_ulong pc, size_t size)
+{
+    return MIN(size, TARGET_PAGE_SIZE - (pc & ~TARGET_PAGE_MASK));
+}
+
+/* Called with the RCU read lock held */
+static bool tb_pcache_guest_matches(const TBPCacheRecord *r)
+{
+    const uint8_t *guest = tb_pcache_guest(r);
+    size_t len = tb_pcache_page1_len(r->pc, r->guest_size);
+
+    if (memcmp(qemu_map_ram_ptr(NULL, r->phys_pc), guest, len)) {
+        return false;
+    }
+    return len == r->guest_size ||
+           !memcmp(qemu_map_ram_ptr(NULL, r->phys_page2), guest + len,
+                   r->guest_size - len);
+}
+
+/* Called with the lock held */
+static void tb_pcache_drop_locked(void)
+{
+    g_hash_table_remove_all(pcache.index);
+    qatomic_set(&pcache_pending, 0);
+    if (pcache.file) {
+        g_mapped_file_unref(pcache.file);
+        pcache.file = NULL;
+    }
+}
+
+static void tb_pcache_load(void)
+{
+    uint8_t *buf = tcg_init_ctx.code_gen_buffer;
+    size_t buf_size = tcg_init_ctx.code_gen_buffer_size;
+    const TBPCacheHeader *hdr;
+    const uint8_t *p, *end;
+    uint8_t *used_end = NULL;
+    GError *gerr = NULL;
+    uint64_t i;
+
+    pcache.file = g_mapped_file_new(pcache.path, FALSE, &gerr);
+    if (!pcache.file) {
+        /* a missing file simply means this run is going to create it */
+        if (!g_error_matches(gerr, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            warn_report("tb-cache: %s", gerr->message);
+        }
+        g_error_free(gerr);
+        return;
+    }
+
+    p = (const uint8_t *)g_mapped_file_get_contents(pcache.file);
+    end = p + g_mapped_file_get_length(pcache.file);
+    hdr = (const TBPCacheHeader *)p;
+    if (end - p < sizeof(*hdr) ||
+        memcmp(hdr->magic, TB_PCACHE_MAGIC, sizeof(hdr->magic)) ||
+        memcmp(hdr->config, pcache.config, sizeof(hdr->config)) ||
+        hdr->text != (uintptr_t)tb_gen_code ||
+        hdr->buffer != (uintptr_t)buf || hdr->buffer_size != buf_size) {
+        warn_report("tb-cache: %s was saved by a different QEMU binary, "
+                    "configuration or address space layout; ignoring it",
+                    pcache.path);
+        tb_pcache_drop_locked();
+        return;
+    }
+    pcache.env = hdr->env;
+
+    p += sizeof(*hdr);
+    for (i = 0; i < hdr->nb_records; i++) {
+        const TBPCacheRecord *r = (const TBPCacheRecord *)p;
+        const TranslationBlock *tb;
+        uint8_t *blob;
+
+        if (end - p < sizeof(*r) || end - p < tb_pcache_record_size(r)) {
+            warn_report("tb-cache: %s is truncated", pcache.path);
+            break;
+        }
+        p += tb_pcache_record_size(r);
+
+        blob = (uint8_t *)(uintptr_t)r->blob;
+        if (blob < buf || blob >= buf + buf_size ||
+            r->blob_size > buf + buf_size - blob ||
+            r->blob_size < sizeof(TranslationBlock)) {
+            continue;
+        }
+        tb = (const TranslationBlock *)tb_pcache_blob(r);
+        if ((uint8_t *)tb->tc.ptr < blob + sizeof(*tb) ||
+            (uint8_t *)tb->tc.ptr + tb->tc.size > blob + r->blob_size ||
+            tb->size != r->guest_size) {
+            continue;
+        }
+
+        memcpy(blob, tb_pcache_blob(r), r->blob_size);
+        g_hash_table_add(pcache.index, (gpointer)r);
+        used_end = MAX(used_end, blob + r->blob_size);
+    }
+
+    if (!used_end || !tcg_region_reserve(used_end)) {
+        if (used_end) {
+            warn_report("tb-cache: %s does not leave room for new "
+                        "translations; ignoring it", pcache.path);
+        }
+        tb_pcache_drop_locked();
+        return;
+    }
+    flush_icache_range((uintptr_t)buf, (uintptr_t)used_end);
+    qatomic_set(&pcache_pending, g_hash_table_size(pcache.index));
+    trace_tb_pcache_load(pcache.path, pcache_pending, used_end - buf);
+}
+
+/*
+ * Look up a cached TB for the given lookup key.  On success the TB still
+ * has to be reset and linked by the caller; @phys_page2 is set to the
+ * physical address of its second page, or -1.
+ */
+TranslationBlock *tb_pcache_take(CPUState *cpu, target_ulong pc,
+                                 target_ulong cs_base, uint32_t flags,
+                                 uint32_t cflags, tb_page_addr_t phys_pc,
+                                 tb_page_addr_t *phys_page2)
+{
+    TBPCacheRecord key = {
+        .pc = pc,
+        .cs_base = cs_base,
+        .phys_pc = phys_pc,
+        .flags = flags,
+        .cflags = cflags,
+        .trace_vcpu_dstate = *cpu->trace_dstate,
+    };
+    const TBPCacheRecord *r;
+    target_ulong virt_page2;
+
+    if (likely(!qatomic_read(&pcache_pending))) {
+        return NULL;
+    }
+    /* the cached TBs were not generated for single-stepping */
+    if (cpu->singlestep_enabled || singlestep) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&pcache.lock);
+    if (!pcache.env_checked) {
+        pcache.env_checked = true;
+        if (pcache.env != (uintptr_t)first_cpu->env_ptr ||
+            test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS, cpu->plugin_mask)) {
+            warn_report("tb-cache: the CPU state or plugins differ from "
+                        "the run that saved %s; ignoring it", pcache.path);
+            tb_pcache_drop_locked();
+            pcache.disabled = true;
+        }
+    }
+    r = g_hash_table_lookup(pcache.index, &key);
+    if (r) {
+        g_hash_table_remove(pcache.index, r);
+        qatomic_set(&pcache_pending, g_hash_table_size(pcache.index));
+    }
+    qemu_mutex_unlock(&pcache.lock);
+
+    if (!r) {
+        return NULL;
+    }
+
+    virt_page2 = (pc + r->guest_size - 1) & TARGET_PAGE_MASK;
+    *phys_page2 = -1;
+    if ((pc & TARGET_PAGE_MASK) != virt_page2) {
+        *phys_page2 = get_page_addr_code(cpu->env_ptr, virt_page2);
+    }
+    if (*phys_page2 != r->phys_page2 || !tb_pcache_guest_matches(r)) {
+        trace_tb_pcache_stale(pc);
+        return NULL;
+    }
+    trace_tb_pcache_hit((void *)(uintptr_t)r->blob, pc);
+    return (TranslationBlock *)(uintptr_t)r->blob;
+}
+
+/* Called from do_tb_flush(): the cached TBs are about to be overwritten */
+void tb_pcache_flush(void)
+{
+    if (!pcache.path) {
+        return;
+    }
+    qemu_mutex_lock(&pcache.lock);
+    tb_pcache_drop_locked();
+    qemu_mutex_unlock(&pcache.lock);
+}
+
+static bool tb_pcache_write_record(int fd, const TBPCacheRecord *r,
+                                   const void *guest, const void *blob)
+{
+    static const uint8_t zero[8];
+    size_t guest_pad = ROUND_UP(r->guest_size, 8) - r->guest_size;
+    size_t blob_pad = ROUND_UP(r->blob_size, 8) - r->blob_size;
+
+    return qemu_write_full(fd, r, sizeof(*r)) == sizeof(*r) &&
+           qemu_write_full(fd, guest, r->guest_size) == r->guest_size &&
+           qemu_write_full(fd, zero, guest_pad) == guest_pad &&
+           qemu_write_full(fd, blob, r->blob_size) == r->blob_size &&
+           qemu_write_full(fd, zero, blob_pad) == blob_pad;
+}
+
+/*
+ * Save a live TB.  The guest code is read back from guest memory: any
+ * write to it since the TB was linked has invalidated the TB, which is
+ * checked only after the copy so that a racing write is not missed.
+ */
+static bool tb_pcache_write_tb(int fd, TranslationBlock *tb, uint8_t *guest,
+                               uint64_t *nb_records)
+{
+    TBPCacheRecord r = {
+        .pc = tb->pc,
+        .cs_base = tb->cs_base,
+        .phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK),
+        .phys_page2 = tb->page_addr[1],
+        .blob = (uintptr_t)tb,
+        .guest_size = tb->size,
+        .flags = tb->flags,
+        .cflags = tb->cflags,
+        .trace_vcpu_dstate = tb->trace_vcpu_dstate,
+    };
+    size_t len = tb_pcache_page1_len(tb->pc, tb->size);
+
+    r.blob_size = (uint8_t *)tb->tc.ptr + tb->tc.size +
+                  tb_encoded_search_size(tb) - (uint8_t *)tb;
+
+    memcpy(guest, qemu_map_ram_ptr(NULL, r.phys_pc), len);
+    if (len < tb->size) {
+        memcpy(guest + len, qemu_map_ram_ptr(NULL, r.phys_page2),
+               tb->size - len);
+    }
+    smp_rmb();
+    if (qatomic_read(&tb->cflags) & CF_INVALID) {
+        return true;
+    }
+    (*nb_records)++;
+    return tb_pcache_write_record(fd, &r, guest, tb);
+}
+
+static gboolean tb_pcache_collect(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    /* a TB spans at most two pages */
+    if (!(tb->cflags & (CF_NOCACHE | CF_INVALID)) &&
+        tb->page_addr[0] != -1 && tb->size &&
+        tb->size <= TARGET_PAGE_SIZE * 2) {
+        g_ptr_array_add(data, tb);
+    }
+    return false;
+}
+
+static void tb_pcache_save(Notifier *notifier, void *data)
+{
+    g_autofree char *tmp = g_strdup_printf("%s.tmp", pcache.path);
+    TBPCacheHeader hdr = {
+        .text = (uintptr_t)tb_gen_code,
+        .buffer = (uintptr_t)tcg_init_ctx.code_gen_buffer,
+        .buffer_size = tcg_init_ctx.code_gen_buffer_size,
+        .env = first_cpu ? (uintptr_t)first_cpu->env_ptr : 0,
+    };
+    g_autoptr(GPtrArray) tbs = g_ptr_array_new();
+    g_autofree uint8_t *guest = g_malloc(TARGET_PAGE_SIZE * 2);
+    GHashTableIter iter;
+    gpointer key;
+    bool ok = true;
+    int fd, i;
+
+    if (pcache.disabled) {
+        return;
+    }
+
+    memcpy(hdr.magic, TB_PCACHE_MAGIC, sizeof(hdr.magic));
+    memcpy(hdr.config, pcache.config, sizeof(hdr.config));
+
+    fd = qemu_open_old(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        warn_report("tb-cache: cannot create %s: %s", tmp, strerror(errno));
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    qemu_mutex_lock(&pcache.lock);
+
+    ok = qemu_write_full(fd, &hdr, sizeof(hdr)) == sizeof(hdr);
+
+    /* the TBs restored but never used this time */
+    g_hash_table_iter_init(&iter, pcache.index);
+    while (ok && g_hash_table_iter_next(&iter, &key, NULL)) {
+        const TBPCacheRecord *r = key;
+
+        ok = tb_pcache_write_record(fd, r, tb_pcache_guest(r),
+                                    tb_pcache_blob(r));
+        hdr.nb_records++;
+    }
+
+    tcg_tb_foreach(tb_pcache_collect, tbs);
+    for (i = 0; ok && i < tbs->len; i++) {
+        ok = tb_pcache_write_tb(fd, g_ptr_array_index(tbs, i), guest,
+                                &hdr.nb_records);
+    }
+
+    qemu_mutex_unlock(&pcache.lock);
+
+    ok = ok && lseek(fd, 0, SEEK_SET) == 0 &&
+         qemu_write_full(fd, &hdr, sizeof(hdr)) == sizeof(hdr);
+    if (close(fd) < 0 || !ok || rename(tmp, pcache.path) < 0) {
+        warn_report("tb-cache: cannot write %s: %s", pcache.path,
+                    strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    trace_tb_pcache_save(pcache.path, hdr.nb_records);
+}
+
+/*
+ * Called by tcg_init() once the code_gen_buffer and its regions are set
+ * up, and before any vCPU thread allocates a region.
+ */
+void tb_pcache_init(const char *path)
+{
+    qemu_mutex_init(&pcache.lock);
+    pcache.path = g_strdup(path);
+    pcache.index = g_hash_table_new(tb_pcache_hash, tb_pcache_equal);
+
+    if (!tb_pcache_config(pcache.config)) {
+        warn_report("tb-cache: cannot identify the QEMU binary; "
+                    "the translation cache is disabled");
+        pcache.disabled = true;
+        return;
+    }
+
+    qemu_mutex_lock(&pcache.lock);
+    tb_pcache_load();
+    qemu_mutex_unlock(&pcache.lock);
+
+    pcache.exit_notifier.notify = tb_pcache_save;
+    qemu_add_exit_notifier(&pcache.exit_notifier);
+}
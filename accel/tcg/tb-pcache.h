@@ -0,0 +1,20 @@
+/*
+ * Persistent translation block cache
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef ACCEL_TCG_TB_PCACHE_H
+#define ACCEL_TCG_TB_PCACHE_H
+
+#include "exec/exec-all.h"
+
+/* tb-pcache.c */
+void tb_pcache_init(const char *path);
+TranslationBlock *tb_pcache_take(CPUState *cpu, target_ulong pc,
+                                 target_ulong cs_base, uint32_t flags,
+                                 uint32_t cflags, tb_page_addr_t phys_pc,
+                                 tb_page_addr_t *phys_page2);
+void tb_pcache_flush(void);
+
+#endif /* ACCEL_TCG_TB_PCACHE_H */
@@ -0,0 +1,374 @@
+/*
+ * Speculative translation of likely successor blocks
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * With MTTCG, each vCPU translates the blocks it misses on its own, so
+ * that cold code, e.g. while the guest boots, is translated one block at
+ * a time in between the execution of the previous ones.  A pool of
+ * threads, each with a TCG context and code_gen_buffer region of its own,
+ * translates ahead of the vCPUs the blocks they are likely to run next:
+ * the fall-through and the direct branch targets of each block that is
+ * translated, up to a few blocks deep.
+ *
+ * A pool thread cannot use the softmmu TLB of the vCPU it translates for,
+ * so it only translates successors that lie on the same guest page as the
+ * block they follow, from the physical page that block was translated
+ * from; code fetches anywhere else give up on the translation.  The TBs
+ * are keyed by physical address like any other, so that a speculative TB
+ * is only ever found by a vCPU that maps the page the same way.
+ *
+ * The translator must not read CPU state of the vCPU that can change
+ * while it runs, since a pool thread translates concurrently with it;
+ * only targets that define TARGET_TB_FLAGS_COMPLETE, whose translators
+ * depend on nothing but pc, cs_base and flags, can use the pool.
+ *
+ * Pool threads translate in parallel, each in its own region.  tb_flush()
+ * and region eviction pause the pool, which waits for the threads that
+ * are translating and keeps the others from starting.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/ram_addr.h"
+#include "exec/tb-hash.h"
+#include "tcg/tcg.h"
+#include "qemu/qht.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "tb-spec.h"
+#include "trace.h"
+
+/* pending requests; new requests are dropped when the queue is full */
+#define TB_SPEC_QUEUE_SIZE 1024
+/* successors of speculative TBs are translated up to this depth */
+#define TB_SPEC_MAX_DEPTH 4
+
+typedef struct TBSpecRequest {
+    CPUState *cpu;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    tb_page_addr_t page_addr;
+    int depth;
+} TBSpecRequest;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    QemuCond idle_cond;
+    unsigned int nr_threads;
+
+    /* fields protected by the lock */
+    bool started;
+    unsigned int head;
+    unsigned int tail;
+    TBSpecRequest queue[TB_SPEC_QUEUE_SIZE];
+    /* threads translating, and tb_spec_pause() callers holding them off */
+    unsigned int active;
+    unsigned int paused;
+} tb_spec;
+
+__thread TBSpecCode *tb_spec_code;
+
+/*
+ * Host address of the code at @addr, for a code load by a pool thread.
+ * Gives up on the translation when the load is not within the page being
+ * translated.
+ */
+void *tb_spec_code_ptr(target_ulong addr, int size)
+{
+    TBSpecCode *code = tb_spec_code;
+
+    if (addr - code->vaddr > TARGET_PAGE_SIZE - size) {
+        siglongjmp(code->jmp, 1);
+    }
+    return code->host + (addr - code->vaddr);
+}
+
+static void *tb_spec_thread(void *arg);
+
+/*
+ * Pool threads copy the TCG globals of the target in tcg_register_thread(),
+ * which only exist once the first vCPU has been realized, so they are
+ * started along with the first request rather than in tb_spec_init().
+ *
+ * Called with tb_spec.lock held.
+ */
+static void tb_spec_start(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < tb_spec.nr_threads; i++) {
+        QemuThread thread;
+        char name[16];
+
+        snprintf(name, sizeof(name), "tcg-spec/%u", i);
+        qemu_thread_create(&thread, name, tb_spec_thread, NULL,
+                           QEMU_THREAD_DETACHED);
+    }
+    tb_spec.started = true;
+}
+
+static void tb_spec_add(TBSpecRequest *req)
+{
+    bool queued = false;
+
+    qemu_mutex_lock(&tb_spec.lock);
+    if (!tb_spec.started) {
+        tb_spec_start();
+    }
+    if (tb_spec.tail - tb_spec.head < TB_SPEC_QUEUE_SIZE) {
+        object_ref(OBJECT(req->cpu));
+        tb_spec.queue[tb_spec.tail++ % TB_SPEC_QUEUE_SIZE] = *req;
+        qemu_cond_signal(&tb_spec.cond);
+        queued = true;
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+
+    if (queued) {
+        qatomic_set(&tb_ctx.tb_spec_requests, tb_ctx.tb_spec_requests + 1);
+    } else {
+        qatomic_set(&tb_ctx.tb_spec_dropped, tb_ctx.tb_spec_dropped + 1);
+    }
+}
+
+/*
+ * Collect in @succ the likely successors of @tb that are on its first
+ * page, from the TCG ops it was just translated to: the constants moved
+ * between each goto_tb and the matching exit_tb, which is where targets
+ * set the pc of a direct jump, and the address that follows @tb.
+ */
+int tb_spec_successors(TranslationBlock *tb, target_ulong *succ)
+{
+    target_ulong page = tb->pc & TARGET_PAGE_MASK;
+    target_ulong dest = 0;
+    bool in_goto_tb = false, found = false;
+    int i, n = 0;
+    TCGOp *op;
+
+    QTAILQ_FOREACH(op, &tcg_ctx->ops, link) {
+        switch (op->opc) {
+        case INDEX_op_goto_tb:
+            in_goto_tb = true;
+            found = false;
+            break;
+        case INDEX_op_movi_i32:
+        case INDEX_op_movi_i64:
+            if (in_goto_tb &&
+                ((target_ulong)op->args[1] & TARGET_PAGE_MASK) == page) {
+                dest = op->args[1];
+                found = true;
+            }
+            break;
+        case INDEX_op_exit_tb:
+            if (in_goto_tb && found && n < TB_SPEC_MAX_SUCC - 1) {
+                succ[n++] = dest;
+            }
+            in_goto_tb = false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    dest = tb->pc + tb->size;
+    if ((dest & TARGET_PAGE_MASK) == page) {
+        succ[n++] = dest;
+    }
+
+    /* drop duplicates, and loops back to @tb which exists already */
+    for (i = 0; i < n; i++) {
+        int j;
+
+        for (j = 0; j < i && succ[j] != succ[i]; j++) {
+            continue;
+        }
+        if (j < i || succ[i] == tb->pc) {
+            succ[i--] = succ[--n];
+        }
+    }
+    return n;
+}
+
+/*
+ * Ask the pool to translate the successors @succ of @tb, which @cpu has
+ * just translated.
+ */
+void tb_spec_request(CPUState *cpu, TranslationBlock *tb,
+                     const target_ulong *succ, int n)
+{
+    TBSpecRequest req = {
+        .cpu = cpu,
+        .cs_base = tb->cs_base,
+        .flags = tb->flags,
+        .cflags = tb->cflags & (CF_HASH_MASK & ~CF_COUNT_MASK),
+        .trace_vcpu_dstate = tb->trace_vcpu_dstate,
+        .page_addr = tb->page_addr[0],
+        .depth = tb_spec_code ? tb_spec_code->depth + 1 : 0,
+    };
+    int i;
+
+    if (!tb_spec.nr_threads || req.depth > TB_SPEC_MAX_DEPTH ||
+        !tb_trace_enabled(cpu, tb->cflags)) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        req.pc = succ[i];
+        tb_spec_add(&req);
+    }
+}
+
+static bool tb_spec_cmp(const void *p, const void *d)
+{
+    const TranslationBlock *tb = p;
+    const TBSpecRequest *req = d;
+
+    return tb->pc == req->pc &&
+           tb->page_addr[0] == req->page_addr &&
+           tb->cs_base == req->cs_base &&
+           tb->flags == req->flags &&
+           tb->trace_vcpu_dstate == req->trace_vcpu_dstate &&
+           (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == req->cflags;
+}
+
+/* Called with the RCU read lock held */
+static bool tb_spec_present(TBSpecRequest *req)
+{
+    tb_page_addr_t phys_pc = req->page_addr + (req->pc & ~TARGET_PAGE_MASK);
+    uint32_t h;
+
+    h = tb_hash_func(phys_pc, req->pc, req->flags, req->cflags,
+                     req->trace_vcpu_dstate);
+    return qht_lookup_custom(&tb_ctx.htable, req, h, tb_spec_cmp);
+}
+
+static void tb_spec_translate(TBSpecRequest *req)
+{
+    TBSpecCode code = {
+        .vaddr = req->pc & TARGET_PAGE_MASK,
+        .paddr = req->page_addr,
+        .depth = req->depth,
+    };
+    CPUState *cpu = req->cpu;
+    void *code_buf, *code_ptr;
+
+    rcu_read_lock();
+
+    /* the vCPU may have gone on to translate it, or be debugged now */
+    if (tb_spec_present(req) || !tb_trace_enabled(cpu, req->cflags)) {
+        qatomic_set(&tb_ctx.tb_spec_present, tb_ctx.tb_spec_present + 1);
+        goto out;
+    }
+
+    code.host = qemu_map_ram_ptr(NULL, req->page_addr);
+    code_buf = tcg_ctx->code_gen_buffer;
+    code_ptr = tcg_ctx->code_gen_ptr;
+    if (sigsetjmp(code.jmp, 0) == 0) {
+        tb_spec_code = &code;
+        tb_gen_code(cpu, req->pc, req->cs_base, req->flags, req->cflags);
+        qatomic_set(&tb_ctx.tb_spec_translated,
+                    tb_ctx.tb_spec_translated + 1);
+    } else {
+        /*
+         * Give back the space of the TB, as tb_gen_code() does when it
+         * finds the TB exists already; if tcg_tb_alloc() moved on to a
+         * new region, the one before is only partly used, like when the
+         * TB does not fit.
+         */
+        if (tcg_ctx->code_gen_buffer != code_buf) {
+            code_ptr = tcg_ctx->code_gen_buffer;
+        }
+        qatomic_set(&tcg_ctx->code_gen_ptr, code_ptr);
+        trace_tb_spec_abort(req->pc);
+        qatomic_set(&tb_ctx.tb_spec_aborted, tb_ctx.tb_spec_aborted + 1);
+    }
+    tb_spec_code = NULL;
+
+out:
+    rcu_read_unlock();
+}
+
+static void *tb_spec_thread(void *arg)
+{
+    TBSpecRequest req;
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock(&tb_spec.lock);
+    while (true) {
+        while (tb_spec.head == tb_spec.tail || tb_spec.paused) {
+            qemu_cond_wait(&tb_spec.cond, &tb_spec.lock);
+        }
+        req = tb_spec.queue[tb_spec.head++ % TB_SPEC_QUEUE_SIZE];
+        tb_spec.active++;
+        qemu_mutex_unlock(&tb_spec.lock);
+
+        tb_spec_translate(&req);
+
+        qemu_mutex_lock(&tb_spec.lock);
+        if (--tb_spec.active == 0 && tb_spec.paused) {
+            qemu_cond_broadcast(&tb_spec.idle_cond);
+        }
+        qemu_mutex_unlock(&tb_spec.lock);
+
+        object_unref(OBJECT(req.cpu));
+
+        qemu_mutex_lock(&tb_spec.lock);
+    }
+    return NULL;
+}
+
+/*
+ * Keep the pool out of code_gen_buffer, e.g. while it is flushed: wait for
+ * the translations in progress, and hold off new ones until resumed.
+ */
+void tb_spec_pause(void)
+{
+    if (!tb_spec.nr_threads) {
+        return;
+    }
+    qemu_mutex_lock(&tb_spec.lock);
+    tb_spec.paused++;
+    while (tb_spec.active) {
+        qemu_cond_wait(&tb_spec.idle_cond, &tb_spec.lock);
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+}
+
+void tb_spec_resume(void)
+{
+    if (!tb_spec.nr_threads) {
+        return;
+    }
+    qemu_mutex_lock(&tb_spec.lock);
+    assert(tb_spec.paused);
+    if (--tb_spec.paused == 0) {
+        qemu_cond_broadcast(&tb_spec.cond);
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+}
+
+/*
+ * Set up a pool of @nr_threads translation threads, which start with the
+ * first request.  Must be called after tcg_region_init(), which set aside
+ * a region for each of them.
+ */
+void tb_spec_init(unsigned int nr_threads)
+{
+    if (!nr_threads) {
+        return;
+    }
+    qemu_mutex_init(&tb_spec.lock);
+    qemu_cond_init(&tb_spec.cond);
+    qemu_cond_init(&tb_spec.idle_cond);
+    tb_spec.nr_threads = nr_threads;
+}
@@ -0,0 +1,45 @@
+/*
+ * Speculative translation of likely successor blocks
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef ACCEL_TCG_TB_SPEC_H
+#define ACCEL_TCG_TB_SPEC_H
+
+#include "exec/exec-all.h"
+
+#define TB_SPEC_MAX_THREADS 16
+#define TB_SPEC_MAX_SUCC 3
+
+/*
+ * Set while a translation pool thread translates a block.  The pool has
+ * no softmmu TLB of its own, so it may only fetch code from the guest
+ * page at @vaddr, which was mapped at @paddr when the request was made.
+ */
+typedef struct TBSpecCode {
+    target_ulong vaddr;
+    tb_page_addr_t paddr;
+    uint8_t *host;
+    int depth;
+    sigjmp_buf jmp;     /* to give up on the translation */
+} TBSpecCode;
+
+extern __thread TBSpecCode *tb_spec_code;
+
+/* tb-spec.c */
+void tb_spec_init(unsigned int nr_threads);
+int tb_spec_successors(TranslationBlock *tb, target_ulong *succ);
+void tb_spec_request(CPUState *cpu, TranslationBlock *tb,
+                     const target_ulong *succ, int n);
+void *tb_spec_code_ptr(target_ulong addr, int size);
+
+#ifdef CONFIG_SOFTMMU
+void tb_spec_pause(void);
+void tb_spec_resume(void);
+#else
+static inline void tb_spec_pause(void) { }
+static inline void tb_spec_resume(void) { }
+#endif
+
+#endif /* ACCEL_TCG_TB_SPEC_H */
@@ -33,12 +33,20 @@
 #include "hw/boards.h"
 #include "qapi/qapi-builtin-visit.h"
 #include "tcg-cpus.h"
+#include "tb-pcache.h"
+#include "tb-spec.h"
 
 struct TCGState {
     AccelState parent_obj;
 
     bool mttcg_enabled;
     unsigned long tb_size;
+    char *tb_cache;
+    uint32_t hot_threshold;
+    uint32_t smc_threshold;
+    uint32_t spec_threads;
+    uint32_t jmp_cache_bits;
+    bool jmp_cache_resize;
 };
 typedef struct TCGState TCGState;
 
@@ -94,6 +102,7 @@ static void tcg_accel_instance_init(Object *obj)
     TCGState *s = TCG_STATE(obj);
 
     s->mttcg_enabled = default_mttcg_enabled();
+    s->jmp_cache_bits = TB_JMP_CACHE_BITS;
 }
 
 bool mttcg_enabled;
@@ -102,14 +111,36 @@ static int tcg_init(MachineState *ms)
 {
     TCGState *s = TCG_STATE(current_accel());
 
+    if (s->spec_threads && !s->mttcg_enabled) {
+        warn_report("spec-threads needs thread=multi, ignoring it");
+        s->spec_threads = 0;
+    }
+#ifndef TARGET_TB_FLAGS_COMPLETE
+    if (s->spec_threads) {
+        warn_report("spec-threads is not supported by this target, "
+                    "ignoring it");
+        s->spec_threads = 0;
+    }
+#endif
+    tcg_spec_threads = s->spec_threads;
+
     tcg_exec_init(s->tb_size * 1024 * 1024);
     mttcg_enabled = s->mttcg_enabled;
+    tb_hot_threshold = s->hot_threshold;
+    tb_smc_threshold = s->smc_threshold;
+    tb_jmp_cache_bits = s->jmp_cache_bits;
+    tb_jmp_cache_resize_enabled = s->jmp_cache_resize;
 
     /*
      * Initialize TCG regions
      */
     tcg_region_init();
 
+    if (s->tb_cache) {
+        tb_pcache_init(s->tb_cache);
+    }
+    tb_spec_init(s->spec_threads);
+
     if (mttcg_enabled) {
         cpus_register_accel(&tcg_cpus_mttcg);
     } else if (icount_enabled()) {
@@ -179,6 +210,137 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+
+static void tcg_get_hot_threshold(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->hot_threshold, errp);
+}
+
+static void tcg_set_hot_threshold(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->hot_threshold = value;
+}
+
+static void tcg_get_smc_threshold(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->smc_threshold, errp);
+}
+
+static void tcg_set_smc_threshold(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->smc_threshold = value;
+}
+
+static void tcg_get_spec_threads(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->spec_threads, errp);
+}
+
+static void tcg_set_spec_threads(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > TB_SPEC_MAX_THREADS) {
+        error_setg(errp, "spec-threads must be at most %d",
+                   TB_SPEC_MAX_THREADS);
+        return;
+    }
+
+    s->spec_threads = value;
+}
+
+static void tcg_get_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->jmp_cache_bits, errp);
+}
+
+static void tcg_set_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < TB_JMP_CACHE_MIN_BITS || value > TB_JMP_CACHE_MAX_BITS) {
+        error_setg(errp, "jmp-cache-bits must be between %d and %d",
+                   TB_JMP_CACHE_MIN_BITS, TB_JMP_CACHE_MAX_BITS);
+        return;
+    }
+
+    s->jmp_cache_bits = value;
+}
+
+static bool tcg_get_jmp_cache_resize(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->jmp_cache_resize;
+}
+
+static void tcg_set_jmp_cache_resize(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->jmp_cache_resize = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -196,6 +358,45 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_str(oc, "tb-cache",
+                                  tcg_get_tb_cache,
+                                  tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File to load translated code from and save it to on exit");
+
+    object_class_property_add(oc, "hot-threshold", "uint32",
+        tcg_get_hot_threshold, tcg_set_hot_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "hot-threshold",
+        "Executions after which a TB and its hottest successors are "
+        "translated again as one superblock (0 disables)");
+
+    object_class_property_add(oc, "smc-threshold", "uint32",
+        tcg_get_smc_threshold, tcg_set_smc_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "smc-threshold",
+        "Writes to the code of a guest page after which its TBs check "
+        "their own code instead (0 disables)");
+
+    object_class_property_add(oc, "spec-threads", "uint32",
+        tcg_get_spec_threads, tcg_set_spec_threads,
+        NULL, NULL);
+    object_class_property_set_description(oc, "spec-threads",
+        "Threads that translate the likely successors of new TBs "
+        "ahead of the vCPUs (needs thread=multi, 32-bit Arm only)");
+
+    object_class_property_add(oc, "jmp-cache-bits", "uint32",
+        tcg_get_jmp_cache_bits, tcg_set_jmp_cache_bits,
+        NULL, NULL);
+    object_class_property_set_description(oc, "jmp-cache-bits",
+        "Initial and minimum size of the per-vCPU TB jump cache, in bits");
+
+    object_class_property_add_bool(oc, "jmp-cache-resize",
+                                   tcg_get_jmp_cache_resize,
+                                   tcg_set_jmp_cache_resize);
+    object_class_property_set_description(oc, "jmp-cache-resize",
+        "Grow and shrink the TB jump caches with their miss rate");
+
 }
 
 static const TypeInfo tcg_accel_type = {
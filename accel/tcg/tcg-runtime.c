@@ -164,6 +164,16 @@ void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     return tb->tc.ptr;
 }
 
+void HELPER(tb_hot)(CPUArchState *env, void *tb)
+{
+    tb_trace_hot(env_cpu(env), tb);
+}
+
+void HELPER(tb_smc_check)(CPUArchState *env, void *tb)
+{
+    tb_smc_check(env_cpu(env), tb, GETPC());
+}
+
 void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(env_cpu(env), GETPC());
@@ -50,7 +50,10 @@
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
 #include "translate-all.h"
+#include "tb-pcache.h"
+#include "tb-spec.h"
 #include "qemu/bitmap.h"
+#include "qemu/crc32c.h"
 #include "qemu/error-report.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
@@ -113,6 +116,13 @@ typedef struct PageDesc {
 #else
     unsigned long flags;
 #endif
+    /*
+     * Number of guest writes that invalidated code on the page.  Past
+     * tb_smc_threshold, smc_check is set: the page is no longer
+     * write-protected, and its TBs check their own code instead.
+     */
+    unsigned int smc_count;
+    bool smc_check;
 #ifndef CONFIG_USER_ONLY
     QemuSpin lock;
 #endif
@@ -220,6 +230,28 @@ static void *l1_map[V_L1_MAX_SIZE];
 TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
+
+/*
+ * Approximate set of the TBs dropped by flushes and evictions, indexed by
+ * a slice of their hash, used to account for the cost of translating
+ * them again.
+ */
+#define TB_RECLAIMED_BITS 16
+static unsigned long *tb_reclaimed;
+
+/*
+ * Hot traces whose first TB was invalidated so that it is translated
+ * again as a superblock, keyed like the TB hash table.
+ */
+static GHashTable *tb_traces;
+static QemuMutex tb_traces_lock;
+unsigned int tb_hot_threshold;
+unsigned int tb_smc_threshold;
+
+/* Initial, and smallest, size of the jump caches, in bits */
+unsigned int tb_jmp_cache_bits = TB_JMP_CACHE_BITS;
+bool tb_jmp_cache_resize_enabled;
+
 bool parallel_cpus;
 
 static void page_table_config_init(void)
@@ -288,6 +320,20 @@ static target_long decode_sleb128(uint8_t **pp)
     return val;
 }
 
+/* Return the number of bytes taken by the search data of TB, which
+   immediately follows its host code.  */
+size_t tb_encoded_search_size(const TranslationBlock *tb)
+{
+    uint8_t *start = tb->tc.ptr + tb->tc.size;
+    uint8_t *p = start;
+    int i, n = tb->icount * (TARGET_INSN_START_WORDS + 1);
+
+    for (i = 0; i < n; ++i) {
+        decode_sleb128(&p);
+    }
+    return p - start;
+}
+
 /* Encode the data collected about the instructions while compiling TB.
    Place the data at BLOCK, and return the number of bytes consumed.
 
@@ -1149,6 +1195,41 @@ static void tb_htable_init(void)
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
 }
 
+static guint tb_trace_hash(gconstpointer key)
+{
+    const TBTrace *t = key;
+
+    return tb_hash_func(t->phys_pc, t->blocks[0].pc, t->flags, t->cflags,
+                        t->trace_vcpu_dstate);
+}
+
+static gboolean tb_trace_equal(gconstpointer ap, gconstpointer bp)
+{
+    const TBTrace *a = ap;
+    const TBTrace *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+           a->blocks[0].pc == b->blocks[0].pc &&
+           a->cs_base == b->cs_base &&
+           a->flags == b->flags &&
+           a->cflags == b->cflags &&
+           a->trace_vcpu_dstate == b->trace_vcpu_dstate;
+}
+
+static void tb_traces_init(void)
+{
+    qemu_mutex_init(&tb_traces_lock);
+    tb_traces = g_hash_table_new_full(tb_trace_hash, tb_trace_equal,
+                                      g_free, NULL);
+}
+
+static void tb_traces_flush(void)
+{
+    qemu_mutex_lock(&tb_traces_lock);
+    g_hash_table_remove_all(tb_traces);
+    qemu_mutex_unlock(&tb_traces_lock);
+}
+
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
    (in bytes) allocated to the translation buffer. Zero means default
    size. */
@@ -1158,6 +1239,9 @@ void tcg_exec_init(unsigned long tb_size)
     cpu_gen_init();
     page_init();
     tb_htable_init();
+    tb_reclaimed = bitmap_new(1 << TB_RECLAIMED_BITS);
+    tb_ctx.tb_start_time = get_clock();
+    tb_traces_init();
     code_gen_alloc(tb_size);
 #if defined(CONFIG_SOFTMMU)
     /* There's no guest base to take into account, so go ahead and
@@ -1191,6 +1275,8 @@ static void page_flush_tb_1(int level, void **lp)
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
+            pd[i].smc_count = 0;
+            pd[i].smc_check = false;
             invalidate_page_bitmap(pd + i);
             page_unlock(&pd[i]);
         }
@@ -1221,11 +1307,48 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+static inline long tb_reclaimed_bit(tb_page_addr_t phys_pc, target_ulong pc,
+                                    uint32_t flags, uint32_t cf_mask,
+                                    uint32_t trace_vcpu_dstate)
+{
+    return tb_hash_func(phys_pc, pc, flags, cf_mask, trace_vcpu_dstate) &
+           ((1 << TB_RECLAIMED_BITS) - 1);
+}
+
+static void tb_mark_reclaimed(TranslationBlock *tb)
+{
+    tb_page_addr_t phys_pc;
+
+    if (tb->page_addr[0] == -1 || (tb->cflags & (CF_NOCACHE | CF_INVALID))) {
+        return;
+    }
+    phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+    set_bit_atomic(tb_reclaimed_bit(phys_pc, tb->pc, tb->flags,
+                                    tb->cflags & CF_HASH_MASK,
+                                    tb->trace_vcpu_dstate),
+                   tb_reclaimed);
+}
+
+static gboolean tb_mark_reclaimed_iter(gpointer key, gpointer value,
+                                       gpointer data)
+{
+    tb_mark_reclaimed(value);
+    return false;
+}
+
+/* number of flushes and evictions, to tell whether one happened meanwhile */
+static unsigned tb_reclaim_count(void)
+{
+    return qatomic_mb_read(&tb_ctx.tb_flush_count) +
+           qatomic_mb_read(&tb_ctx.tb_evict_count);
+}
+
 /* flush all the translation blocks */
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
     bool did_flush = false;
 
+    tb_spec_pause();
     mmap_lock();
     /* If it is already been done on request of another CPU,
      * just retry.
@@ -1244,6 +1367,8 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
                tcg_code_size(), nb_tbs, nb_tbs > 0 ? host_size / nb_tbs : 0);
     }
 
+    tcg_tb_foreach(tb_mark_reclaimed_iter, NULL);
+
     CPU_FOREACH(cpu) {
         cpu_tb_jmp_cache_clear(cpu);
     }
@@ -1252,12 +1377,18 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     page_flush_tb();
 
     tcg_region_reset_all();
+#ifdef CONFIG_SOFTMMU
+    tb_pcache_flush();
+#endif
+    tb_traces_flush();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
+    qatomic_set(&tb_ctx.tb_reclaim_time, get_clock());
     qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
 
 done:
     mmap_unlock();
+    tb_spec_resume();
     if (did_flush) {
         qemu_plugin_flush_cb();
     }
@@ -1277,6 +1408,80 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    size_t *nb_tbs = data;
+
+    if (!(tb->cflags & CF_INVALID)) {
+        tb_mark_reclaimed(tb);
+        tb_phys_invalidate(tb, -1);
+        (*nb_tbs)++;
+    }
+    return false;
+}
+
+/*
+ * Make room in code_gen_buffer by evicting its oldest regions, about an
+ * eighth of it, rather than flushing every translation.  Invalidating
+ * the evicted TBs unlinks them from the other TBs, the hash table, the
+ * page lists and the jump caches.  Falls back to a full flush when no
+ * region can be evicted, e.g. because each region is in use by a vCPU.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_reclaim_count_arg)
+{
+    size_t target = tcg_code_capacity() / 8;
+    size_t evicted = 0, nb_tbs = 0;
+
+    tb_spec_pause();
+    mmap_lock();
+    /* another CPU may have made room already */
+    if (tb_reclaim_count() != tb_reclaim_count_arg.host_int) {
+        mmap_unlock();
+        tb_spec_resume();
+        return;
+    }
+
+    while (evicted < target) {
+        size_t size = tcg_region_evict(tb_evict_iter, &nb_tbs);
+
+        if (!size) {
+            break;
+        }
+        evicted += size;
+    }
+
+    if (!evicted) {
+        mmap_unlock();
+        tb_spec_resume();
+        do_tb_flush(cpu,
+                    RUN_ON_CPU_HOST_INT(qatomic_read(&tb_ctx.tb_flush_count)));
+        return;
+    }
+
+#ifdef CONFIG_SOFTMMU
+    tb_pcache_flush();
+#endif
+    trace_tb_evict(evicted, nb_tbs);
+    qatomic_set(&tb_ctx.tb_evicted_tbs, tb_ctx.tb_evicted_tbs + nb_tbs);
+    qatomic_set(&tb_ctx.tb_reclaim_time, get_clock());
+    qatomic_mb_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+    mmap_unlock();
+    tb_spec_resume();
+    qemu_plugin_flush_cb();
+}
+
+static void tb_evict(CPUState *cpu)
+{
+    unsigned count = tb_reclaim_count();
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict, RUN_ON_CPU_HOST_INT(count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1465,10 +1670,15 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     }
 
     /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
+        TBJmpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (!jc) {
+            continue;
+        }
+        h = tb_jmp_cache_hash_func(tb->pc, jc->bits);
+        if (qatomic_read(&jc->array[h]) == tb) {
+            qatomic_set(&jc->array[h], NULL);
         }
     }
 
@@ -1554,6 +1764,11 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     p->first_tb = (uintptr_t)tb | n;
     invalidate_page_bitmap(p);
 
+    /* a self-checking TB need not be told about writes to its code */
+    if (p->smc_check && (tb->cflags & CF_SMC_CHECK)) {
+        return;
+    }
+
 #if defined(CONFIG_USER_ONLY)
     if (p->flags & PAGE_WRITE) {
         target_ulong addr;
@@ -1582,9 +1797,9 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     }
 #else
     /* if some code is already present, then the pages are already
-       protected. So we handle the case where only the first TB is
-       allocated in a physical page */
-    if (!page_already_protected) {
+       protected, unless they only hold self-checking TBs. So we handle
+       the case where only the first TB is allocated in a physical page */
+    if (!page_already_protected || p->smc_check) {
         tlb_protect_code(page_addr);
     }
 #endif
@@ -1670,6 +1885,319 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
+/*
+ * Account for the time spent translating again a TB that was flushed or
+ * evicted.  @start is 0 unless tb_gen_code() found the TB in tb_reclaimed.
+ */
+static void tb_account_retranslation(long bit, int64_t start)
+{
+    if (likely(!start)) {
+        return;
+    }
+    qatomic_and(&tb_reclaimed[BIT_WORD(bit)], ~BIT_MASK(bit));
+    stat64_add(&tb_ctx.tb_retrans_count, 1);
+    stat64_add(&tb_ctx.tb_retrans_time, get_clock() - start);
+}
+
+#ifdef CONFIG_SOFTMMU
+/*
+ * Bring a TB restored from the persistent cache back to the state
+ * tb_gen_code() leaves a freshly generated TB in, and link it.
+ */
+static TranslationBlock *
+tb_link_cached(TranslationBlock *tb, tb_page_addr_t phys_pc,
+               tb_page_addr_t phys_page2)
+{
+    TranslationBlock *existing_tb;
+
+    tb->cflags &= ~CF_INVALID;
+    tb->orig_tb = NULL;
+    tb->exec_count = 0;
+
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+
+    /* the saved code may still be chained to TBs of the previous run */
+    if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    existing_tb = tb_link_page(tb, phys_pc, phys_page2);
+    if (unlikely(existing_tb != tb)) {
+        tb_destroy(tb);
+        return existing_tb;
+    }
+    tcg_tb_insert(tb);
+    return tb;
+}
+#endif
+
+/* Whether TBs generated with @cflags may be profiled and joined in traces */
+bool tb_trace_enabled(CPUState *cpu, uint32_t cflags)
+{
+    if ((cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE | CF_USE_ICOUNT |
+                   CF_SMC_CHECK))
+        || cpu->singlestep_enabled || singlestep
+        || !QTAILQ_EMPTY(&cpu->breakpoints)) {
+        return false;
+    }
+#ifdef CONFIG_PLUGIN
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS, cpu->plugin_mask)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+/*
+ * Checksum of the @size bytes of guest code at @pc, whose first page is
+ * at @phys_pc and whose second page, if any, is at @phys_page2.
+ */
+static uint32_t tb_code_crc(tb_page_addr_t phys_pc, tb_page_addr_t phys_page2,
+                            target_ulong pc, target_ulong size)
+{
+#ifdef CONFIG_SOFTMMU
+    target_ulong len = TARGET_PAGE_SIZE - (pc & ~TARGET_PAGE_MASK);
+    uint32_t crc;
+
+    len = MIN(len, size);
+
+    crc = crc32c(0xffffffff, qemu_map_ram_ptr(NULL, phys_pc), len);
+    if (len < size) {
+        crc = crc32c(crc, qemu_map_ram_ptr(NULL, phys_page2), size - len);
+    }
+    return crc;
+#else
+    return crc32c(0xffffffff, g2h(pc), size);
+#endif
+}
+
+/* Checksum of the guest code covered by @trace */
+static uint32_t tb_trace_crc(const TBTrace *trace, target_ulong size)
+{
+    return tb_code_crc(trace->phys_pc, -1, trace->blocks[0].pc, size);
+}
+
+/*
+ * Whether @dest may follow the blocks of @trace, which start with @head.
+ * The superblock spans [head->pc, end of its last block), so that it is
+ * invalidated like any other TB when guest code in that range changes.
+ */
+static bool tb_trace_fits(const TBTrace *trace, const TranslationBlock *head,
+                          const TranslationBlock *dest, int icount)
+{
+    int i;
+
+    if ((qatomic_read(&dest->cflags) & (CF_INVALID | CF_TRACE)) ||
+        (dest->cflags & CF_HASH_MASK) != trace->cflags ||
+        dest->cs_base != trace->cs_base ||
+        dest->flags != trace->flags ||
+        dest->trace_vcpu_dstate != trace->trace_vcpu_dstate ||
+        dest->page_addr[0] != head->page_addr[0] ||
+        dest->page_addr[1] != -1 ||
+        dest->pc < head->pc ||
+        (dest->pc & TARGET_PAGE_MASK) != (head->pc & TARGET_PAGE_MASK) ||
+        icount + dest->icount > TCG_MAX_INSNS) {
+        return false;
+    }
+    for (i = 0; i < trace->n; i++) {
+        if (trace->blocks[i].pc == dest->pc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Called by the code of @tb once it has run tb_hot_threshold times.
+ * Follow the hottest chained exit of each TB from @tb on and, if this
+ * yields a trace of several TBs, invalidate @tb so that the next lookup
+ * translates the whole trace as one superblock.
+ */
+void tb_trace_hot(CPUState *cpu, TranslationBlock *tb)
+{
+    TranslationBlock *cur = tb;
+    TBTrace *trace;
+    target_ulong end = tb->pc;
+    int icount = 0;
+
+    if (tb->page_addr[1] != -1 ||
+        (qatomic_read(&tb->cflags) & (CF_INVALID | CF_TRACE))) {
+        return;
+    }
+
+    trace = g_new0(TBTrace, 1);
+    trace->phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+    trace->cs_base = tb->cs_base;
+    trace->flags = tb->flags;
+    trace->cflags = tb->cflags & CF_HASH_MASK;
+    trace->trace_vcpu_dstate = tb->trace_vcpu_dstate;
+
+    while (cur) {
+        TBTraceBlock *b = &trace->blocks[trace->n++];
+        TranslationBlock *next = NULL;
+        int i;
+
+        b->pc = cur->pc;
+        b->size = cur->size;
+        b->icount = cur->icount;
+        b->hot_exit = -1;
+        icount += cur->icount;
+        end = MAX(end, cur->pc + cur->size);
+
+        if (trace->n == TB_TRACE_MAX_BLOCKS) {
+            break;
+        }
+        for (i = 0; i < 2; i++) {
+            TranslationBlock *dest = (TranslationBlock *)
+                (qatomic_read(&cur->jmp_dest[i]) & ~(uintptr_t)1);
+
+            if (dest && dest != tb &&
+                tb_trace_fits(trace, tb, dest, icount) &&
+                (!next || qatomic_read(&dest->exec_count) >
+                          qatomic_read(&next->exec_count))) {
+                next = dest;
+                b->hot_exit = i;
+            }
+        }
+        cur = next;
+    }
+
+    if (trace->n < 2) {
+        g_free(trace);
+        return;
+    }
+    trace->crc = tb_trace_crc(trace, end - tb->pc);
+    trace_tb_trace_hot(tb->pc, trace->n, icount);
+
+    qemu_mutex_lock(&tb_traces_lock);
+    g_hash_table_add(tb_traces, trace);
+    qemu_mutex_unlock(&tb_traces_lock);
+
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    mmap_unlock();
+}
+
+/* Remove and return the trace starting with the TB to be generated, if any */
+static TBTrace *tb_trace_take(CPUState *cpu, tb_page_addr_t phys_pc,
+                              target_ulong pc, target_ulong cs_base,
+                              uint32_t flags, uint32_t cflags)
+{
+    TBTrace key = {
+        .phys_pc = phys_pc,
+        .cs_base = cs_base,
+        .flags = flags,
+        .cflags = cflags & CF_HASH_MASK,
+        .trace_vcpu_dstate = *cpu->trace_dstate,
+    };
+    TBTrace *trace;
+    target_ulong end = pc;
+    int i;
+
+    if (!tb_hot_threshold || !tb_trace_enabled(cpu, cflags)) {
+        return NULL;
+    }
+    key.blocks[0].pc = pc;
+
+    qemu_mutex_lock(&tb_traces_lock);
+    trace = g_hash_table_lookup(tb_traces, &key);
+    if (trace) {
+        g_hash_table_steal(tb_traces, trace);
+    }
+    qemu_mutex_unlock(&tb_traces_lock);
+    if (!trace) {
+        return NULL;
+    }
+
+    /* the guest code may have changed since the trace was formed */
+    for (i = 0; i < trace->n; i++) {
+        end = MAX(end, trace->blocks[i].pc + trace->blocks[i].size);
+    }
+    if (tb_trace_crc(trace, end - pc) != trace->crc) {
+        qatomic_set(&tb_ctx.tb_traces_dropped, tb_ctx.tb_traces_dropped + 1);
+        g_free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+static void tb_trace_drop(TBTrace *trace)
+{
+    trace_tb_trace_drop(trace->blocks[0].pc, trace->n);
+    qatomic_set(&tb_ctx.tb_traces_dropped, tb_ctx.tb_traces_dropped + 1);
+    g_free(trace);
+}
+
+/* Whether the TBs on the page at @page_addr must check their own code */
+static bool tb_page_smc_check(tb_page_addr_t page_addr)
+{
+    PageDesc *p;
+
+    if (!tb_smc_threshold || page_addr == -1) {
+        return false;
+    }
+    p = page_find(page_addr >> TARGET_PAGE_BITS);
+    return p && qatomic_read(&p->smc_check);
+}
+
+/*
+ * Called by a self-checking @tb before it runs.  If its guest code changed
+ * since it was translated, invalidate it and return to the main loop, which
+ * translates the new code.  Unlike with a write-protected page, a store
+ * by @tb to its own code is not seen by the rest of @tb.
+ */
+void tb_smc_check(CPUState *cpu, TranslationBlock *tb, uintptr_t retaddr)
+{
+    tb_page_addr_t phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+
+    if (likely(tb_code_crc(phys_pc, tb->page_addr[1], tb->pc, tb->size) ==
+               tb->smc_crc)) {
+        return;
+    }
+    trace_tb_smc_stale(tb->pc);
+    qatomic_set(&tb_ctx.tb_smc_stale, tb_ctx.tb_smc_stale + 1);
+
+    cpu_restore_state(cpu, retaddr, true);
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    mmap_unlock();
+    cpu_loop_exit_noexc(cpu);
+}
+
+/* true if called by a translation pool thread, see tb-spec.c */
+static inline bool tb_spec_running(void)
+{
+#ifdef CONFIG_SOFTMMU
+    return tb_spec_code != NULL;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Like get_page_addr_code(), also for a translation pool thread, which
+ * cannot use the TLB of @env but only translates code on the page its
+ * request was made for.
+ */
+static tb_page_addr_t tb_get_page_addr_code(CPUArchState *env,
+                                            target_ulong pc)
+{
+#ifdef CONFIG_SOFTMMU
+    if (unlikely(tb_spec_running())) {
+        return tb_spec_code->paddr + (pc & ~TARGET_PAGE_MASK);
+    }
+#endif
+    return get_page_addr_code(env, pc);
+}
+
 /* Called with mmap_lock held for user mode emulation.  */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
@@ -1681,6 +2209,13 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+    long reclaimed_bit = 0;
+    int64_t retrans_start = 0;
+    TBTrace *trace = NULL;
+#ifdef CONFIG_SOFTMMU
+    target_ulong spec_succ[TB_SPEC_MAX_SUCC];
+    int spec_n = 0;
+#endif
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1688,7 +2223,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     assert_memory_lock();
 
-    phys_pc = get_page_addr_code(env, pc);
+    phys_pc = tb_get_page_addr_code(env, pc);
 
     if (phys_pc == -1) {
         /* Generate a temporary TB with 1 insn in it */
@@ -1710,11 +2245,46 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         max_insns = 1;
     }
 
+    if (phys_pc != -1 && tb_page_smc_check(phys_pc)) {
+        cflags |= CF_SMC_CHECK;
+    }
+
+    if (phys_pc != -1) {
+        reclaimed_bit = tb_reclaimed_bit(phys_pc, pc, flags,
+                                         cflags & CF_HASH_MASK,
+                                         *cpu->trace_dstate);
+        if (unlikely(test_bit(reclaimed_bit, tb_reclaimed))) {
+            retrans_start = get_clock();
+        }
+        /* superblocks and cached code are left to the vCPUs */
+        if (likely(!tb_spec_running())) {
+            trace = tb_trace_take(cpu, phys_pc, pc, cs_base, flags, cflags);
+        }
+    }
+
+#ifdef CONFIG_SOFTMMU
+    if (phys_pc != -1 && !trace && !(cflags & CF_SMC_CHECK) &&
+        !tb_spec_running()) {
+        tb = tb_pcache_take(cpu, pc, cs_base, flags, cflags, phys_pc,
+                            &phys_page2);
+        if (tb) {
+            return tb_link_cached(tb, phys_pc, phys_page2);
+        }
+    }
+#endif
+
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+#ifdef CONFIG_SOFTMMU
+        /* leave it to the vCPUs to make room */
+        if (unlikely(tb_spec_running())) {
+            siglongjmp(tb_spec_code->jmp, 1);
+        }
+#endif
+        /* make room, dropping the oldest translations */
+        g_free(trace);
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1729,6 +2299,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cflags = cflags;
     tb->orig_tb = NULL;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1741,9 +2312,39 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_func_start(tcg_ctx);
 
     tcg_ctx->cpu = env_cpu(env);
+    tcg_ctx->trace = trace;
     gen_intermediate_code(cpu, tb, max_insns);
+    tcg_ctx->trace = NULL;
     tcg_ctx->cpu = NULL;
 
+    if (unlikely(trace && tcg_ctx->trace_failed)) {
+        /*
+         * A block of the trace did not translate as before.  Translate
+         * the first one on its own, without profiling it again.
+         */
+        tb_trace_drop(trace);
+        trace = NULL;
+        goto tb_overflow;
+    }
+    tcg_ctx->trace_failed = false;
+
+    /* a block that runs into a self-checking page must check itself too */
+    virt_page2 = (pc + tb->size - 1) & TARGET_PAGE_MASK;
+    if (!(cflags & CF_SMC_CHECK) && tb_smc_threshold &&
+        phys_pc != -1 && (pc & TARGET_PAGE_MASK) != virt_page2 &&
+        tb_page_smc_check(get_page_addr_code(env, virt_page2))) {
+        cflags |= CF_SMC_CHECK;
+        tb->cflags = cflags;
+        tcg_ctx->tb_cflags = cflags;
+        goto tb_overflow;
+    }
+
+#ifdef CONFIG_SOFTMMU
+    if (tcg_spec_threads && phys_pc != -1) {
+        spec_n = tb_spec_successors(tb, spec_succ);
+    }
+#endif
+
     trace_translate_block(tb, tb->pc, tb->tc.ptr);
 
     /* generate machine code */
@@ -1789,7 +2390,14 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
              *
              * Try again with half as many insns as we attempted this time.
              * If a single insn overflows, there's a bug somewhere...
+             * A superblock is given up rather than shortened.
              */
+            if (trace) {
+                tb_trace_drop(trace);
+                trace = NULL;
+                tcg_ctx->trace_failed = true;
+                goto tb_overflow;
+            }
             max_insns = tb->icount;
             assert(max_insns > 1);
             max_insns /= 2;
@@ -1804,6 +2412,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+    if (trace) {
+        tb->cflags |= CF_TRACE;
+        qatomic_set(&tb_ctx.tb_traces, tb_ctx.tb_traces + 1);
+        g_free(trace);
+        trace = NULL;
+    }
 
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
@@ -1903,6 +2517,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
+    if (cflags & CF_SMC_CHECK) {
+        tb->smc_crc = tb_code_crc(phys_pc, phys_page2, pc, tb->size);
+    }
     /*
      * No explicit memory barrier is required -- tb_link_page() makes the
      * TB visible in a consistent state.
@@ -1915,9 +2532,16 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
         tb_destroy(tb);
+        tb_account_retranslation(reclaimed_bit, retrans_start);
         return existing_tb;
     }
     tcg_tb_insert(tb);
+    tb_account_retranslation(reclaimed_bit, retrans_start);
+#ifdef CONFIG_SOFTMMU
+    if (spec_n) {
+        tb_spec_request(cpu, tb, spec_succ, spec_n);
+    }
+#endif
     return tb;
 }
 
@@ -2072,6 +2696,26 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
     page_collection_unlock(pages);
 }
 
+/*
+ * Account for a guest write to code on the page @p at @addr.  Returns
+ * true if the page has just been written to tb_smc_threshold times: the
+ * write protection of the page then costs more than TBs that check their
+ * own code each time they run.
+ *
+ * Called with @p->lock held.
+ */
+static bool tb_page_smc_write(PageDesc *p, tb_page_addr_t addr)
+{
+    if (!tb_smc_threshold || p->smc_check ||
+        ++p->smc_count < tb_smc_threshold) {
+        return false;
+    }
+    qatomic_set(&p->smc_check, true);
+    qatomic_set(&tb_ctx.tb_smc_pages, tb_ctx.tb_smc_pages + 1);
+    trace_tb_smc_page(addr & TARGET_PAGE_MASK);
+    return true;
+}
+
 #ifdef CONFIG_SOFTMMU
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
@@ -2108,6 +2752,11 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
         }
     } else {
     do_invalidate:
+        if (tb_page_smc_write(p, start)) {
+            /* drop all the TBs that do not check themselves */
+            start &= TARGET_PAGE_MASK;
+            len = TARGET_PAGE_SIZE;
+        }
         tb_invalidate_phys_page_range__locked(pages, p, start, start + len,
                                               retaddr);
     }
@@ -2142,6 +2791,9 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
         return false;
     }
 
+    if (p->first_tb) {
+        tb_page_smc_write(p, addr);
+    }
 #ifdef TARGET_HAS_PRECISE_SMC
     if (p->first_tb && pc != 0) {
         current_tb = tcg_tb_lookup(pc);
@@ -2280,12 +2932,83 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
     cpu_loop_exit_noexc(cpu);
 }
 
+static TBJmpCache *tb_jmp_cache_new(unsigned int bits)
+{
+    TBJmpCache *jc;
+
+    jc = g_malloc0(sizeof(TBJmpCache) + (sizeof(TranslationBlock *) << bits));
+    jc->bits = bits;
+    return jc;
+}
+
+void tb_jmp_cache_init(CPUState *cpu)
+{
+    cpu->tb_jmp_cache = tb_jmp_cache_new(tb_jmp_cache_bits);
+}
+
+void tb_jmp_cache_free(CPUState *cpu)
+{
+    TBJmpCache *jc = cpu->tb_jmp_cache;
+
+    if (jc) {
+        qatomic_rcu_set(&cpu->tb_jmp_cache, NULL);
+        g_free_rcu(jc, rcu);
+    }
+}
+
+/**
+ * tb_jmp_cache_resize - resize the jump cache of @cpu if needed
+ * @cpu: the vCPU that owns the jump cache; must be the current thread
+ *
+ * Called once TB_JMP_CACHE_WINDOW lookups have been made since the last
+ * call, in the same fashion as tlb_mmu_resize_locked() sizes the TLB:
+ * the cache is doubled if more than one lookup in eight missed it during
+ * the window, and halved, but never below tb_jmp_cache_bits, if fewer than
+ * one lookup in 64 missed it and no more than an eighth of it is in use.
+ * Concurrent invalidations may still clear entries of the old table until
+ * it is reclaimed by RCU; they are harmless.
+ *
+ * Returns the jump cache of @cpu, which is a new table if it was resized.
+ */
+TBJmpCache *tb_jmp_cache_resize(CPUState *cpu)
+{
+    TBJmpCache *jc = cpu->tb_jmp_cache;
+    TBJmpCache *new_jc;
+    size_t misses = jc->misses - jc->window_misses;
+    size_t lookups = jc->hits - jc->window_hits + misses;
+    unsigned int bits = jc->bits;
+
+    jc->window_hits = jc->hits;
+    jc->window_misses = jc->misses;
+
+    if (misses > lookups / 8 && bits < TB_JMP_CACHE_MAX_BITS) {
+        bits++;
+    } else if (misses < lookups / 64 && bits > tb_jmp_cache_bits &&
+               jc->used < (1u << jc->bits) / 8) {
+        bits--;
+    } else {
+        return jc;
+    }
+
+    new_jc = tb_jmp_cache_new(bits);
+    new_jc->hits = new_jc->window_hits = jc->hits;
+    new_jc->misses = new_jc->window_misses = jc->misses;
+    trace_tb_jmp_cache_resize(cpu->cpu_index, 1u << jc->bits, 1u << bits,
+                              misses, lookups);
+
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+    return new_jc;
+}
+
 static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 {
-    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
+    TBJmpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr, jc->bits);
+    unsigned int n = 1u << tb_jmp_page_bits(jc->bits);
 
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+    for (i = 0; i < n; i++) {
+        qatomic_set(&jc->array[i0 + i], NULL);
     }
 }
 
@@ -2297,6 +3020,27 @@ void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
     tb_jmp_cache_clear_page(cpu, addr);
 }
 
+void tb_flush_jmp_cache_range(CPUState *cpu, target_ulong addr,
+                              target_ulong len)
+{
+    TBJmpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+    unsigned int nb_groups = 1u << (jc->bits - tb_jmp_page_bits(jc->bits));
+    target_ulong i;
+
+    /*
+     * Past as many pages as the jump cache has groups of entries for,
+     * clearing it page by page no longer leaves anything behind.
+     */
+    if ((len - 1) >> TARGET_PAGE_BITS >= nb_groups - 1) {
+        cpu_tb_jmp_cache_clear(cpu);
+        return;
+    }
+    tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
+    for (i = 0; i < len; i += TARGET_PAGE_SIZE) {
+        tb_jmp_cache_clear_page(cpu, addr + i);
+    }
+}
+
 static void print_qht_statistics(struct qht_stats hst)
 {
     uint32_t hgram_opts;
@@ -2334,6 +3078,33 @@ static void print_qht_statistics(struct qht_stats hst)
     g_free(hgram);
 }
 
+static void print_jmp_cache_statistics(void)
+{
+    size_t hits = 0, misses = 0;
+    unsigned int min_bits = UINT_MAX, max_bits = 0;
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        TBJmpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (!jc) {
+            continue;
+        }
+        hits += qatomic_read(&jc->hits);
+        misses += qatomic_read(&jc->misses);
+        min_bits = MIN(min_bits, jc->bits);
+        max_bits = MAX(max_bits, jc->bits);
+    }
+    if (!max_bits) {
+        return;
+    }
+    qemu_printf("TB jump cache size  %u-%u entries per vCPU\n",
+                1u << min_bits, 1u << max_bits);
+    qemu_printf("TB jump cache hits  %zu/%zu (%0.2f%%)\n", hits, hits + misses,
+                hits + misses ? (double)hits / (hits + misses) * 100 : 0);
+}
+
 struct tb_tree_stats {
     size_t nb_tbs;
     size_t host_size;
@@ -2372,6 +3143,10 @@ void dump_exec_info(void)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t flush_coalesced;
+    size_t slow_loads, slow_stores, slow_misses, slow_cross, slow_cross_ram;
+    unsigned flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+    unsigned evict_count = qatomic_read(&tb_ctx.tb_evict_count);
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2402,17 +3177,54 @@ void dump_exec_info(void)
     qht_statistics_init(&tb_ctx.htable, &hst);
     print_qht_statistics(hst);
     qht_statistics_destroy(&hst);
+    print_jmp_cache_statistics();
 
     qemu_printf("\nStatistics:\n");
-    qemu_printf("TB flush count      %u\n",
-                qatomic_read(&tb_ctx.tb_flush_count));
+    qemu_printf("TB flush count      %u\n", flush_count);
+    qemu_printf("TB evict count      %u (%zu TBs)\n", evict_count,
+                qatomic_read(&tb_ctx.tb_evicted_tbs));
+    if (flush_count + evict_count) {
+        int64_t now = get_clock();
+
+        qemu_printf("TB reclaim interval avg %0.1f s, last %0.1f s ago\n",
+                    (double)(now - tb_ctx.tb_start_time) /
+                    (flush_count + evict_count) / NANOSECONDS_PER_SECOND,
+                    (double)(now - qatomic_read(&tb_ctx.tb_reclaim_time)) /
+                    NANOSECONDS_PER_SECOND);
+    }
+    qemu_printf("TB retranslations   %" PRIu64 " (%" PRIu64 " us)\n",
+                stat64_get(&tb_ctx.tb_retrans_count),
+                stat64_get(&tb_ctx.tb_retrans_time) / SCALE_US);
+    qemu_printf("TB superblocks      %zu (%zu traces dropped)\n",
+                qatomic_read(&tb_ctx.tb_traces),
+                qatomic_read(&tb_ctx.tb_traces_dropped));
+    qemu_printf("TB self-checking    %zu pages (%zu stale TBs)\n",
+                qatomic_read(&tb_ctx.tb_smc_pages),
+                qatomic_read(&tb_ctx.tb_smc_stale));
+    qemu_printf("TB speculative      %zu translated, %zu requests "
+                "(%zu present, %zu aborted, %zu dropped)\n",
+                qatomic_read(&tb_ctx.tb_spec_translated),
+                qatomic_read(&tb_ctx.tb_spec_requests),
+                qatomic_read(&tb_ctx.tb_spec_present),
+                qatomic_read(&tb_ctx.tb_spec_aborted),
+                qatomic_read(&tb_ctx.tb_spec_dropped));
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide,
+                     &flush_coalesced);
     qemu_printf("TLB full flushes    %zu\n", flush_full);
     qemu_printf("TLB partial flushes %zu\n", flush_part);
     qemu_printf("TLB elided flushes  %zu\n", flush_elide);
+    qemu_printf("TLB merged flushes  %zu\n", flush_coalesced);
+
+    tlb_slow_path_counts(&slow_loads, &slow_stores, &slow_misses,
+                         &slow_cross, &slow_cross_ram);
+    qemu_printf("TLB slow path       %zu loads, %zu stores\n",
+                slow_loads, slow_stores);
+    qemu_printf("TLB slow misses     %zu\n", slow_misses);
+    qemu_printf("TLB page-crossing   %zu (%zu RAM to RAM)\n",
+                slow_cross, slow_cross_ram);
     tcg_dump_info();
 }
 
@@ -14,6 +14,7 @@
 #include "tcg/tcg-op.h"
 #include "exec/exec-all.h"
 #include "exec/gen-icount.h"
+#include "exec/helper-gen.h"
 #include "exec/log.h"
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
@@ -32,33 +33,15 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
-void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
-                     CPUState *cpu, TranslationBlock *tb, int max_insns)
+/*
+ * Translate guest instructions from db->pc_next until the target or the
+ * limits in @db end the block.  Returns 1 if the last instruction hit a
+ * breakpoint and should not be counted, 0 otherwise.
+ */
+static int translator_insns(const TranslatorOps *ops, DisasContextBase *db,
+                            CPUState *cpu, bool plugin_enabled)
 {
     int bp_insn = 0;
-    bool plugin_enabled;
-
-    /* Initialize DisasContext */
-    db->tb = tb;
-    db->pc_first = tb->pc;
-    db->pc_next = db->pc_first;
-    db->is_jmp = DISAS_NEXT;
-    db->num_insns = 0;
-    db->max_insns = max_insns;
-    db->singlestep_enabled = cpu->singlestep_enabled;
-
-    ops->init_disas_context(db, cpu);
-    tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
-
-    /* Reset the temp count so that we can identify leaks */
-    tcg_clear_temp_count();
-
-    /* Start translating.  */
-    gen_tb_start(db->tb);
-    ops->tb_start(db, cpu);
-    tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
-
-    plugin_enabled = plugin_gen_tb_start(cpu, tb);
 
     while (true) {
         db->num_insns++;
@@ -123,19 +106,111 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
             break;
         }
     }
+    return bp_insn;
+}
 
-    /* Emit code to exit the TB, as indicated by db->is_jmp.  */
-    ops->tb_stop(db, cpu);
-    gen_tb_end(db->tb, db->num_insns - bp_insn);
+/*
+ * Count the executions of @tb, and ask for a trace to be formed from it
+ * once the count reaches tb_hot_threshold.  The count is not atomic:
+ * losing an increment to another vCPU only delays the trace.
+ */
+static void gen_tb_profile(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(tb);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *skip = gen_new_label();
 
-    if (plugin_enabled) {
-        plugin_gen_tb_end(cpu);
+    tcg_gen_ld_i32(count, ptr, offsetof(TranslationBlock, exec_count));
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, offsetof(TranslationBlock, exec_count));
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, tb_hot_threshold, skip);
+    gen_helper_tb_hot(cpu_env, ptr);
+    gen_set_label(skip);
+
+    tcg_temp_free_i32(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+/*
+ * Translate the blocks of tcg_ctx->trace one after the other into @tb.
+ * Each block but the last continues with the next one through its hot
+ * goto_tb, see tcg_gen_goto_tb().  Every block must be translated exactly
+ * as it was the first time; otherwise trace_failed is set and
+ * tb_gen_code() translates @tb again on its own.
+ */
+static void translator_trace(const TranslatorOps *ops, DisasContextBase *db,
+                             CPUState *cpu, TranslationBlock *tb)
+{
+    const TBTrace *trace = tcg_ctx->trace;
+    TranslationBlock block = *tb;
+    target_ulong end = tb->pc;
+    int i, num_insns = 0;
+
+    tcg_ctx->trace_tb = tb;
+
+    /* Reset the temp count so that we can identify leaks */
+    tcg_clear_temp_count();
+
+    gen_tb_start(tb);
+
+    for (i = 0; i < trace->n; i++) {
+        const TBTraceBlock *b = &trace->blocks[i];
+
+        /* Let the target see each block as a TB of its own */
+        block.pc = b->pc;
+        db->tb = i == 0 ? tb : &block;
+        db->pc_first = b->pc;
+        db->pc_next = b->pc;
+        db->is_jmp = DISAS_NEXT;
+        db->num_insns = 0;
+        db->max_insns = b->icount;
+        db->singlestep_enabled = cpu->singlestep_enabled;
+
+        ops->init_disas_context(db, cpu);
+        tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
+        ops->tb_start(db, cpu);
+        tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
+
+        if (i + 1 < trace->n) {
+            tcg_ctx->trace_next = gen_new_label();
+            tcg_ctx->trace_hot_exit = b->hot_exit;
+        }
+
+        if (translator_insns(ops, db, cpu, false)
+            || db->num_insns != b->icount
+            || db->pc_next != b->pc + b->size) {
+            tcg_ctx->trace_failed = true;
+            break;
+        }
+        ops->tb_stop(db, cpu);
+
+        num_insns += db->num_insns;
+        end = MAX(end, db->pc_next);
+        if (tcg_ctx->trace_next) {
+            gen_set_label(tcg_ctx->trace_next);
+            tcg_ctx->trace_next = NULL;
+        }
     }
 
-    /* The disas_log hook may use these values rather than recompute.  */
-    db->tb->size = db->pc_next - db->pc_first;
-    db->tb->icount = db->num_insns;
+    tcg_ctx->trace_next = NULL;
+    tcg_ctx->trace_tb = NULL;
+    if (tcg_ctx->trace_failed) {
+        return;
+    }
 
+    gen_tb_end(tb, num_insns);
+
+    db->tb = tb;
+    db->pc_first = tb->pc;
+    db->pc_next = end;
+    db->num_insns = num_insns;
+    tb->size = end - tb->pc;
+    tb->icount = num_insns;
+}
+
+static void translator_log(const TranslatorOps *ops, DisasContextBase *db,
+                           CPUState *cpu)
+{
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
         && qemu_log_in_addr_range(db->pc_first)) {
@@ -147,3 +222,67 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     }
 #endif
 }
+
+void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
+                     CPUState *cpu, TranslationBlock *tb, int max_insns)
+{
+    int bp_insn = 0;
+    bool plugin_enabled;
+
+    if (tcg_ctx->trace) {
+        translator_trace(ops, db, cpu, tb);
+        if (!tcg_ctx->trace_failed) {
+            translator_log(ops, db, cpu);
+        }
+        return;
+    }
+
+    /* Initialize DisasContext */
+    db->tb = tb;
+    db->pc_first = tb->pc;
+    db->pc_next = db->pc_first;
+    db->is_jmp = DISAS_NEXT;
+    db->num_insns = 0;
+    db->max_insns = max_insns;
+    db->singlestep_enabled = cpu->singlestep_enabled;
+
+    ops->init_disas_context(db, cpu);
+    tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
+
+    /* Reset the temp count so that we can identify leaks */
+    tcg_clear_temp_count();
+
+    /* Start translating.  */
+    gen_tb_start(db->tb);
+    if (tb_cflags(tb) & CF_SMC_CHECK) {
+        TCGv_ptr ptr = tcg_const_ptr(tb);
+
+        gen_helper_tb_smc_check(cpu_env, ptr);
+        tcg_temp_free_ptr(ptr);
+    }
+    /* A TB whose trace could not be translated is not profiled again */
+    if (tb_hot_threshold && !tcg_ctx->trace_failed
+        && tb_trace_enabled(cpu, tb_cflags(tb))) {
+        gen_tb_profile(tb);
+    }
+    ops->tb_start(db, cpu);
+    tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
+
+    plugin_enabled = plugin_gen_tb_start(cpu, tb);
+
+    bp_insn = translator_insns(ops, db, cpu, plugin_enabled);
+
+    /* Emit code to exit the TB, as indicated by db->is_jmp.  */
+    ops->tb_stop(db, cpu);
+    gen_tb_end(db->tb, db->num_insns - bp_insn);
+
+    if (plugin_enabled) {
+        plugin_gen_tb_end(cpu);
+    }
+
+    /* The disas_log hook may use these values rather than recompute.  */
+    db->tb->size = db->pc_next - db->pc_first;
+    db->tb->icount = db->num_insns;
+
+    translator_log(ops, db, cpu);
+}
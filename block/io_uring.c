@@ -16,18 +16,32 @@
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
+#include "qemu/error-report.h"
+#include "exec/cpu-common.h"
+#include "exec/ramlist.h"
 #include "qapi/error.h"
 #include "trace.h"
 
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Number of slots in the registered file table */
+#define MAX_FIXED_FILES 64
+
+/*
+ * The kernel limits registered buffers to 1 GiB each and (before Linux 5.12)
+ * to UIO_MAXIOV of them, so guest RAM is registered in chunks.
+ */
+#define FIXED_BUF_MAX_SIZE (1ULL << 30)
+#define MAX_FIXED_BUFS 1024
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
+    bool fixed_buf;
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
     /*
@@ -56,6 +70,29 @@ typedef struct LuringState {
 
     /* I/O completion processing.  Only runs in I/O thread.  */
     QEMUBH *completion_bh;
+
+    /*
+     * Registered files, see luring_register_fd().  NULL until the first file
+     * is registered, afterwards MAX_FIXED_FILES entries with -1 for unused
+     * slots.  Protected by AioContext lock.
+     */
+    int *fixed_fds;
+
+    /*
+     * Registered guest RAM, see luring_enable_fixed_buffers().  Array of
+     * struct iovec sorted by iov_base; the array index is the buf_index of
+     * READ_FIXED/WRITE_FIXED requests.  Protected by AioContext lock.
+     *
+     * When RAM blocks come and go, the array changes at once but the ring
+     * keeps the old registration, which requests use by index, until no
+     * request uses it any more (fixed_bufs_stale).
+     */
+    bool fixed_bufs_enabled;
+    bool fixed_bufs_registered;
+    bool fixed_bufs_stale;
+    unsigned int fixed_bufs_in_use;
+    RAMBlockNotifier ram_notifier;
+    GArray *fixed_bufs;
 } LuringState;
 
 /**
@@ -88,6 +125,16 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     trace_luring_resubmit_short_read(s, luringcb, nread);
 
+    /* Fixed buffers are contiguous, just advance into the buffer */
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->total_read += nread;
+        luringcb->sqeq.off += nread;
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len -= nread;
+        luring_resubmit(s, luringcb);
+        return;
+    }
+
     /* Update read position */
     luringcb->total_read = nread;
     remaining = luringcb->qiov->size - luringcb->total_read;
@@ -123,6 +170,8 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
  * canceled.
  *
  */
+static void luring_update_fixed_bufs(LuringState *s);
+
 static void luring_process_completions(LuringState *s)
 {
     struct io_uring_cqe *cqes;
@@ -194,6 +243,11 @@ end:
         luringcb->ret = ret;
         qemu_iovec_destroy(&luringcb->resubmit_qiov);
 
+        if (luringcb->fixed_buf && --s->fixed_bufs_in_use == 0 &&
+            s->fixed_bufs_stale) {
+            luring_update_fixed_bufs(s);
+        }
+
         /*
          * If the coroutine is already entered it must be in ioq_submit()
          * and will notice luringcb->ret has been filled in when it
@@ -312,6 +366,64 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
     }
 }
 
+/**
+ * luring_fixed_file_index:
+ *
+ * Returns the slot of @fd in the registered file table, or -1 if @fd is not
+ * registered.
+ */
+static int luring_fixed_file_index(LuringState *s, int fd)
+{
+    int i;
+
+    if (!s->fixed_fds) {
+        return -1;
+    }
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_fds[i] == fd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * luring_fixed_buf_index:
+ *
+ * Returns the index of the registered buffer that contains the single
+ * element of @qiov, or -1 if the request cannot use a fixed buffer.
+ */
+static int luring_fixed_buf_index(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t start, end;
+    int lo, hi;
+
+    if (!s->fixed_bufs_registered || s->fixed_bufs_stale ||
+        qiov->niov != 1) {
+        return -1;
+    }
+
+    start = (uintptr_t)qiov->iov[0].iov_base;
+    end = start + qiov->iov[0].iov_len;
+
+    lo = 0;
+    hi = s->fixed_bufs->len - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        struct iovec *buf = &g_array_index(s->fixed_bufs, struct iovec, mid);
+        uintptr_t buf_start = (uintptr_t)buf->iov_base;
+
+        if (start < buf_start) {
+            hi = mid - 1;
+        } else if (start >= buf_start + buf->iov_len) {
+            lo = mid + 1;
+        } else {
+            return end <= buf_start + buf->iov_len ? mid : -1;
+        }
+    }
+    return -1;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -328,15 +440,32 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    struct iovec *iov;
+    int file_index = luring_fixed_file_index(s, fd);
+    int buf_index = -1;
 
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        buf_index = luring_fixed_buf_index(s, luringcb->qiov);
+        if (buf_index >= 0) {
+            iov = &luringcb->qiov->iov[0];
+            io_uring_prep_write_fixed(sqes, fd, iov->iov_base, iov->iov_len,
+                                      offset, buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
+                                 luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        buf_index = luring_fixed_buf_index(s, luringcb->qiov);
+        if (buf_index >= 0) {
+            iov = &luringcb->qiov->iov[0];
+            io_uring_prep_read_fixed(sqes, fd, iov->iov_base, iov->iov_len,
+                                     offset, buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
+                                luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -346,6 +475,14 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (buf_index >= 0) {
+        luringcb->fixed_buf = true;
+        s->fixed_bufs_in_use++;
+    }
+    if (file_index >= 0) {
+        sqes->fd = file_index;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -402,7 +539,220 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_completion_cb, NULL, qemu_luring_poll_cb, s);
 }
 
-LuringState *luring_init(Error **errp)
+/**
+ * luring_register_fd:
+ * @s: AIO state
+ * @fd: file descriptor
+ *
+ * Adds @fd to the registered file table of the ring so that requests for it
+ * skip the file descriptor lookup in the kernel.  Must be undone with
+ * luring_unregister_fd() before @fd is closed.
+ *
+ * Returns: 0 on success, -errno on failure.  Requests for @fd still work
+ * if registration fails.
+ */
+int luring_register_fd(LuringState *s, int fd)
+{
+    int i, ret;
+
+    if (!s->fixed_fds) {
+        int *fds = g_new(int, MAX_FIXED_FILES);
+
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            fds[i] = -1;
+        }
+        ret = io_uring_register_files(&s->ring, fds, MAX_FIXED_FILES);
+        if (ret < 0) {
+            g_free(fds);
+            return ret;
+        }
+        s->fixed_fds = fds;
+    }
+
+    i = luring_fixed_file_index(s, -1);
+    if (i < 0) {
+        return -ENFILE;
+    }
+
+    ret = io_uring_register_files_update(&s->ring, i, &fd, 1);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->fixed_fds[i] = fd;
+    trace_luring_register_fd(s, fd, i);
+    return 0;
+}
+
+void luring_unregister_fd(LuringState *s, int fd)
+{
+    int i = luring_fixed_file_index(s, fd);
+    int unused = -1;
+
+    if (i < 0) {
+        return;
+    }
+
+    io_uring_register_files_update(&s->ring, i, &unused, 1);
+    s->fixed_fds[i] = -1;
+    trace_luring_unregister_fd(s, fd, i);
+}
+
+static gint luring_fixed_buf_compare(gconstpointer a, gconstpointer b)
+{
+    uintptr_t base_a = (uintptr_t)((const struct iovec *)a)->iov_base;
+    uintptr_t base_b = (uintptr_t)((const struct iovec *)b)->iov_base;
+
+    return base_a < base_b ? -1 : base_a > base_b;
+}
+
+/**
+ * luring_update_fixed_bufs:
+ *
+ * Replaces the buffers registered with the ring by the current contents of
+ * s->fixed_bufs.  If the kernel refuses them (e.g. because of
+ * RLIMIT_MEMLOCK) requests fall back to unregistered buffers.
+ *
+ * Must not be called while requests use the registered buffers, whose
+ * buf_index would then refer to a different buffer.
+ */
+static void luring_update_fixed_bufs(LuringState *s)
+{
+    int ret;
+
+    assert(s->fixed_bufs_in_use == 0);
+    s->fixed_bufs_stale = false;
+
+    if (s->fixed_bufs_registered) {
+        io_uring_unregister_buffers(&s->ring);
+        s->fixed_bufs_registered = false;
+    }
+
+    if (s->fixed_bufs->len == 0) {
+        return;
+    }
+
+    g_array_sort(s->fixed_bufs, luring_fixed_buf_compare);
+    ret = io_uring_register_buffers(&s->ring,
+                                    (struct iovec *)s->fixed_bufs->data,
+                                    s->fixed_bufs->len);
+    trace_luring_register_buffers(s, s->fixed_bufs->len, ret);
+    if (ret < 0) {
+        warn_report_once("Failed to register guest RAM with io_uring, "
+                         "falling back to unregistered buffers: %s",
+                         strerror(-ret));
+        return;
+    }
+    s->fixed_bufs_registered = true;
+}
+
+/**
+ * luring_fixed_bufs_changed:
+ *
+ * Stops new requests from using the registered buffers after s->fixed_bufs
+ * changed, and re-registers them once the requests in flight that use them
+ * have completed, from luring_process_completions() in the AioContext of
+ * the ring.
+ */
+static void luring_fixed_bufs_changed(LuringState *s)
+{
+    s->fixed_bufs_stale = true;
+    if (s->fixed_bufs_in_use == 0) {
+        luring_update_fixed_bufs(s);
+    }
+}
+
+static void luring_add_ram(LuringState *s, void *host, size_t size)
+{
+    uint8_t *p = host;
+
+    while (size > 0) {
+        struct iovec buf = {
+            .iov_base = p,
+            .iov_len = MIN(size, FIXED_BUF_MAX_SIZE),
+        };
+
+        if (s->fixed_bufs->len == MAX_FIXED_BUFS) {
+            warn_report_once("Too many RAM blocks to register with io_uring");
+            return;
+        }
+        g_array_append_val(s->fixed_bufs, buf);
+        p += buf.iov_len;
+        size -= buf.iov_len;
+    }
+}
+
+static void luring_ram_block_added(RAMBlockNotifier *n, void *host,
+                                   size_t size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+
+    aio_context_acquire(s->aio_context);
+    luring_add_ram(s, host, size);
+    luring_fixed_bufs_changed(s);
+    aio_context_release(s->aio_context);
+}
+
+static void luring_ram_block_removed(RAMBlockNotifier *n, void *host,
+                                     size_t size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+    uintptr_t start = (uintptr_t)host;
+    int i;
+
+    if (!host) {
+        return;
+    }
+
+    aio_context_acquire(s->aio_context);
+    for (i = s->fixed_bufs->len - 1; i >= 0; i--) {
+        struct iovec *buf = &g_array_index(s->fixed_bufs, struct iovec, i);
+        uintptr_t base = (uintptr_t)buf->iov_base;
+
+        if (base >= start && base < start + size) {
+            g_array_remove_index(s->fixed_bufs, i);
+        }
+    }
+    luring_fixed_bufs_changed(s);
+    aio_context_release(s->aio_context);
+}
+
+static int luring_init_ramblock(RAMBlock *rb, void *opaque)
+{
+    LuringState *s = opaque;
+    void *host = qemu_ram_get_host_addr(rb);
+
+    if (host) {
+        luring_add_ram(s, host, qemu_ram_get_used_length(rb));
+    }
+    return 0;
+}
+
+/**
+ * luring_enable_fixed_buffers:
+ * @s: AIO state
+ *
+ * Registers all guest RAM with the ring and keeps the registration up to
+ * date when RAM blocks are added or removed.  Single-buffer reads and writes
+ * that fall inside guest RAM are then submitted as READ_FIXED/WRITE_FIXED,
+ * which avoids pinning the pages for every request.
+ */
+void luring_enable_fixed_buffers(LuringState *s)
+{
+    if (s->fixed_bufs_enabled) {
+        return;
+    }
+
+    s->fixed_bufs_enabled = true;
+    s->fixed_bufs = g_array_new(false, false, sizeof(struct iovec));
+    s->ram_notifier.ram_block_added = luring_ram_block_added;
+    s->ram_notifier.ram_block_removed = luring_ram_block_removed;
+    ram_block_notifier_add(&s->ram_notifier);
+    qemu_ram_foreach_block(luring_init_ramblock, s);
+    luring_update_fixed_bufs(s);
+}
+
+LuringState *luring_init(AioContext *ctx, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
@@ -410,9 +760,14 @@ LuringState *luring_init(Error **errp)
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
-    if (rc < 0) {
-        error_setg_errno(errp, errno, "failed to init linux io_uring ring");
+    rc = aio_context_io_uring_queue_init(ctx, MAX_ENTRIES, ring);
+    if (rc == -ENOTSUP) {
+        error_setg(errp, "io_uring SQPOLL is not supported by the host "
+                   "kernel for unregistered files (needs Linux 5.11)");
+        g_free(s);
+        return NULL;
+    } else if (rc < 0) {
+        error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
@@ -424,6 +779,11 @@ LuringState *luring_init(Error **errp)
 
 void luring_cleanup(LuringState *s)
 {
+    if (s->fixed_bufs_enabled) {
+        ram_block_notifier_remove(&s->ram_notifier);
+        g_array_free(s->fixed_bufs, true);
+    }
+    g_free(s->fixed_fds);
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
     g_free(s);
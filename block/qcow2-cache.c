@@ -23,6 +23,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
 #include "qcow2.h"
 #include "trace.h"
 
@@ -31,6 +32,8 @@ typedef struct Qcow2CachedTable {
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    QTAILQ_ENTRY(Qcow2CachedTable) lru_next;
+    QTAILQ_ENTRY(Qcow2CachedTable) dirty_next;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -42,6 +45,19 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+
+    /* Maps the offset of every cached table to its Qcow2CachedTable */
+    GHashTable             *index;
+
+    /*
+     * All entries with ref == 0, least recently used first.  Unused entries
+     * (offset == 0) are kept at the head so that they are reused before any
+     * cached table gets evicted.
+     */
+    QTAILQ_HEAD(, Qcow2CachedTable) lru;
+
+    /* All entries with dirty == true */
+    QTAILQ_HEAD(, Qcow2CachedTable) dirty;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -57,6 +73,25 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline int qcow2_cache_entry_idx(Qcow2Cache *c, Qcow2CachedTable *t)
+{
+    return t - c->entries;
+}
+
+/* Drop the table held by @t from the index and mark the entry as unused */
+static void qcow2_cache_entry_reset(Qcow2Cache *c, Qcow2CachedTable *t)
+{
+    if (t->offset) {
+        g_hash_table_remove(c->index, &t->offset);
+    }
+    if (t->dirty) {
+        QTAILQ_REMOVE(&c->dirty, t, dirty_next);
+        t->dirty = false;
+    }
+    t->offset = 0;
+    t->lru_counter = 0;
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -84,35 +119,43 @@ static void qcow2_cache_table_release(Qcow2Cache *c, int i, int num_tables)
 #endif
 }
 
-static inline bool can_clean_entry(Qcow2Cache *c, int i)
-{
-    Qcow2CachedTable *t = &c->entries[i];
-    return t->ref == 0 && !t->dirty && t->offset != 0 &&
-        t->lru_counter <= c->cache_clean_lru_counter;
-}
-
 void qcow2_cache_clean_unused(Qcow2Cache *c)
 {
-    int i = 0;
-    while (i < c->size) {
-        int to_clean = 0;
-
-        /* Skip the entries that we don't need to clean */
-        while (i < c->size && !can_clean_entry(c, i)) {
-            i++;
+    Qcow2CachedTable *t, *next;
+    unsigned long *cleaned = NULL;
+    long i, end;
+
+    /*
+     * The LRU list is sorted by lru_counter, so only the entries up to the
+     * first one that has been used since the last call need to be visited.
+     */
+    QTAILQ_FOREACH_SAFE(t, &c->lru, lru_next, next) {
+        if (t->offset == 0 || t->dirty) {
+            continue;
         }
+        if (t->lru_counter > c->cache_clean_lru_counter) {
+            break;
+        }
+
+        qcow2_cache_entry_reset(c, t);
+        QTAILQ_REMOVE(&c->lru, t, lru_next);
+        QTAILQ_INSERT_HEAD(&c->lru, t, lru_next);
 
-        /* And count how many we can clean in a row */
-        while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
-            i++;
-            to_clean++;
+        if (!cleaned) {
+            cleaned = bitmap_new(c->size);
         }
+        set_bit(qcow2_cache_entry_idx(c, t), cleaned);
+    }
 
-        if (to_clean > 0) {
-            qcow2_cache_table_release(c, i - to_clean, to_clean);
+    /* Release the memory of adjacent cleaned tables together */
+    if (cleaned) {
+        i = find_first_bit(cleaned, c->size);
+        while (i < c->size) {
+            end = find_next_zero_bit(cleaned, c->size, i);
+            qcow2_cache_table_release(c, i, end - i);
+            i = find_next_bit(cleaned, c->size, end);
         }
+        g_free(cleaned);
     }
 
     c->cache_clean_lru_counter = c->lru_counter;
@@ -123,6 +166,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int i;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -140,7 +184,14 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
         qemu_vfree(c->table_array);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    c->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&c->lru);
+    QTAILQ_INIT(&c->dirty);
+    for (i = 0; i < num_tables; i++) {
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], lru_next);
     }
 
     return c;
@@ -154,6 +205,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
         assert(c->entries[i].ref == 0);
     }
 
+    g_hash_table_destroy(c->index);
     qemu_vfree(c->table_array);
     g_free(c->entries);
     g_free(c);
@@ -229,6 +281,7 @@ static int qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
     }
 
     c->entries[i].dirty = false;
+    QTAILQ_REMOVE(&c->dirty, &c->entries[i], dirty_next);
 
     return 0;
 }
@@ -236,14 +289,14 @@ static int qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
 int qcow2_cache_write(BlockDriverState *bs, Qcow2Cache *c)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *t, *next;
     int result = 0;
     int ret;
-    int i;
 
     trace_qcow2_cache_flush(qemu_coroutine_self(), c == s->l2_table_cache);
 
-    for (i = 0; i < c->size; i++) {
-        ret = qcow2_cache_entry_flush(bs, c, i);
+    QTAILQ_FOREACH_SAFE(t, &c->dirty, dirty_next, next) {
+        ret = qcow2_cache_entry_flush(bs, c, qcow2_cache_entry_idx(c, t));
         if (ret < 0 && result != -ENOSPC) {
             result = ret;
         }
@@ -303,10 +356,14 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
         return ret;
     }
 
+    g_hash_table_remove_all(c->index);
+    QTAILQ_INIT(&c->lru);
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
+        assert(!c->entries[i].dirty);
         c->entries[i].offset = 0;
         c->entries[i].lru_counter = 0;
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], lru_next);
     }
 
     qcow2_cache_table_release(c, 0, c->size);
@@ -320,11 +377,9 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     uint64_t offset, void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *t;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -339,29 +394,22 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    t = g_hash_table_lookup(c->index, &offset);
+    if (t) {
+        i = qcow2_cache_entry_idx(c, t);
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    /* Cache miss: pick the least recently used entry that is not in use */
+    t = QTAILQ_FIRST(&c->lru);
+    if (!t) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
-    /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    /* Write the table back and replace it */
+    i = qcow2_cache_entry_idx(c, t);
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -372,7 +420,8 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_entry_reset(c, t);
+    QTAILQ_REMOVE(&c->lru, t, lru_next);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -382,15 +431,20 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
                          qcow2_cache_get_table_addr(c, i),
                          c->table_size);
         if (ret < 0) {
+            QTAILQ_INSERT_HEAD(&c->lru, t, lru_next);
             return ret;
         }
     }
 
-    c->entries[i].offset = offset;
+    t->offset = offset;
+    g_hash_table_insert(c->index, &t->offset, t);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
+    if (QTAILQ_IN_USE(t, lru_next)) {
+        QTAILQ_REMOVE(&c->lru, t, lru_next);
+    }
+    t->ref++;
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -420,6 +474,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], lru_next);
     }
 
     assert(c->entries[i].ref >= 0);
@@ -429,17 +484,18 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 {
     int i = qcow2_cache_get_table_idx(c, table);
     assert(c->entries[i].offset != 0);
-    c->entries[i].dirty = true;
+    if (!c->entries[i].dirty) {
+        c->entries[i].dirty = true;
+        QTAILQ_INSERT_TAIL(&c->dirty, &c->entries[i], dirty_next);
+    }
 }
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    Qcow2CachedTable *t = g_hash_table_lookup(c->index, &offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
+    if (t) {
+        return qcow2_cache_get_table_addr(c, qcow2_cache_entry_idx(c, t));
     }
     return NULL;
 }
@@ -450,9 +506,9 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
-    c->entries[i].dirty = false;
+    qcow2_cache_entry_reset(c, &c->entries[i]);
+    QTAILQ_REMOVE(&c->lru, &c->entries[i], lru_next);
+    QTAILQ_INSERT_HEAD(&c->lru, &c->entries[i], lru_next);
 
     qcow2_cache_table_release(c, i, 1);
 }
@@ -130,6 +130,9 @@ void cpu_exec_unrealizefn(CPUState *cpu)
 
     tlb_destroy(cpu);
     cpu_list_remove(cpu);
+    if (tcg_enabled()) {
+        tb_jmp_cache_free(cpu);
+    }
 
 #ifdef CONFIG_USER_ONLY
     assert(cc->vmsd == NULL);
@@ -161,6 +164,9 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
     CPUClass *cc = CPU_GET_CLASS(cpu);
     static bool tcg_target_initialized;
 
+    if (tcg_enabled()) {
+        tb_jmp_cache_init(cpu);
+    }
     cpu_list_add(cpu);
 
     if (tcg_enabled() && !tcg_target_initialized) {
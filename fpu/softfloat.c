@@ -215,12 +215,75 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 # define QEMU_HARDFLOAT_USE_ISINF   0
 #endif
 
+/*
+ * QEMU_HARDFLOAT_HOST_FLAGS is set on hosts whose inexact flag is cheap to
+ * clear and read back without going through <fenv.h>: x86_64's MXCSR and
+ * aarch64's FPSR.  There, hardfloat is also used while the guest's inexact
+ * flag is clear, and raises it from the host's.
+ *
+ * The compiler is free to move floating-point arithmetic across the asm
+ * statements that access the flags, so the operands and the result of the
+ * operation are passed through hardfloat_barrier() to order them.
+ */
+#if defined(__x86_64__)
+# define QEMU_HARDFLOAT_HOST_FLAGS 1
+# define HOST_FP_INEXACT 0x20           /* MXCSR.PE */
+
+static inline uint32_t host_fp_flags(void)
+{
+    uint32_t csr;
+
+    asm volatile("stmxcsr %0" : "=m"(csr));
+    return csr;
+}
+
+static inline void host_fp_set_flags(uint32_t csr)
+{
+    asm volatile("ldmxcsr %0" : : "m"(csr));
+}
+
+# define hardfloat_barrier(x) asm volatile("" : "+x"(x))
+#elif defined(__aarch64__)
+# define QEMU_HARDFLOAT_HOST_FLAGS 1
+# define HOST_FP_INEXACT 0x10           /* FPSR.IXC */
+
+static inline uint32_t host_fp_flags(void)
+{
+    uint64_t fpsr;
+
+    asm volatile("mrs %0, fpsr" : "=r"(fpsr));
+    return fpsr;
+}
+
+static inline void host_fp_set_flags(uint32_t fpsr)
+{
+    asm volatile("msr fpsr, %0" : : "r"((uint64_t)fpsr));
+}
+
+# define hardfloat_barrier(x) asm volatile("" : "+w"(x))
+#else
+# define QEMU_HARDFLOAT_HOST_FLAGS 0
+# define HOST_FP_INEXACT 0
+
+static inline uint32_t host_fp_flags(void)
+{
+    return 0;
+}
+
+static inline void host_fp_set_flags(uint32_t flags)
+{
+}
+
+# define hardfloat_barrier(x) do { } while (0)
+#endif
+
 /*
  * Some targets clear the FP flags before most FP operations. This prevents
  * the use of hardfloat, since hardfloat relies on the inexact flag being
- * already set.
+ * already set, unless the host's inexact flag can be read back.
  */
-#if defined(TARGET_PPC) || defined(__FAST_MATH__)
+#if (defined(TARGET_PPC) && !QEMU_HARDFLOAT_HOST_FLAGS) || \
+    defined(__FAST_MATH__)
 # if defined(__FAST_MATH__)
 #  warning disabling hardfloat due to -ffast-math: hardfloat requires an exact \
     IEEE implementation
@@ -237,10 +300,47 @@ static inline bool can_use_fpu(const float_status *s)
     if (QEMU_NO_HARDFLOAT) {
         return false;
     }
-    return likely(s->float_exception_flags & float_flag_inexact &&
+    return likely((QEMU_HARDFLOAT_HOST_FLAGS ||
+                   s->float_exception_flags & float_flag_inexact) &&
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * For the operations, such as conversions, that work out the inexact flag
+ * themselves instead of relying on it being set already.
+ */
+static inline bool can_use_fpu_rounding(const float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely(s->float_rounding_mode == float_round_nearest_even);
+}
+
+/*
+ * Returns true if the inexact flag has to be taken from the host for the
+ * next hardfloat operation, after clearing it.
+ */
+static inline bool hardfloat_track_inexact(const float_status *s)
+{
+    uint32_t flags;
+
+    if (!QEMU_HARDFLOAT_HOST_FLAGS ||
+        likely(s->float_exception_flags & float_flag_inexact)) {
+        return false;
+    }
+    flags = host_fp_flags();
+    if (flags & HOST_FP_INEXACT) {
+        host_fp_set_flags(flags & ~HOST_FP_INEXACT);
+    }
+    return true;
+}
+
+static inline bool hardfloat_inexact(void)
+{
+    return host_fp_flags() & HOST_FP_INEXACT;
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -345,6 +445,7 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
              f32_check_fn pre, f32_check_fn post)
 {
     union_float32 ua, ub, ur;
+    bool track_inexact;
 
     ua.s = xa;
     ub.s = xb;
@@ -358,11 +459,17 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
         goto soft;
     }
 
+    track_inexact = hardfloat_track_inexact(s);
+    hardfloat_barrier(ua.h);
+    hardfloat_barrier(ub.h);
     ur.h = hard(ua.h, ub.h);
+    hardfloat_barrier(ur.h);
     if (unlikely(f32_is_inf(ur))) {
-        s->float_exception_flags |= float_flag_overflow;
+        s->float_exception_flags |= float_flag_overflow | float_flag_inexact;
     } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (track_inexact && hardfloat_inexact()) {
+        s->float_exception_flags |= float_flag_inexact;
     }
     return ur.s;
 
@@ -376,6 +483,7 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
              f64_check_fn pre, f64_check_fn post)
 {
     union_float64 ua, ub, ur;
+    bool track_inexact;
 
     ua.s = xa;
     ub.s = xb;
@@ -389,11 +497,17 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
         goto soft;
     }
 
+    track_inexact = hardfloat_track_inexact(s);
+    hardfloat_barrier(ua.h);
+    hardfloat_barrier(ub.h);
     ur.h = hard(ua.h, ub.h);
+    hardfloat_barrier(ur.h);
     if (unlikely(f64_is_inf(ur))) {
-        s->float_exception_flags |= float_flag_overflow;
+        s->float_exception_flags |= float_flag_overflow | float_flag_inexact;
     } else if (unlikely(fabs(ur.h) <= DBL_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (track_inexact && hardfloat_inexact()) {
+        s->float_exception_flags |= float_flag_inexact;
     }
     return ur.s;
 
@@ -1564,6 +1678,7 @@ float32 QEMU_FLATTEN
 float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
 {
     union_float32 ua, ub, uc, ur;
+    bool track_inexact;
 
     ua.s = xa;
     ub.s = xb;
@@ -1612,14 +1727,22 @@ float32_muladd(float32 xa, float32 xb, float32 xc, int flags, float_status *s)
             uc.h = -uc.h;
         }
 
+        track_inexact = hardfloat_track_inexact(s);
+        hardfloat_barrier(ua.h);
+        hardfloat_barrier(ub.h);
+        hardfloat_barrier(uc.h);
         ur.h = fmaf(ua.h, ub.h, uc.h);
+        hardfloat_barrier(ur.h);
 
         if (unlikely(f32_is_inf(ur))) {
-            s->float_exception_flags |= float_flag_overflow;
+            s->float_exception_flags |= float_flag_overflow |
+                                        float_flag_inexact;
         } else if (unlikely(fabsf(ur.h) <= FLT_MIN)) {
             ua = ua_orig;
             uc = uc_orig;
             goto soft;
+        } else if (track_inexact && hardfloat_inexact()) {
+            s->float_exception_flags |= float_flag_inexact;
         }
     }
     if (flags & float_muladd_negate_result) {
@@ -1635,6 +1758,7 @@ float64 QEMU_FLATTEN
 float64_muladd(float64 xa, float64 xb, float64 xc, int flags, float_status *s)
 {
     union_float64 ua, ub, uc, ur;
+    bool track_inexact;
 
     ua.s = xa;
     ub.s = xb;
@@ -1683,14 +1807,22 @@ float64_muladd(float64 xa, float64 xb, float64 xc, int flags, float_status *s)
             uc.h = -uc.h;
         }
 
+        track_inexact = hardfloat_track_inexact(s);
+        hardfloat_barrier(ua.h);
+        hardfloat_barrier(ub.h);
+        hardfloat_barrier(uc.h);
         ur.h = fma(ua.h, ub.h, uc.h);
+        hardfloat_barrier(ur.h);
 
         if (unlikely(f64_is_inf(ur))) {
-            s->float_exception_flags |= float_flag_overflow;
+            s->float_exception_flags |= float_flag_overflow |
+                                        float_flag_inexact;
         } else if (unlikely(fabs(ur.h) <= FLT_MIN)) {
             ua = ua_orig;
             uc = uc_orig;
             goto soft;
+        } else if (track_inexact && hardfloat_inexact()) {
+            s->float_exception_flags |= float_flag_inexact;
         }
     }
     if (flags & float_muladd_negate_result) {
@@ -2007,13 +2139,35 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(pr, s, fmt16);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts p = float64_unpack_canonical(a, s);
     FloatParts pr = float_to_float(p, &float32_params, s);
     return float32_round_pack_canonical(pr, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ua;
+    union_float32 ur;
+
+    ua.s = a;
+    if (likely(float64_is_normal(a)) && can_use_fpu_rounding(s)) {
+        ur.h = ua.h;
+        /* tiny and overflowing results need softfloat's flags */
+        if (likely(fabsf(ur.h) > FLT_MIN && fabsf(ur.h) <= FLT_MAX)) {
+            if (ur.h != ua.h) {
+                s->float_exception_flags |= float_flag_inexact;
+            }
+            return ur.s;
+        }
+    } else if (float64_is_zero(a)) {
+        return float32_set_sign(float32_zero, float64_is_neg(a));
+    }
+    return soft_float64_to_float32(a, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts p = bfloat16_unpack_canonical(a, s);
@@ -2310,6 +2464,47 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                  rmode, scale, INT64_MIN, INT64_MAX, s);
 }
 
+/*
+ * Hardfloat conversion of a zero or normal @a to an integer, for results
+ * whose magnitude is below @limit.  The inexact flag is found by comparing
+ * the result with @a, so it need not be set already.  Returns false if
+ * the conversion is left to softfloat.
+ */
+static inline bool f64_to_int_hard(union_float64 a, FloatRoundMode rmode,
+                                   double limit, double *r, float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT || unlikely(!float64_is_zero_or_normal(a.s)) ||
+        unlikely(!(fabs(a.h) < limit))) {
+        return false;
+    }
+    switch (rmode) {
+    case float_round_nearest_even:
+        *r = rint(a.h);
+        break;
+    case float_round_to_zero:
+        *r = trunc(a.h);
+        break;
+    default:
+        return false;
+    }
+    if (*r != a.h) {
+        s->float_exception_flags |= float_flag_inexact;
+    }
+    return true;
+}
+
+static inline bool f32_to_int_hard(union_float32 a, FloatRoundMode rmode,
+                                   double limit, double *r, float_status *s)
+{
+    union_float64 ud;
+
+    if (unlikely(!float32_is_zero_or_normal(a.s))) {
+        return false;
+    }
+    ud.h = a.h;
+    return f64_to_int_hard(ud, rmode, limit, r, s);
+}
+
 int8_t float16_to_int8(float16 a, float_status *s)
 {
     return float16_to_int8_scalbn(a, s->float_rounding_mode, 0, s);
@@ -2337,11 +2532,25 @@ int16_t float32_to_int16(float32 a, float_status *s)
 
 int32_t float32_to_int32(float32 a, float_status *s)
 {
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (f32_to_int_hard(ua, s->float_rounding_mode, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float32_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float32_to_int64(float32 a, float_status *s)
 {
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (f32_to_int_hard(ua, s->float_rounding_mode, INT64_MAX, &r, s)) {
+        return r;
+    }
     return float32_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -2352,11 +2561,25 @@ int16_t float64_to_int16(float64 a, float_status *s)
 
 int32_t float64_to_int32(float64 a, float_status *s)
 {
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (f64_to_int_hard(ua, s->float_rounding_mode, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float64_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float64_to_int64(float64 a, float_status *s)
 {
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (f64_to_int_hard(ua, s->float_rounding_mode, INT64_MAX, &r, s)) {
+        return r;
+    }
     return float64_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -2382,11 +2605,25 @@ int16_t float32_to_int16_round_to_zero(float32 a, float_status *s)
 
 int32_t float32_to_int32_round_to_zero(float32 a, float_status *s)
 {
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (f32_to_int_hard(ua, float_round_to_zero, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float32_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float32_to_int64_round_to_zero(float32 a, float_status *s)
 {
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (f32_to_int_hard(ua, float_round_to_zero, INT64_MAX, &r, s)) {
+        return r;
+    }
     return float32_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2397,11 +2634,25 @@ int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
 
 int32_t float64_to_int32_round_to_zero(float64 a, float_status *s)
 {
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (f64_to_int_hard(ua, float_round_to_zero, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float64_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float64_to_int64_round_to_zero(float64 a, float_status *s)
 {
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (f64_to_int_hard(ua, float_round_to_zero, INT64_MAX, &r, s)) {
+        return r;
+    }
     return float64_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2829,12 +3080,19 @@ float32 int16_to_float32_scalbn(int16_t a, int scale, float_status *status)
 
 float32 int64_to_float32(int64_t a, float_status *status)
 {
+    /* Integers of up to 24 bits convert exactly.  */
+    if (likely(a >= -(1 << 24) && a <= 1 << 24)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
 float32 int32_to_float32(int32_t a, float_status *status)
 {
-    return int64_to_float32_scalbn(a, 0, status);
+    return int64_to_float32(a, status);
 }
 
 float32 int16_to_float32(int16_t a, float_status *status)
@@ -2860,12 +3118,23 @@ float64 int16_to_float64_scalbn(int16_t a, int scale, float_status *status)
 
 float64 int64_to_float64(int64_t a, float_status *status)
 {
+    /* Integers of up to 53 bits convert exactly.  */
+    if (likely(a >= -(INT64_C(1) << 53) && a <= INT64_C(1) << 53)) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float64_scalbn(a, 0, status);
 }
 
 float64 int32_to_float64(int32_t a, float_status *status)
 {
-    return int64_to_float64_scalbn(a, 0, status);
+    union_float64 ur;
+
+    /* Always exact.  */
+    ur.h = a;
+    return ur.s;
 }
 
 float64 int16_to_float64(int16_t a, float_status *status)
@@ -3538,6 +3807,7 @@ soft_f64_sqrt(float64 a, float_status *status)
 float32 QEMU_FLATTEN float32_sqrt(float32 xa, float_status *s)
 {
     union_float32 ua, ur;
+    bool track_inexact;
 
     ua.s = xa;
     if (unlikely(!can_use_fpu(s))) {
@@ -3555,7 +3825,13 @@ float32 QEMU_FLATTEN float32_sqrt(float32 xa, float_status *s)
                         float32_is_neg(ua.s))) {
         goto soft;
     }
+    track_inexact = hardfloat_track_inexact(s);
+    hardfloat_barrier(ua.h);
     ur.h = sqrtf(ua.h);
+    hardfloat_barrier(ur.h);
+    if (track_inexact && hardfloat_inexact()) {
+        s->float_exception_flags |= float_flag_inexact;
+    }
     return ur.s;
 
  soft:
@@ -3565,6 +3841,7 @@ float32 QEMU_FLATTEN float32_sqrt(float32 xa, float_status *s)
 float64 QEMU_FLATTEN float64_sqrt(float64 xa, float_status *s)
 {
     union_float64 ua, ur;
+    bool track_inexact;
 
     ua.s = xa;
     if (unlikely(!can_use_fpu(s))) {
@@ -3582,7 +3859,13 @@ float64 QEMU_FLATTEN float64_sqrt(float64 xa, float_status *s)
                         float64_is_neg(ua.s))) {
         goto soft;
     }
+    track_inexact = hardfloat_track_inexact(s);
+    hardfloat_barrier(ua.h);
     ur.h = sqrt(ua.h);
+    hardfloat_barrier(ur.h);
+    if (track_inexact && hardfloat_inexact()) {
+        s->float_exception_flags |= float_flag_inexact;
+    }
     return ur.s;
 
  soft:
@@ -19,12 +19,14 @@
 #include "qemu/main-loop.h"
 #include "qemu/thread.h"
 #include "qemu/error-report.h"
+#include "block/aio-wait.h"
 #include "hw/virtio/virtio-access.h"
 #include "hw/virtio/virtio-blk.h"
 #include "virtio-blk.h"
 #include "block/aio.h"
 #include "hw/virtio/virtio-bus.h"
 #include "qom/object_interfaces.h"
+#include "sysemu/iothread.h"
 
 struct VirtIOBlockDataPlane {
     bool starting;
@@ -43,31 +45,42 @@ struct VirtIOBlockDataPlane {
      */
     IOThread *iothread;
     AioContext *ctx;
+
+    /* Additional IOThreads that virtqueues are spread across, if any */
+    unsigned num_vq_iothreads;
+    IOThread **vq_iothreads;
+    AioContext **vq_aio_context;    /* per-virtqueue handler AioContext */
 };
 
 /* Raise an interrupt to signal guest, if necessary */
 void virtio_blk_data_plane_notify(VirtIOBlockDataPlane *s, VirtQueue *vq)
 {
     if (s->batch_notifications) {
-        set_bit(virtio_get_queue_index(vq), s->batch_notify_vqs);
+        unsigned idx = virtio_get_queue_index(vq);
+
+        qatomic_or(&s->batch_notify_vqs[BIT_WORD(idx)], BIT_MASK(idx));
         qemu_bh_schedule(s->bh);
     } else {
         virtio_notify_irqfd(s->vdev, vq);
     }
 }
 
+/* AioContext that handles @vq, and in which its requests are completed */
+AioContext *virtio_blk_data_plane_get_vq_context(VirtIOBlockDataPlane *s,
+                                                 VirtQueue *vq)
+{
+    return s->vq_aio_context[virtio_get_queue_index(vq)];
+}
+
 static void notify_guest_bh(void *opaque)
 {
     VirtIOBlockDataPlane *s = opaque;
     unsigned nvqs = s->conf->num_queues;
-    unsigned long bitmap[BITS_TO_LONGS(nvqs)];
     unsigned j;
 
-    memcpy(bitmap, s->batch_notify_vqs, sizeof(bitmap));
-    memset(s->batch_notify_vqs, 0, sizeof(bitmap));
-
     for (j = 0; j < nvqs; j += BITS_PER_LONG) {
-        unsigned long bits = bitmap[j / BITS_PER_LONG];
+        unsigned long *word = &s->batch_notify_vqs[j / BITS_PER_LONG];
+        unsigned long bits = qatomic_xchg(word, 0);
 
         while (bits != 0) {
             unsigned i = j + ctzl(bits);
@@ -88,9 +101,22 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     VirtIOBlockDataPlane *s;
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    unsigned i;
 
     *dataplane = NULL;
 
+    if (conf->num_vq_iothreads && !conf->iothread) {
+        error_setg(errp, "vq-iothreads requires the iothread property");
+        return false;
+    }
+    for (i = 0; i < conf->num_vq_iothreads; i++) {
+        if (!conf->vq_iothreads[i] || !iothread_by_id(conf->vq_iothreads[i])) {
+            error_setg(errp, "vq-iothreads[%u]: iothread '%s' not found", i,
+                       conf->vq_iothreads[i] ? conf->vq_iothreads[i] : "");
+            return false;
+        }
+    }
+
     if (conf->iothread) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
@@ -130,6 +156,29 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     s->bh = aio_bh_new(s->ctx, notify_guest_bh, s);
     s->batch_notify_vqs = bitmap_new(conf->num_queues);
 
+    /*
+     * Virtqueue i is handled by vq-iothreads[i % n], which pops its requests
+     * and pushes them back to the ring when they complete.  The block layer
+     * still runs in the BlockBackend's AioContext (that of the iothread
+     * property), whose lock is taken to submit requests.
+     */
+    s->num_vq_iothreads = conf->num_vq_iothreads;
+    s->vq_iothreads = g_new0(IOThread *, s->num_vq_iothreads);
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        s->vq_iothreads[i] = iothread_by_id(conf->vq_iothreads[i]);
+        object_ref(OBJECT(s->vq_iothreads[i]));
+    }
+    s->vq_aio_context = g_new(AioContext *, conf->num_queues);
+    for (i = 0; i < conf->num_queues; i++) {
+        if (s->num_vq_iothreads) {
+            IOThread *iothread = s->vq_iothreads[i % s->num_vq_iothreads];
+
+            s->vq_aio_context[i] = iothread_get_aio_context(iothread);
+        } else {
+            s->vq_aio_context[i] = s->ctx;
+        }
+    }
+
     *dataplane = s;
 
     return true;
@@ -139,6 +188,7 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
 void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
 {
     VirtIOBlock *vblk;
+    unsigned i;
 
     if (!s) {
         return;
@@ -148,6 +198,11 @@ void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
     assert(!vblk->dataplane_started);
     g_free(s->batch_notify_vqs);
     qemu_bh_delete(s->bh);
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        object_unref(OBJECT(s->vq_iothreads[i]));
+    }
+    g_free(s->vq_iothreads);
+    g_free(s->vq_aio_context);
     if (s->iothread) {
         object_unref(OBJECT(s->iothread));
     }
@@ -183,7 +238,12 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
 
     s->starting = true;
 
-    if (!virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+    /*
+     * The batching BH runs in the iothread property's AioContext, so it
+     * cannot be used when the rings are accessed from vq-iothreads.
+     */
+    if (!virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX) &&
+        !s->num_vq_iothreads) {
         s->batch_notifications = true;
     } else {
         s->batch_notifications = false;
@@ -231,14 +291,15 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     }
 
     /* Get this show started by hooking up our callbacks */
-    aio_context_acquire(s->ctx);
     for (i = 0; i < nvqs; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
+        AioContext *ctx = s->vq_aio_context[i];
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx,
+        aio_context_acquire(ctx);
+        virtio_queue_aio_set_host_notifier_handler(vq, ctx,
                 virtio_blk_data_plane_handle_output);
+        aio_context_release(ctx);
     }
-    aio_context_release(s->ctx);
     return 0;
 
   fail_guest_notifiers:
@@ -253,19 +314,24 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     return -ENOSYS;
 }
 
-/* Stop notifications for new requests from guest.
+/* Stop notifications for new requests from guest on the virtqueues handled
+ * by the current AioContext.
  *
  * Context: BH in IOThread
  */
 static void virtio_blk_data_plane_stop_bh(void *opaque)
 {
     VirtIOBlockDataPlane *s = opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
     unsigned i;
 
     for (i = 0; i < s->conf->num_queues; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx, NULL);
+        if (s->vq_aio_context[i] != ctx) {
+            continue;
+        }
+        virtio_queue_aio_set_host_notifier_handler(vq, ctx, NULL);
     }
 }
 
@@ -292,6 +358,18 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
     s->stopping = true;
     trace_virtio_blk_data_plane_stop(s);
 
+    /* Detach the virtqueues handled outside the BlockBackend's AioContext */
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->vq_iothreads[i]);
+
+        if (ctx == s->ctx) {
+            continue;
+        }
+        aio_context_acquire(ctx);
+        aio_wait_bh_oneshot(ctx, virtio_blk_data_plane_stop_bh, s);
+        aio_context_release(ctx);
+    }
+
     aio_context_acquire(s->ctx);
     aio_wait_bh_oneshot(s->ctx, virtio_blk_data_plane_stop_bh, s);
 
@@ -301,6 +379,9 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
 
     aio_context_release(s->ctx);
 
+    /* Requests completed by the drain are pushed in their virtqueue's BH */
+    AIO_WAIT_WHILE(NULL, qatomic_read(&vblk->deferred_pushes) > 0);
+
     for (i = 0; i < nvqs; i++) {
         virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
         virtio_bus_cleanup_host_notifier(VIRTIO_BUS(qbus), i);
@@ -18,6 +18,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "trace.h"
+#include "block/aio-wait.h"
 #include "hw/block/block.h"
 #include "hw/qdev-properties.h"
 #include "sysemu/blockdev.h"
@@ -65,11 +66,28 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
     req->in_len = 0;
     req->next = NULL;
     req->mr_next = NULL;
+    req->refcnt = 1;
 }
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
 {
-    g_free(req);
+    if (qatomic_fetch_dec(&req->refcnt) == 1) {
+        g_free(req);
+    }
+}
+
+/* Context: BH in the AioContext of the request's virtqueue */
+static void virtio_blk_req_push_bh(void *opaque)
+{
+    VirtIOBlockReq *req = opaque;
+    VirtIOBlock *s = req->dev;
+
+    virtqueue_push(req->vq, &req->elem, req->in_len);
+    virtio_blk_data_plane_notify(s->dataplane, req->vq);
+    virtio_blk_free_request(req);
+
+    qatomic_dec(&s->deferred_pushes);
+    aio_wait_kick();
 }
 
 static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
@@ -82,6 +100,26 @@ static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
     stb_p(&req->in->status, status);
     iov_discard_undo(&req->inhdr_undo);
     iov_discard_undo(&req->outhdr_undo);
+
+    /*
+     * With dataplane, the ring of a virtqueue is only accessed from the
+     * AioContext that handles it, which with vq-iothreads is not the one
+     * the BlockBackend completes requests in.  The BH holds a reference to
+     * the request, which the caller frees as usual.
+     */
+    if (s->dataplane_started && !s->dataplane_disabled) {
+        AioContext *ctx = virtio_blk_data_plane_get_vq_context(s->dataplane,
+                                                               req->vq);
+
+        if (ctx != qemu_get_current_aio_context()) {
+            trace_virtio_blk_req_push_deferred(vdev, req);
+            qatomic_inc(&req->refcnt);
+            qatomic_inc(&s->deferred_pushes);
+            aio_bh_schedule_oneshot(ctx, virtio_blk_req_push_bh, req);
+            return;
+        }
+    }
+
     virtqueue_push(req->vq, &req->elem, req->in_len);
     if (s->dataplane_started && !s->dataplane_disabled) {
         virtio_blk_data_plane_notify(s->dataplane, req->vq);
@@ -1268,6 +1306,14 @@ static void virtio_blk_instance_init(Object *obj)
                                   DEVICE(obj));
 }
 
+static void virtio_blk_instance_finalize(Object *obj)
+{
+    VirtIOBlock *s = VIRTIO_BLK(obj);
+
+    /* The array elements are released together with their properties */
+    g_free(s->conf.vq_iothreads);
+}
+
 static const VMStateDescription vmstate_virtio_blk = {
     .name = "virtio-blk",
     .minimum_version_id = 2,
@@ -1297,6 +1343,8 @@ static Property virtio_blk_properties[] = {
     DEFINE_PROP_BOOL("seg-max-adjust", VirtIOBlock, conf.seg_max_adjust, true),
     DEFINE_PROP_LINK("iothread", VirtIOBlock, conf.iothread, TYPE_IOTHREAD,
                      IOThread *),
+    DEFINE_PROP_ARRAY("vq-iothreads", VirtIOBlock, conf.num_vq_iothreads,
+                      conf.vq_iothreads, qdev_prop_string, char *),
     DEFINE_PROP_BIT64("discard", VirtIOBlock, host_features,
                       VIRTIO_BLK_F_DISCARD, true),
     DEFINE_PROP_BIT64("write-zeroes", VirtIOBlock, host_features,
@@ -1336,6 +1384,7 @@ static const TypeInfo virtio_blk_info = {
     .parent = TYPE_VIRTIO_DEVICE,
     .instance_size = sizeof(VirtIOBlock),
     .instance_init = virtio_blk_instance_init,
+    .instance_finalize = virtio_blk_instance_finalize,
     .class_init = virtio_blk_class_init,
 };
 
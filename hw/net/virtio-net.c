@@ -16,6 +16,7 @@
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "block/aio-wait.h"
 #include "hw/virtio/virtio.h"
 #include "net/net.h"
 #include "net/checksum.h"
@@ -38,6 +39,7 @@
 #include "hw/virtio/virtio-access.h"
 #include "migration/misc.h"
 #include "standard-headers/linux/ethtool.h"
+#include "sysemu/kvm.h"
 #include "sysemu/sysemu.h"
 #include "trace.h"
 #include "monitor/qdev.h"
@@ -338,11 +340,45 @@ static void virtio_net_vnet_endian_status(VirtIONet *n, uint8_t status)
     }
 }
 
+/*
+ * Notify the guest of used buffers on a data virtqueue, which may be done
+ * from the IOThread of the queue pair.
+ */
+static void virtio_net_notify(VirtIONet *n, VirtQueue *vq)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+
+    if (n->dataplane_started) {
+        virtio_notify_irqfd(vdev, vq);
+    } else {
+        virtio_notify(vdev, vq);
+    }
+}
+
 static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(VIRTIO_NET(vdev), vq);
+    }
+}
+
+/* Keep the IOThreads of the queue pairs out of the device state */
+static void virtio_net_dataplane_acquire(VirtIONet *n)
+{
+    int i;
+
+    for (i = 0; i < n->max_queues; i++) {
+        qemu_net_client_acquire(qemu_get_subqueue(n->nic, i));
+    }
+}
+
+static void virtio_net_dataplane_release(VirtIONet *n)
+{
+    int i;
+
+    for (i = n->max_queues - 1; i >= 0; i--) {
+        qemu_net_client_release(qemu_get_subqueue(n->nic, i));
     }
 }
 
@@ -369,11 +405,13 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
         queue_started =
             virtio_net_started(n, queue_status) && !n->vhost_started;
 
+        qemu_net_client_acquire(ncs);
         if (queue_started) {
             qemu_flush_queued_packets(ncs);
         }
 
         if (!q->tx_waiting) {
+            qemu_net_client_release(ncs);
             continue;
         }
 
@@ -400,6 +438,7 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
                 virtio_net_drop_tx_queue_data(vdev, q->tx_vq);
             }
         }
+        qemu_net_client_release(ncs);
     }
 }
 
@@ -1158,6 +1197,15 @@ static int virtio_net_handle_announce(VirtIONet *n, uint8_t cmd,
     }
 }
 
+static void virtio_net_rss_update_key(VirtIONet *n)
+{
+    if (!n->rss_data.toeplitz) {
+        n->rss_data.toeplitz = g_new(NetToeplitz, 1);
+    }
+    net_toeplitz_init(n->rss_data.toeplitz, n->rss_data.key,
+                      sizeof(n->rss_data.key));
+}
+
 static void virtio_net_disable_rss(VirtIONet *n)
 {
     if (n->rss_data.enabled) {
@@ -1277,6 +1325,7 @@ static uint16_t virtio_net_handle_rss(VirtIONet *n,
         err_value = (uint32_t)s;
         goto error;
     }
+    virtio_net_rss_update_key(n);
     n->rss_data.enabled = true;
     trace_virtio_net_rss_enable(n->rss_data.hash_types,
                                 n->rss_data.indirections_len,
@@ -1360,6 +1409,7 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
         iov2 = iov = g_memdup(elem->out_sg, sizeof(struct iovec) * elem->out_num);
         s = iov_to_buf(iov, iov_cnt, 0, &ctrl, sizeof(ctrl));
         iov_discard_front(&iov, &iov_cnt, sizeof(ctrl));
+        virtio_net_dataplane_acquire(n);
         if (s != sizeof(ctrl)) {
             status = VIRTIO_NET_ERR;
         } else if (ctrl.class == VIRTIO_NET_CTRL_RX) {
@@ -1375,6 +1425,7 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
         } else if (ctrl.class == VIRTIO_NET_CTRL_GUEST_OFFLOADS) {
             status = virtio_net_handle_offloads(n, ctrl.cmd, iov, iov_cnt);
         }
+        virtio_net_dataplane_release(n);
 
         s = iov_from_buf(elem->in_sg, elem->in_num, 0, &status, sizeof(status));
         assert(s == sizeof(status));
@@ -1600,7 +1651,7 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     unsigned int index = nc->queue_index, new_index = index;
-    struct NetRxPkt *pkt = n->rx_pkt;
+    struct NetRxPkt *pkt = virtio_net_get_subqueue(nc)->rx_pkt;
     uint8_t net_hash_type;
     uint32_t hash;
     bool isip4, isip6, isudp, istcp;
@@ -1634,7 +1685,8 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
         return n->rss_data.redirect ? n->rss_data.default_queue : -1;
     }
 
-    hash = net_rx_pkt_calc_rss_hash(pkt, net_hash_type, n->rss_data.key);
+    hash = net_rx_pkt_calc_rss_hash_table(pkt, net_hash_type,
+                                          n->rss_data.toeplitz);
 
     if (n->rss_data.populate_hash) {
         virtio_set_packet_hash(buf, reports[net_hash_type], hash);
@@ -1648,6 +1700,46 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
     return (index == new_index) ? -1 : new_index;
 }
 
+/* Packets waiting for a queue before it drops more, as in a NIC ring */
+#define VIRTIO_NET_STEER_MAX 256
+
+struct VirtIONetSteerPacket {
+    QSIMPLEQ_ENTRY(VirtIONetSteerPacket) next;
+    size_t size;
+    uint8_t data[];
+};
+
+/*
+ * Hand a packet over to queue @index, which RSS picked for it and which
+ * runs in another IOThread.  It was hashed here already, with the hash
+ * written to its header if the guest asked for it, so that the queue
+ * delivers it as is.
+ */
+static ssize_t virtio_net_steer(VirtIONet *n, int index, const uint8_t *buf,
+                                size_t size)
+{
+    VirtIONetQueue *q = &n->vqs[index];
+    VirtIONetSteerPacket *pkt = g_malloc(sizeof(*pkt) + size);
+
+    pkt->size = size;
+    memcpy(pkt->data, buf, size);
+
+    qemu_mutex_lock(&q->steer_lock);
+    if (q->steer_bh && q->steer_len < VIRTIO_NET_STEER_MAX) {
+        QSIMPLEQ_INSERT_TAIL(&q->steer_packets, pkt, next);
+        q->steer_len++;
+        qemu_bh_schedule(q->steer_bh);
+        pkt = NULL;
+    }
+    qemu_mutex_unlock(&q->steer_lock);
+
+    if (pkt) {
+        trace_virtio_net_steer_drop(index);
+        g_free(pkt);
+    }
+    return size;
+}
+
 static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                                       size_t size, bool no_rss)
 {
@@ -1667,6 +1759,10 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
         int index = virtio_net_process_rss(nc, buf, size);
         if (index >= 0) {
             NetClientState *nc2 = qemu_get_subqueue(n->nic, index);
+
+            if (nc2->aio_context != nc->aio_context) {
+                return virtio_net_steer(n, index, buf, size);
+            }
             return virtio_net_receive_rcu(nc2, buf, size, true);
         }
     }
@@ -1760,7 +1856,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    if (q->rx_batching) {
+        q->rx_notify = true;
+    } else {
+        virtio_net_notify(n, q->rx_vq);
+    }
 
     return size;
 }
@@ -2378,16 +2478,53 @@ static ssize_t virtio_net_receive(NetClientState *nc, const uint8_t *buf,
     }
 }
 
+/*
+ * Receive packets until the guest runs out of buffers, and notify it
+ * once for all of them on each queue of this thread that they went to.
+ */
+static int virtio_net_receive_batch(NetClientState *nc,
+                                    const struct iovec *pkts, int count)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    int i, j;
+
+    for (j = 0; j < n->max_queues; j++) {
+        if (qemu_get_subqueue(n->nic, j)->aio_context == nc->aio_context) {
+            n->vqs[j].rx_batching = true;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        if (virtio_net_receive(nc, pkts[i].iov_base, pkts[i].iov_len) == 0) {
+            break;
+        }
+    }
+
+    /* Queues in other AioContexts are batched by their own thread */
+    for (j = 0; j < n->max_queues; j++) {
+        VirtIONetQueue *q = &n->vqs[j];
+
+        if (qemu_get_subqueue(n->nic, j)->aio_context != nc->aio_context ||
+            !q->rx_batching) {
+            continue;
+        }
+        q->rx_batching = false;
+        if (q->rx_notify) {
+            q->rx_notify = false;
+            virtio_net_notify(n, q->rx_vq);
+        }
+    }
+    return i;
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q);
 
 static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q = virtio_net_get_subqueue(nc);
-    VirtIODevice *vdev = VIRTIO_DEVICE(n);
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(n, q->tx_vq);
 
     g_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
@@ -2482,7 +2619,7 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 
 drop:
         virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
+        virtio_net_notify(n, q->tx_vq);
         g_free(elem);
 
         if (++num_packets >= n->tx_burst) {
@@ -2617,6 +2754,296 @@ static void virtio_net_tx_bh(void *opaque)
     }
 }
 
+/*
+ * With the iothreads property, each queue pair runs in an IOThread while
+ * ioeventfd is active: guest kicks, the transmit bottom half or timer, and
+ * the handlers of its peer, which delivers packets straight from there.
+ * The main loop takes the AioContext of a queue pair with
+ * qemu_net_client_acquire() before it touches its state.
+ */
+
+/* Deliver the packets steered to @q, until the guest runs out of buffers */
+static void virtio_net_steer_flush(VirtIONetQueue *q)
+{
+    VirtIONet *n = q->n;
+    NetClientState *nc = qemu_get_subqueue(n->nic, q - n->vqs);
+    QSIMPLEQ_HEAD(, VirtIONetSteerPacket) packets;
+    VirtIONetSteerPacket *pkt;
+    unsigned int len;
+
+    QSIMPLEQ_INIT(&packets);
+    qemu_mutex_lock(&q->steer_lock);
+    QSIMPLEQ_CONCAT(&packets, &q->steer_packets);
+    len = q->steer_len;
+    q->steer_len = 0;
+    qemu_mutex_unlock(&q->steer_lock);
+
+    if (!len) {
+        return;
+    }
+
+    q->rx_batching = true;
+    WITH_RCU_READ_LOCK_GUARD() {
+        while ((pkt = QSIMPLEQ_FIRST(&packets))) {
+            if (virtio_net_receive_rcu(nc, pkt->data, pkt->size, true) == 0) {
+                break;
+            }
+            QSIMPLEQ_REMOVE_HEAD(&packets, next);
+            len--;
+            g_free(pkt);
+        }
+    }
+    q->rx_batching = false;
+    if (q->rx_notify) {
+        q->rx_notify = false;
+        virtio_net_notify(n, q->rx_vq);
+    }
+
+    /* What is left waits for rx buffers, ahead of newer packets */
+    if (len) {
+        qemu_mutex_lock(&q->steer_lock);
+        QSIMPLEQ_CONCAT(&packets, &q->steer_packets);
+        QSIMPLEQ_CONCAT(&q->steer_packets, &packets);
+        q->steer_len += len;
+        qemu_mutex_unlock(&q->steer_lock);
+    }
+}
+
+static void virtio_net_steer_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+
+    qemu_net_client_acquire(nc);
+    virtio_net_steer_flush(q);
+    qemu_net_client_release(nc);
+}
+
+static void virtio_net_dataplane_tx_timer(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+
+    qemu_net_client_acquire(nc);
+    virtio_net_tx_timer(q);
+    qemu_net_client_release(nc);
+}
+
+static void virtio_net_dataplane_tx_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+
+    qemu_net_client_acquire(nc);
+    virtio_net_tx_bh(q);
+    qemu_net_client_release(nc);
+}
+
+static bool virtio_net_dataplane_handle_output(VirtIODevice *vdev,
+                                               VirtQueue *vq)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    int queue_index = vq2q(virtio_get_queue_index(vq));
+    VirtIONetQueue *q = &n->vqs[queue_index];
+    NetClientState *nc = qemu_get_subqueue(n->nic, queue_index);
+
+    assert(n->dataplane_started);
+
+    qemu_net_client_acquire(nc);
+    if (vq == q->rx_vq) {
+        virtio_net_steer_flush(q);
+        virtio_net_handle_rx(vdev, vq);
+    } else if (q->tx_timer) {
+        virtio_net_handle_tx_timer(vdev, vq);
+    } else {
+        virtio_net_handle_tx_bh(vdev, vq);
+    }
+    qemu_net_client_release(nc);
+    return true;
+}
+
+/*
+ * Move the bottom halves and timer of @q to @ctx, or the main loop.  Only
+ * queues in an IOThread accept steered packets, the others drop them.
+ */
+static void virtio_net_queue_set_aio_context(VirtIONetQueue *q,
+                                             AioContext *ctx)
+{
+    VirtIONetSteerPacket *pkt, *next_pkt;
+
+    qemu_mutex_lock(&q->steer_lock);
+    if (q->steer_bh) {
+        qemu_bh_delete(q->steer_bh);
+        q->steer_bh = NULL;
+    }
+    if (ctx) {
+        q->steer_bh = aio_bh_new(ctx, virtio_net_steer_bh, q);
+    } else {
+        QSIMPLEQ_FOREACH_SAFE(pkt, &q->steer_packets, next, next_pkt) {
+            g_free(pkt);
+        }
+        QSIMPLEQ_INIT(&q->steer_packets);
+        q->steer_len = 0;
+    }
+    qemu_mutex_unlock(&q->steer_lock);
+
+    if (q->tx_timer) {
+        bool pending = timer_pending(q->tx_timer);
+        int64_t expire = timer_expire_time_ns(q->tx_timer);
+
+        timer_del(q->tx_timer);
+        timer_free(q->tx_timer);
+        if (ctx) {
+            q->tx_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                                        virtio_net_dataplane_tx_timer, q);
+        } else {
+            q->tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                       virtio_net_tx_timer, q);
+        }
+        if (pending) {
+            timer_mod(q->tx_timer, expire);
+        }
+    } else {
+        qemu_bh_delete(q->tx_bh);
+        if (ctx) {
+            q->tx_bh = aio_bh_new(ctx, virtio_net_dataplane_tx_bh, q);
+        } else {
+            q->tx_bh = qemu_bh_new(virtio_net_tx_bh, q);
+        }
+        if (q->tx_waiting) {
+            qemu_bh_schedule(q->tx_bh);
+        }
+    }
+}
+
+/* Context: QEMU global mutex held */
+static void virtio_net_dataplane_start(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(n)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queues = n->multiqueue ? n->max_queues : 1;
+    int i, r;
+
+    if (!n->net_conf.num_iothreads || n->dataplane_started ||
+        n->vhost_started) {
+        return;
+    }
+
+    for (i = 0; i < queues; i++) {
+        NetClientState *peer = qemu_get_subqueue(n->nic, i)->peer;
+
+        if (!peer || !peer->info->set_aio_context ||
+            !QTAILQ_EMPTY(&peer->filters)) {
+            warn_report_once("virtio-net: the netdev cannot run in an "
+                             "iothread, using the main loop");
+            return;
+        }
+    }
+    if (n->rsc4_enabled || n->rsc6_enabled) {
+        warn_report_once("virtio-net: iothreads do not support "
+                         "guest_rsc_ext, using the main loop");
+        return;
+    }
+
+    /*
+     * The queues signal their guest notifier directly, so the transport
+     * must unbind the irqfd of a vector while the guest masks it, like it
+     * does for devices without guest_notifier_mask.
+     */
+    if (kvm_msi_via_irqfd_enabled()) {
+        vdev->use_guest_notifier_mask = false;
+    }
+    r = k->set_guest_notifiers(qbus->parent, queues * 2, true);
+    if (r != 0) {
+        vdev->use_guest_notifier_mask = true;
+        warn_report_once("virtio-net: failed to set guest notifier (%d), "
+                         "ensure -accel kvm is set", r);
+        return;
+    }
+    n->dataplane_started = true;
+
+    for (i = 0; i < queues; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+        IOThread *iothread = n->iothreads[i % n->net_conf.num_iothreads];
+        AioContext *ctx = iothread_get_aio_context(iothread);
+
+        aio_context_acquire(ctx);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                                   NULL);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                                   NULL);
+        virtio_net_queue_set_aio_context(q, ctx);
+        qemu_net_client_set_aio_context(nc->peer, ctx);
+        qemu_net_client_set_aio_context(nc, ctx);
+        virtio_queue_aio_set_host_notifier_handler(q->rx_vq, ctx,
+                virtio_net_dataplane_handle_output);
+        virtio_queue_aio_set_host_notifier_handler(q->tx_vq, ctx,
+                virtio_net_dataplane_handle_output);
+        aio_context_release(ctx);
+
+        /* Kick right away to pick up what came in during the switch */
+        event_notifier_set(virtio_queue_get_host_notifier(q->rx_vq));
+        event_notifier_set(virtio_queue_get_host_notifier(q->tx_vq));
+    }
+}
+
+/* Context: BH in IOThread */
+static void virtio_net_dataplane_stop_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    virtio_queue_aio_set_host_notifier_handler(q->rx_vq, ctx, NULL);
+    virtio_queue_aio_set_host_notifier_handler(q->tx_vq, ctx, NULL);
+    qemu_net_client_set_aio_context(nc->peer, NULL);
+    qemu_net_client_set_aio_context(nc, NULL);
+    virtio_net_queue_set_aio_context(q, NULL);
+}
+
+/* Context: QEMU global mutex held */
+static void virtio_net_dataplane_stop(VirtIONet *n)
+{
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(n)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queues = n->multiqueue ? n->max_queues : 1;
+    int i;
+
+    if (!n->dataplane_started) {
+        return;
+    }
+
+    for (i = 0; i < queues; i++) {
+        AioContext *ctx = qemu_get_subqueue(n->nic, i)->aio_context;
+
+        aio_context_acquire(ctx);
+        aio_wait_bh_oneshot(ctx, virtio_net_dataplane_stop_bh, &n->vqs[i]);
+        aio_context_release(ctx);
+    }
+
+    k->set_guest_notifiers(qbus->parent, queues * 2, false);
+    VIRTIO_DEVICE(n)->use_guest_notifier_mask = true;
+    n->dataplane_started = false;
+}
+
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    int r = virtio_device_start_ioeventfd_impl(vdev);
+
+    if (r == 0) {
+        virtio_net_dataplane_start(VIRTIO_NET(vdev));
+    }
+    return r;
+}
+
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    virtio_net_dataplane_stop(VIRTIO_NET(vdev));
+    virtio_device_stop_ioeventfd_impl(vdev);
+}
+
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -2640,6 +3067,9 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
 
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
+    net_rx_pkt_init(&n->vqs[index].rx_pkt, false);
+    qemu_mutex_init(&n->vqs[index].steer_lock);
+    QSIMPLEQ_INIT(&n->vqs[index].steer_packets);
 }
 
 static void virtio_net_del_queue(VirtIONet *n, int index)
@@ -2661,6 +3091,8 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
     }
     q->tx_waiting = 0;
     virtio_del_queue(vdev, index * 2 + 1);
+    net_rx_pkt_uninit(q->rx_pkt);
+    qemu_mutex_destroy(&q->steer_lock);
 }
 
 static void virtio_net_change_num_queues(VirtIONet *n, int new_max_queues)
@@ -2769,6 +3201,7 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
     }
 
     if (n->rss_data.enabled) {
+        virtio_net_rss_update_key(n);
         trace_virtio_net_rss_enable(n->rss_data.hash_types,
                                     n->rss_data.indirections_len,
                                     sizeof(n->rss_data.key));
@@ -3039,6 +3472,7 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .receive_batch = virtio_net_receive_batch,
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
@@ -3048,7 +3482,14 @@ static bool virtio_net_guest_notifier_pending(VirtIODevice *vdev, int idx)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     NetClientState *nc = qemu_get_subqueue(n->nic, vq2q(idx));
-    assert(n->vhost_started);
+
+    if (!n->vhost_started) {
+        /* IOThread queues signal the guest notifier itself */
+        VirtQueue *vq = virtio_get_queue(vdev, idx);
+
+        return event_notifier_test_and_clear(
+            virtio_queue_get_guest_notifier(vq));
+    }
     return vhost_net_virtqueue_pending(get_vhost_net(nc->peer), idx);
 }
 
@@ -3057,7 +3498,14 @@ static void virtio_net_guest_notifier_mask(VirtIODevice *vdev, int idx,
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     NetClientState *nc = qemu_get_subqueue(n->nic, vq2q(idx));
-    assert(n->vhost_started);
+
+    if (!n->vhost_started) {
+        /*
+         * IOThread queues: masked vectors are handled by the transport,
+         * see virtio_net_dataplane_start()
+         */
+        return;
+    }
     vhost_net_virtqueue_mask(get_vhost_net(nc->peer),
                              vdev, idx, mask);
 }
@@ -3264,6 +3712,33 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (n->net_conf.num_iothreads) {
+        BusState *qbus = qdev_get_parent_bus(dev);
+        VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+
+        if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+            error_setg(errp, "device is incompatible with iothreads "
+                       "(transport does not support notifiers)");
+            virtio_cleanup(vdev);
+            return;
+        }
+        if (!virtio_device_ioeventfd_enabled(vdev)) {
+            error_setg(errp, "ioeventfd is required for iothreads");
+            virtio_cleanup(vdev);
+            return;
+        }
+        for (i = 0; i < n->net_conf.num_iothreads; i++) {
+            const char *id = n->net_conf.iothreads[i];
+
+            if (!id || !iothread_by_id(id)) {
+                error_setg(errp, "iothreads[%d]: iothread '%s' not found", i,
+                           id ? id : "");
+                virtio_cleanup(vdev);
+                return;
+            }
+        }
+    }
+
     n->max_queues = MAX(n->nic_conf.peers.queues, 1);
     if (n->max_queues * 2 + 1 > VIRTIO_QUEUE_MAX) {
         error_setg(errp, "Invalid number of queues (= %" PRIu32 "), "
@@ -3344,7 +3819,12 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
     QTAILQ_INIT(&n->rsc_chains);
     n->qdev = dev;
 
-    net_rx_pkt_init(&n->rx_pkt, false);
+    /* Queue pair i runs in iothreads[i % n] */
+    n->iothreads = g_new0(IOThread *, n->net_conf.num_iothreads);
+    for (i = 0; i < n->net_conf.num_iothreads; i++) {
+        n->iothreads[i] = iothread_by_id(n->net_conf.iothreads[i]);
+        object_ref(OBJECT(n->iothreads[i]));
+    }
 }
 
 static void virtio_net_device_unrealize(DeviceState *dev)
@@ -3379,7 +3859,11 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
-    net_rx_pkt_uninit(n->rx_pkt);
+    g_free(n->rss_data.toeplitz);
+    for (i = 0; i < n->net_conf.num_iothreads; i++) {
+        object_unref(OBJECT(n->iothreads[i]));
+    }
+    g_free(n->iothreads);
     virtio_cleanup(vdev);
 }
 
@@ -3397,6 +3881,14 @@ static void virtio_net_instance_init(Object *obj)
                                   DEVICE(n));
 }
 
+static void virtio_net_instance_finalize(Object *obj)
+{
+    VirtIONet *n = VIRTIO_NET(obj);
+
+    /* The array elements are released together with their properties */
+    g_free(n->net_conf.iothreads);
+}
+
 static int virtio_net_pre_save(void *opaque)
 {
     VirtIONet *n = opaque;
@@ -3496,6 +3988,8 @@ static Property virtio_net_properties[] = {
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_ARRAY("iothreads", VirtIONet, net_conf.num_iothreads,
+                      net_conf.iothreads, qdev_prop_string, char *),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
@@ -3526,6 +4020,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->bad_features = virtio_net_bad_features;
     vdc->reset = virtio_net_reset;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
@@ -3539,6 +4035,7 @@ static const TypeInfo virtio_net_info = {
     .parent = TYPE_VIRTIO_DEVICE,
     .instance_size = sizeof(VirtIONet),
     .instance_init = virtio_net_instance_init,
+    .instance_finalize = virtio_net_instance_finalize,
     .class_init = virtio_net_class_init,
 };
 
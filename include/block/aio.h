@@ -197,6 +197,13 @@ struct AioContext {
      */
     struct ThreadPool *thread_pool;
 
+    /* Thread pool parameters, see aio_context_set_thread_pool_params() */
+    int64_t thread_pool_min;
+    int64_t thread_pool_max;
+    int64_t thread_pool_idle_timeout_ms;
+    unsigned long *thread_pool_cpus;
+    unsigned long thread_pool_cpus_nbits;
+
 #ifdef CONFIG_LINUX_AIO
     /*
      * State for native Linux AIO.  Uses aio_context_acquire/release for
@@ -214,6 +221,14 @@ struct AioContext {
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+
+    /*
+     * Create io_uring instances with a kernel submission queue polling
+     * thread, optionally bound to io_uring_sqpoll_cpu (-1 for no affinity).
+     * See aio_context_set_io_uring_sqpoll().
+     */
+    bool io_uring_sqpoll;
+    int io_uring_sqpoll_cpu;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -727,4 +742,60 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+/**
+ * aio_context_set_thread_pool_params:
+ * @ctx: the aio context
+ * @min: number of worker threads that are kept around even when idle
+ * @max: maximum number of worker threads
+ * @idle_timeout_ms: how long a worker above @min waits for work before exiting
+ *
+ * The new values also apply to a thread pool that is already running.
+ */
+void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
+                                        int64_t max, int64_t idle_timeout_ms,
+                                        Error **errp);
+
+/**
+ * aio_context_set_thread_pool_affinity:
+ * @ctx: the aio context
+ * @host_cpus: bitmap of host CPUs the worker threads may run on, or NULL
+ * @nbits: size of @host_cpus
+ *
+ * With a NULL @host_cpus, worker threads inherit the affinity of the thread
+ * that creates the AioContext's thread pool.
+ */
+void aio_context_set_thread_pool_affinity(AioContext *ctx,
+                                          const unsigned long *host_cpus,
+                                          unsigned long nbits);
+
+/**
+ * aio_context_set_io_uring_sqpoll:
+ * @ctx: the aio context
+ * @cpu: host CPU for the kernel submission polling thread, or -1
+ *
+ * Make the io_uring instances of @ctx (used for file descriptor monitoring
+ * and for aio=io_uring block I/O) use IORING_SETUP_SQPOLL, so that requests
+ * are picked up by a kernel thread instead of requiring an io_uring_enter
+ * system call per batch.  Must be called before @ctx is polled for the first
+ * time.
+ */
+void aio_context_set_io_uring_sqpoll(AioContext *ctx, int cpu, Error **errp);
+
+#ifdef CONFIG_LINUX_IO_URING
+/**
+ * aio_context_io_uring_queue_init:
+ * @ctx: the aio context
+ * @entries: size of the submission queue
+ * @ring: the io_uring to set up
+ *
+ * Set up a new io_uring of @ctx, with SQPOLL if it was enabled with
+ * aio_context_set_io_uring_sqpoll().
+ *
+ * Returns: 0 on success, -ENOTSUP if the host kernel only supports SQPOLL
+ * for registered files, or another negative errno value on failure.
+ */
+int aio_context_io_uring_queue_init(AioContext *ctx, unsigned entries,
+                                    struct io_uring *ring);
+#endif
+
 #endif
@@ -24,8 +24,21 @@ typedef int ThreadPoolFunc(void *opaque);
 
 typedef struct ThreadPool ThreadPool;
 
+#define THREAD_POOL_MAX_THREADS_DEFAULT     64
+#define THREAD_POOL_IDLE_TIMEOUT_MS_DEFAULT 10000
+
+typedef struct ThreadPoolStats {
+    int cur_threads;        /* worker threads, including ones being created */
+    int idle_threads;       /* worker threads waiting for requests */
+    int queued;             /* requests not picked up by a worker yet */
+    uint64_t completed;     /* requests completed by worker threads */
+    int64_t busy_ns;        /* total time spent by workers in requests */
+} ThreadPoolStats;
+
 ThreadPool *thread_pool_new(struct AioContext *ctx);
 void thread_pool_free(ThreadPool *pool);
+void thread_pool_update_params(ThreadPool *pool, struct AioContext *ctx);
+void thread_pool_get_stats(ThreadPool *pool, ThreadPoolStats *stats);
 
 BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         ThreadPoolFunc *func, void *arg,
@@ -191,6 +191,20 @@ typedef struct CPUTLBDescFast {
     CPUTLBEntry *table;
 } CPUTLBDescFast QEMU_ALIGNED(2 * sizeof(void *));
 
+/*
+ * A range of pages that another vCPU asked to flush, and that is
+ * waiting for the vCPU that owns the tlb to do so.
+ */
+typedef struct CPUTLBFlushRange {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+    uint16_t bits;
+} CPUTLBFlushRange;
+
+/* Number of pending ranges, beyond which whole mmu_idx are flushed. */
+#define CPU_TLB_FLUSH_RANGES 16
+
 /*
  * Data elements that are shared between all MMU modes.
  */
@@ -203,6 +217,16 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Page flushes requested by other vCPUs are queued here, and all
+     * of them are run by a single work item, which is queued when
+     * pending_queued is clear.  The mmu_idx in pending_full are flushed
+     * whole, once the ranges overflow.  Protected by tlb_c.lock.
+     */
+    CPUTLBFlushRange pending[CPU_TLB_FLUSH_RANGES];
+    unsigned int nb_pending;
+    uint16_t pending_full;
+    bool pending_queued;
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -211,6 +235,13 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t coalesced_flush_count;
+    /* Calls of the softmmu load and store helpers for data accesses. */
+    size_t slow_load_count;
+    size_t slow_store_count;
+    size_t slow_miss_count;
+    size_t slow_cross_count;
+    size_t slow_cross_ram_count;
 } CPUTLBCommon;
 
 /*
@@ -26,6 +26,9 @@
 /* cputlb.c */
 void tlb_protect_code(ram_addr_t ram_addr);
 void tlb_unprotect_code(ram_addr_t ram_addr);
-void tlb_flush_counts(size_t *full, size_t *part, size_t *elide);
+void tlb_flush_counts(size_t *full, size_t *part, size_t *elide,
+                      size_t *coalesced);
+void tlb_slow_path_counts(size_t *loads, size_t *stores, size_t *misses,
+                          size_t *cross, size_t *cross_ram);
 #endif
 #endif
@@ -270,6 +270,32 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *cpu, target_ulong addr,
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced
     (CPUState *cpu, target_ulong addr, uint16_t idxmap, unsigned bits);
 
+/**
+ * tlb_flush_range_by_mmuidx
+ * @cpu: CPU whose TLB should be flushed
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of the range to be flushed
+ * @idxmap: bitmap of mmu indexes to flush
+ * @bits: number of significant bits in address
+ *
+ * For each mmu index, for each page within the range, flush the
+ * entries for that page.  Flushes for other cpus are merged with the
+ * ones already waiting for them, so that each runs a single work item.
+ */
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap,
+                               unsigned bits);
+
+/* Similarly, with broadcast and syncing. */
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu, target_ulong addr,
+                                        target_ulong len, uint16_t idxmap,
+                                        unsigned bits);
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap,
+                                               unsigned bits);
+
 /**
  * tlb_set_page_with_attrs:
  * @cpu: CPU to add this TLB entry for
@@ -373,6 +399,27 @@ tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *cpu, target_ulong addr,
                                               uint16_t idxmap, unsigned bits)
 {
 }
+static inline void tlb_flush_range_by_mmuidx(CPUState *cpu,
+                                             target_ulong addr,
+                                             target_ulong len,
+                                             uint16_t idxmap,
+                                             unsigned bits)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu,
+                                                      target_ulong addr,
+                                                      target_ulong len,
+                                                      uint16_t idxmap,
+                                                      unsigned bits)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                                             target_ulong addr,
+                                                             target_ulong len,
+                                                             uint16_t idxmap,
+                                                             unsigned bits)
+{
+}
 #endif
 /**
  * probe_access:
@@ -466,6 +513,8 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_TRACE       0x00100000 /* Superblock built by tb_trace_hot() */
+#define CF_SMC_CHECK   0x00200000 /* Checks its guest code before running */
 #define CF_CLUSTER_MASK 0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 /* cflags' mask for hashing/comparison */
@@ -475,6 +524,12 @@ struct TranslationBlock {
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
 
+    /* Number of executions, only counted when tb_hot_threshold is set */
+    uint32_t exec_count;
+
+    /* CRC of the guest code, when cflags has CF_SMC_CHECK */
+    uint32_t smc_crc;
+
     struct tb_tc tc;
 
     /* original tb when cflags has CF_NOCACHE */
@@ -521,6 +576,50 @@ struct TranslationBlock {
     uintptr_t jmp_dest[2];
 };
 
+/*
+ * A hot trace of TBs chained through their direct jumps, to be translated
+ * again as a single superblock.  All of its blocks lie on the page of the
+ * first one, at or after its pc, and share its cs_base and flags.
+ */
+#define TB_TRACE_MAX_BLOCKS 8
+
+typedef struct TBTraceBlock {
+    target_ulong pc;
+    uint16_t size;
+    uint16_t icount;
+    int hot_exit;       /* goto_tb index leading to the next block */
+} TBTraceBlock;
+
+typedef struct TBTrace {
+    tb_page_addr_t phys_pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    uint32_t crc;       /* of the guest code the blocks cover */
+    int n;
+    TBTraceBlock blocks[TB_TRACE_MAX_BLOCKS];
+} TBTrace;
+
+extern unsigned int tb_hot_threshold;
+extern unsigned int tb_smc_threshold;
+
+/* Number of jump cache lookups between two resizing decisions */
+#define TB_JMP_CACHE_WINDOW (1 << 16)
+
+extern unsigned int tb_jmp_cache_bits;
+extern bool tb_jmp_cache_resize_enabled;
+
+/* Only to be called by the vCPU thread that owns @jc */
+static inline void tb_jmp_cache_set(TBJmpCache *jc, uint32_t hash,
+                                    TranslationBlock *tb)
+{
+    if (!qatomic_read(&jc->array[hash])) {
+        jc->used++;
+    }
+    qatomic_set(&jc->array[hash], tb);
+}
+
 extern bool parallel_cpus;
 
 /* Hide the qatomic_read to make code a little easier on the eyes */
@@ -545,6 +644,12 @@ void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr, MemTxAttrs attrs);
 #endif
 void tb_flush(CPUState *cpu);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
+void tb_trace_hot(CPUState *cpu, TranslationBlock *tb);
+bool tb_trace_enabled(CPUState *cpu, uint32_t cflags);
+void tb_smc_check(CPUState *cpu, TranslationBlock *tb, uintptr_t retaddr);
+void tb_jmp_cache_init(CPUState *cpu);
+void tb_jmp_cache_free(CPUState *cpu);
+TBJmpCache *tb_jmp_cache_resize(CPUState *cpu);
 TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
                                    target_ulong cs_base, uint32_t flags,
                                    uint32_t cf_mask);
@@ -667,6 +772,8 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr);
 
 /* exec.c */
 void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr);
+void tb_flush_jmp_cache_range(CPUState *cpu, target_ulong addr,
+                              target_ulong len);
 
 MemoryRegionSection *
 address_space_translate_for_iotlb(CPUState *cpu, int asidx, hwaddr addr,
@@ -610,6 +610,17 @@ struct MemoryListener {
      */
     void (*log_sync)(MemoryListener *listener, MemoryRegionSection *section);
 
+    /**
+     * @log_sync_global:
+     *
+     * This is the global version of @log_sync, for listeners that can
+     * only synchronize the dirty log of the whole address space at once.
+     * A listener must not define both @log_sync and @log_sync_global.
+     *
+     * @listener: The #MemoryListener.
+     */
+    void (*log_sync_global)(MemoryListener *listener);
+
     /**
      * @log_clear:
      *
@@ -22,6 +22,7 @@
 
 #include "qemu/thread.h"
 #include "qemu/qht.h"
+#include "qemu/stats64.h"
 
 #define CODE_GEN_HTABLE_BITS     15
 #define CODE_GEN_HTABLE_SIZE     (1 << CODE_GEN_HTABLE_BITS)
@@ -35,6 +36,21 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_evict_count;
+    size_t tb_evicted_tbs;
+    int64_t tb_start_time;      /* ns, when the translation cache was set up */
+    int64_t tb_reclaim_time;    /* ns, last flush or eviction */
+    Stat64 tb_retrans_count;    /* translations of flushed or evicted TBs */
+    Stat64 tb_retrans_time;     /* ns spent in those translations */
+    size_t tb_traces;           /* superblocks generated from hot traces */
+    size_t tb_traces_dropped;   /* traces that could not be translated */
+    size_t tb_smc_pages;        /* pages whose TBs check their own code */
+    size_t tb_smc_stale;        /* self-checking TBs found to be stale */
+    size_t tb_spec_requests;    /* successors queued for the pool */
+    size_t tb_spec_translated;  /* TBs translated by the pool */
+    size_t tb_spec_present;     /* requests for TBs that existed already */
+    size_t tb_spec_aborted;     /* translations that left their page */
+    size_t tb_spec_dropped;     /* requests dropped with the queue full */
 };
 
 extern TBContext tb_ctx;
@@ -22,12 +22,13 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
                      uint32_t *flags, uint32_t cf_mask)
 {
     CPUArchState *env = (CPUArchState *)cpu->env_ptr;
+    TBJmpCache *jc = cpu->tb_jmp_cache;
     TranslationBlock *tb;
     uint32_t hash;
 
     cpu_get_tb_cpu_state(env, pc, cs_base, flags);
-    hash = tb_jmp_cache_hash_func(*pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
+    hash = tb_jmp_cache_hash_func(*pc, jc->bits);
+    tb = qatomic_rcu_read(&jc->array[hash]);
 
     cf_mask &= ~CF_CLUSTER_MASK;
     cf_mask |= cpu->cluster_index << CF_CLUSTER_SHIFT;
@@ -38,13 +39,21 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
                tb->flags == *flags &&
                tb->trace_vcpu_dstate == *cpu->trace_dstate &&
                (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
+        jc->hits++;
         return tb;
     }
+    jc->misses++;
+    if (unlikely(tb_jmp_cache_resize_enabled) &&
+        jc->hits + jc->misses - jc->window_hits - jc->window_misses >=
+        TB_JMP_CACHE_WINDOW) {
+        jc = tb_jmp_cache_resize(cpu);
+        hash = tb_jmp_cache_hash_func(*pc, jc->bits);
+    }
     tb = tb_htable_lookup(cpu, *pc, *cs_base, *flags, cf_mask);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_set(jc, hash, tb);
     return tb;
 }
 
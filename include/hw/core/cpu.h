@@ -278,11 +278,33 @@ typedef struct SavedIOTLB {
 
 struct KVMState;
 struct kvm_run;
+struct kvm_dirty_gfn;
 
 struct hax_vcpu_state;
 
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_MIN_BITS 8
+#define TB_JMP_CACHE_MAX_BITS 16
+
+/*
+ * Per-vCPU cache of recently executed TBs, indexed by virtual pc.
+ * The table is only ever replaced by its own vCPU thread, when it is
+ * resized; other threads may clear entries under the RCU read lock.
+ */
+typedef struct TBJmpCache {
+    struct rcu_head rcu;
+    unsigned int bits;
+    /* Statistics, only updated by the vCPU thread */
+    unsigned int used;
+    size_t hits;
+    size_t misses;
+    /* Values of hits and misses when the resize window started */
+    size_t window_hits;
+    size_t window_misses;
+    /* Accessed in parallel; all accesses must be atomic */
+    struct TranslationBlock *array[];
+} TBJmpCache;
 
 /* work queue */
 
@@ -407,8 +429,7 @@ struct CPUState {
     void *env_ptr; /* CPUArchState */
     IcountDecr *icount_decr_ptr;
 
-    /* Accessed in parallel; all accesses must be atomic */
-    struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    TBJmpCache *tb_jmp_cache;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -431,6 +452,8 @@ struct CPUState {
     int kvm_fd;
     struct KVMState *kvm_state;
     struct kvm_run *kvm_run;
+    struct kvm_dirty_gfn *kvm_dirty_gfns;
+    uint32_t kvm_fetch_index;
 
     /* Used for events with 'vcpu' and *without* the 'disabled' properties */
     DECLARE_BITMAP(trace_dstate_delayed, CPU_TRACE_DSTATE_MAX_EVENTS);
@@ -482,11 +505,16 @@ extern __thread CPUState *current_cpu;
 
 static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 {
+    TBJmpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
     unsigned int i;
 
-    for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
+    if (!jc) {
+        return;
+    }
+    for (i = 0; i < (1u << jc->bits); i++) {
+        qatomic_set(&jc->array[i], NULL);
     }
+    jc->used = 0;
 }
 
 /**
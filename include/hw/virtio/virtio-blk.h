@@ -36,6 +36,8 @@ struct VirtIOBlkConf
 {
     BlockConf conf;
     IOThread *iothread;
+    uint32_t num_vq_iothreads;
+    char **vq_iothreads;
     char *serial;
     uint32_t request_merging;
     uint16_t num_queues;
@@ -61,6 +63,7 @@ struct VirtIOBlock {
     bool dataplane_disabled;
     bool dataplane_started;
     struct VirtIOBlockDataPlane *dataplane;
+    unsigned int deferred_pushes;   /* see virtio_blk_req_complete() */
     uint64_t host_features;
     size_t config_size;
 };
@@ -79,6 +82,7 @@ typedef struct VirtIOBlockReq {
     struct VirtIOBlockReq *next;
     struct VirtIOBlockReq *mr_next;
     BlockAcctCookie acct;
+    int refcnt;
 } VirtIOBlockReq;
 
 #define VIRTIO_BLK_MAX_MERGE_REQS 32
@@ -20,6 +20,8 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "sysemu/iothread.h"
+#include "net/toeplitz.h"
 
 #define TYPE_VIRTIO_NET "virtio-net-device"
 OBJECT_DECLARE_SIMPLE_TYPE(VirtIONet, VIRTIO_NET)
@@ -45,6 +47,9 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    /* queue pair i runs in iothreads[i % num_iothreads] */
+    uint32_t num_iothreads;
+    char **iothreads;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -134,11 +139,14 @@ typedef struct VirtioNetRssData {
     bool    populate_hash;
     uint32_t hash_types;
     uint8_t key[VIRTIO_NET_RSS_MAX_KEY_SIZE];
+    NetToeplitz *toeplitz;  /* lookup tables for the key */
     uint16_t indirections_len;
     uint16_t *indirections_table;
     uint16_t default_queue;
 } VirtioNetRssData;
 
+typedef struct VirtIONetSteerPacket VirtIONetSteerPacket;
+
 typedef struct VirtIONetQueue {
     VirtQueue *rx_vq;
     VirtQueue *tx_vq;
@@ -148,6 +156,16 @@ typedef struct VirtIONetQueue {
     struct {
         VirtQueueElement *elem;
     } async_tx;
+    /* the guest is notified at the end of a batch of received packets */
+    bool rx_batching;
+    /* used buffers were added to rx_vq during a batch of packets */
+    bool rx_notify;
+    struct NetRxPkt *rx_pkt;
+    /* packets that RSS steered here from the IOThreads of other queues */
+    QemuMutex steer_lock;
+    QSIMPLEQ_HEAD(, VirtIONetSteerPacket) steer_packets;
+    unsigned int steer_len;
+    QEMUBH *steer_bh;
     struct VirtIONet *n;
 } VirtIONetQueue;
 
@@ -208,7 +226,9 @@ struct VirtIONet {
     DeviceListener primary_listener;
     Notifier migration_state;
     VirtioNetRssData rss_data;
-    struct NetRxPkt *rx_pkt;
+    IOThread **iothreads;
+    /* the queue pairs run in their IOThreads */
+    bool dataplane_started;
 };
 
 void virtio_net_set_netclient_name(VirtIONet *n, const char *name,
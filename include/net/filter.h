@@ -23,12 +23,17 @@ typedef void (FilterCleanup) (NetFilterState *nf);
  * Return:
  *   0: finished handling the packet, we should continue
  *   size: filter stolen this packet, we stop pass this packet further
+ *
+ * @buf, if not NULL, is the NetPacketBuf that @iov points into.  A filter
+ * that holds on to the packet takes a reference to it instead of copying
+ * @iov.
  */
 typedef ssize_t (FilterReceiveIOV)(NetFilterState *nc,
                                    NetClientState *sender,
                                    unsigned flags,
                                    const struct iovec *iov,
                                    int iovcnt,
+                                   NetPacketBuf *buf,
                                    NetPacketSent *sent_cb);
 
 typedef void (FilterStatusChanged) (NetFilterState *nf, Error **errp);
@@ -68,6 +73,7 @@ ssize_t qemu_netfilter_receive(NetFilterState *nf,
                                unsigned flags,
                                const struct iovec *iov,
                                int iovcnt,
+                               NetPacketBuf *buf,
                                NetPacketSent *sent_cb);
 
 /* pass the packet to the next filter */
@@ -75,6 +81,7 @@ ssize_t qemu_netfilter_pass_to_next(NetClientState *sender,
                                     unsigned flags,
                                     const struct iovec *iov,
                                     int iovcnt,
+                                    NetPacketBuf *buf,
                                     void *opaque);
 
 void colo_notify_filters_event(int event, Error **errp);
@@ -24,8 +24,10 @@
 #ifndef QEMU_NET_QUEUE_H
 #define QEMU_NET_QUEUE_H
 
+#include "qemu/atomic.h"
 
 typedef struct NetPacket NetPacket;
+typedef struct NetPacketBuf NetPacketBuf;
 typedef struct NetQueue NetQueue;
 
 typedef void (NetPacketSent) (NetClientState *sender, ssize_t ret);
@@ -33,15 +35,39 @@ typedef void (NetPacketSent) (NetClientState *sender, ssize_t ret);
 #define QEMU_NET_PACKET_FLAG_NONE  0
 #define QEMU_NET_PACKET_FLAG_RAW  (1<<0)
 
+/*
+ * The data of a queued packet.  Queues and filters that hold on to a
+ * packet they are handed in a NetPacketBuf take a reference to it rather
+ * than a copy of the data.  The data may only be modified by the holder
+ * of the only reference, see net_packet_buf_writable().
+ */
+struct NetPacketBuf {
+    int refcnt;
+    size_t size;
+    uint8_t data[];
+};
+
+NetPacketBuf *net_packet_buf_new(const struct iovec *iov, int iovcnt);
+NetPacketBuf *net_packet_buf_ref(NetPacketBuf *buf);
+void net_packet_buf_unref(NetPacketBuf *buf);
+
+static inline bool net_packet_buf_writable(NetPacketBuf *buf)
+{
+    return qatomic_read(&buf->refcnt) == 1;
+}
+
 /* Returns:
  *   >0 - success
  *    0 - queue packet for future redelivery
  *   <0 - failure (discard packet)
+ *
+ * @buf is the NetPacketBuf that @iov points into, if any.
  */
 typedef ssize_t (NetQueueDeliverFunc)(NetClientState *sender,
                                       unsigned flags,
                                       const struct iovec *iov,
                                       int iovcnt,
+                                      NetPacketBuf *buf,
                                       void *opaque);
 
 NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque);
@@ -53,6 +79,12 @@ void qemu_net_queue_append_iov(NetQueue *queue,
                                int iovcnt,
                                NetPacketSent *sent_cb);
 
+void qemu_net_queue_append_buf(NetQueue *queue,
+                               NetClientState *sender,
+                               unsigned flags,
+                               NetPacketBuf *buf,
+                               NetPacketSent *sent_cb);
+
 void qemu_del_net_queue(NetQueue *queue);
 
 ssize_t qemu_net_queue_send(NetQueue *queue,
@@ -69,6 +101,13 @@ ssize_t qemu_net_queue_send_iov(NetQueue *queue,
                                 int iovcnt,
                                 NetPacketSent *sent_cb);
 
+ssize_t qemu_net_queue_send_buf(NetQueue *queue,
+                                NetClientState *sender,
+                                unsigned flags,
+                                NetPacketBuf *buf,
+                                NetPacketSent *sent_cb);
+
+bool qemu_net_queue_idle(NetQueue *queue);
 void qemu_net_queue_purge(NetQueue *queue, NetClientState *from);
 bool qemu_net_queue_flush(NetQueue *queue);
 
@@ -0,0 +1,44 @@
+/*
+ * Toeplitz hash for receive side scaling
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_NET_TOEPLITZ_H
+#define QEMU_NET_TOEPLITZ_H
+
+/* IPv6 source and destination addresses and ports */
+#define NET_TOEPLITZ_MAX_INPUT  36
+/* enough key for NET_TOEPLITZ_MAX_INPUT bytes of input */
+#define NET_TOEPLITZ_KEY_SIZE   (NET_TOEPLITZ_MAX_INPUT + 4)
+
+/*
+ * The hash of a byte of input only depends on its value and position, so
+ * it is looked up in a table built from the key: the hash of an input is
+ * the XOR of the entries for each of its bytes.
+ */
+typedef struct NetToeplitz {
+    uint32_t table[NET_TOEPLITZ_MAX_INPUT][256];
+} NetToeplitz;
+
+/**
+ * net_toeplitz_init:
+ * @t: the tables to build
+ * @key: the secret key
+ * @key_len: length of @key in bytes, missing bytes are taken as zero
+ */
+void net_toeplitz_init(NetToeplitz *t, const uint8_t *key, size_t key_len);
+
+/**
+ * net_toeplitz_hash:
+ * @t: the tables for the key
+ * @input: the fields of the packet that are hashed
+ * @len: length of @input, at most NET_TOEPLITZ_MAX_INPUT bytes
+ *
+ * Returns the same hash as net_toeplitz_add() does with the key of @t.
+ */
+uint32_t net_toeplitz_hash(const NetToeplitz *t, const uint8_t *input,
+                           size_t len);
+
+#endif /* QEMU_NET_TOEPLITZ_H */
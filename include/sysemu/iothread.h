@@ -37,6 +37,17 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* Thread pool parameters, see aio_context_set_thread_pool_params() */
+    int64_t thread_pool_min;
+    int64_t thread_pool_max;
+    int64_t thread_pool_idle_timeout;
+    unsigned long *thread_pool_cpus;
+    unsigned long thread_pool_cpus_nbits;
+
+    /* io_uring submission queue polling, see aio_context_set_io_uring_sqpoll */
+    bool io_uring_sqpoll;
+    int64_t io_uring_sqpoll_cpu;
 };
 typedef struct IOThread IOThread;
 
@@ -646,6 +646,18 @@ struct TCGContext {
 
     TCGLabel *exitreq_label;
 
+    /*
+     * Superblock translation, see translator_loop().  While a block other
+     * than the last one is translated, trace_next is the label of the next
+     * block: goto_tb trace_hot_exit branches to it, and the other exits
+     * look their destination up instead of being chained.
+     */
+    const struct TBTrace *trace;
+    TranslationBlock *trace_tb;
+    TCGLabel *trace_next;
+    int trace_hot_exit;
+    bool trace_failed;
+
 #ifdef CONFIG_PLUGIN
     /*
      * We keep one plugin_tb struct per TCGContext. Note that on every TB
@@ -680,6 +692,8 @@ struct TCGContext {
 extern TCGContext tcg_init_ctx;
 extern __thread TCGContext *tcg_ctx;
 extern TCGv_env cpu_env;
+/* TCG threads, besides the vCPUs, that translate speculatively */
+extern unsigned int tcg_spec_threads;
 
 static inline size_t temp_idx(TCGTemp *ts)
 {
@@ -836,6 +850,8 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 void tcg_region_init(void);
 void tb_destroy(TranslationBlock *tb);
 void tcg_region_reset_all(void);
+bool tcg_region_reserve(void *end);
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
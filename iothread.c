@@ -16,10 +16,14 @@
 #include "qom/object_interfaces.h"
 #include "qemu/module.h"
 #include "block/aio.h"
+#include "block/aio-wait.h"
 #include "block/block.h"
+#include "block/thread-pool.h"
 #include "sysemu/iothread.h"
 #include "qapi/error.h"
+#include "qapi/qapi-builtin-visit.h"
 #include "qapi/qapi-commands-misc.h"
+#include "qemu/bitmap.h"
 #include "qemu/error-report.h"
 #include "qemu/rcu.h"
 #include "qemu/main-loop.h"
@@ -113,6 +117,9 @@ static void iothread_instance_init(Object *obj)
     IOThread *iothread = IOTHREAD(obj);
 
     iothread->poll_max_ns = IOTHREAD_POLL_MAX_NS_DEFAULT;
+    iothread->thread_pool_max = THREAD_POOL_MAX_THREADS_DEFAULT;
+    iothread->thread_pool_idle_timeout = THREAD_POOL_IDLE_TIMEOUT_MS_DEFAULT;
+    iothread->io_uring_sqpoll_cpu = -1;
     iothread->thread_id = -1;
     qemu_sem_init(&iothread->init_done_sem, 0);
     /* By default, we don't run gcontext */
@@ -145,6 +152,7 @@ static void iothread_instance_finalize(Object *obj)
         g_main_loop_unref(iothread->main_loop);
         iothread->main_loop = NULL;
     }
+    g_free(iothread->thread_pool_cpus);
     qemu_sem_destroy(&iothread->init_done_sem);
 }
 
@@ -178,6 +186,18 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
      */
     iothread_init_gcontext(iothread);
 
+    if (iothread->io_uring_sqpoll) {
+        aio_context_set_io_uring_sqpoll(iothread->ctx,
+                                        iothread->io_uring_sqpoll_cpu,
+                                        &local_error);
+        if (local_error) {
+            error_propagate(errp, local_error);
+            aio_context_unref(iothread->ctx);
+            iothread->ctx = NULL;
+            return;
+        }
+    }
+
     aio_context_set_poll_params(iothread->ctx,
                                 iothread->poll_max_ns,
                                 iothread->poll_grow,
@@ -190,6 +210,21 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
         return;
     }
 
+    aio_context_set_thread_pool_params(iothread->ctx,
+                                       iothread->thread_pool_min,
+                                       iothread->thread_pool_max,
+                                       iothread->thread_pool_idle_timeout,
+                                       &local_error);
+    if (local_error) {
+        error_propagate(errp, local_error);
+        aio_context_unref(iothread->ctx);
+        iothread->ctx = NULL;
+        return;
+    }
+    aio_context_set_thread_pool_affinity(iothread->ctx,
+                                         iothread->thread_pool_cpus,
+                                         iothread->thread_pool_cpus_nbits);
+
     /* This assumes we are called from a thread with useful CPU affinity for us
      * to inherit.
      */
@@ -259,6 +294,178 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
     }
 }
 
+static PollParamInfo thread_pool_min_info = {
+    "thread-pool-min", offsetof(IOThread, thread_pool_min),
+};
+static PollParamInfo thread_pool_max_info = {
+    "thread-pool-max", offsetof(IOThread, thread_pool_max),
+};
+static PollParamInfo thread_pool_idle_timeout_info = {
+    "thread-pool-idle-timeout", offsetof(IOThread, thread_pool_idle_timeout),
+};
+
+static void iothread_set_thread_pool_param(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    PollParamInfo *info = opaque;
+    int64_t *field = (void *)iothread + info->offset;
+    int64_t value;
+
+    if (!visit_type_int64(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value < 0 || value > INT_MAX) {
+        error_setg(errp, "%s value must be in range [0, %d]",
+                   info->name, INT_MAX);
+        return;
+    }
+
+    if (iothread->ctx) {
+        Error *local_err = NULL;
+        int64_t old_value = *field;
+
+        *field = value;
+        aio_context_set_thread_pool_params(iothread->ctx,
+                                           iothread->thread_pool_min,
+                                           iothread->thread_pool_max,
+                                           iothread->thread_pool_idle_timeout,
+                                           &local_err);
+        if (local_err) {
+            *field = old_value;
+            error_propagate(errp, local_err);
+        }
+    } else {
+        *field = value;
+    }
+}
+
+static void iothread_get_thread_pool_cpus(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    uint16List *host_cpus = NULL;
+    uint16List **cpu = &host_cpus;
+    unsigned long nbits = iothread->thread_pool_cpus_nbits;
+    unsigned long value;
+
+    if (iothread->thread_pool_cpus) {
+        value = find_first_bit(iothread->thread_pool_cpus, nbits);
+        while (value < nbits) {
+            *cpu = g_malloc0(sizeof(**cpu));
+            (*cpu)->value = value;
+            cpu = &(*cpu)->next;
+            value = find_next_bit(iothread->thread_pool_cpus, nbits,
+                                  value + 1);
+        }
+    }
+
+    visit_type_uint16List(v, name, &host_cpus, errp);
+    qapi_free_uint16List(host_cpus);
+}
+
+static void iothread_set_thread_pool_affinity_bh(void *opaque)
+{
+    IOThread *iothread = opaque;
+
+    aio_context_set_thread_pool_affinity(iothread->ctx,
+                                         iothread->thread_pool_cpus,
+                                         iothread->thread_pool_cpus_nbits);
+}
+
+static void iothread_set_thread_pool_cpus(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    uint16List *l, *host_cpus = NULL;
+    unsigned long nbits = 0;
+
+    if (!visit_type_uint16List(v, name, &host_cpus, errp)) {
+        return;
+    }
+
+    for (l = host_cpus; l; l = l->next) {
+        nbits = MAX(nbits, l->value + 1);
+    }
+
+    g_free(iothread->thread_pool_cpus);
+    iothread->thread_pool_cpus = NULL;
+    iothread->thread_pool_cpus_nbits = 0;
+    if (nbits) {
+        iothread->thread_pool_cpus = bitmap_new(nbits);
+        iothread->thread_pool_cpus_nbits = nbits;
+        for (l = host_cpus; l; l = l->next) {
+            set_bit(l->value, iothread->thread_pool_cpus);
+        }
+    }
+    qapi_free_uint16List(host_cpus);
+
+    /*
+     * The thread pool of the AioContext is created and reads the affinity
+     * in the iothread, so update it there.
+     */
+    if (iothread->ctx) {
+        aio_context_acquire(iothread->ctx);
+        aio_wait_bh_oneshot(iothread->ctx,
+                            iothread_set_thread_pool_affinity_bh, iothread);
+        aio_context_release(iothread->ctx);
+    }
+}
+
+static bool iothread_get_io_uring_sqpoll(Object *obj, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    return iothread->io_uring_sqpoll;
+}
+
+static void iothread_set_io_uring_sqpoll(Object *obj, bool value,
+                                         Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        error_setg(errp, "io-uring-sqpoll cannot be changed after the "
+                   "iothread has been created");
+        return;
+    }
+    iothread->io_uring_sqpoll = value;
+}
+
+static void iothread_get_io_uring_sqpoll_cpu(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    visit_type_int64(v, name, &iothread->io_uring_sqpoll_cpu, errp);
+}
+
+static void iothread_set_io_uring_sqpoll_cpu(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    int64_t value;
+
+    if (iothread->ctx) {
+        error_setg(errp, "%s cannot be changed after the iothread has been "
+                   "created", name);
+        return;
+    }
+
+    if (!visit_type_int64(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value < -1 || value > INT_MAX) {
+        error_setg(errp, "%s value must be in range [-1, %d]",
+                   name, INT_MAX);
+        return;
+    }
+
+    iothread->io_uring_sqpoll_cpu = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(klass);
@@ -276,6 +483,29 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add(klass, "thread-pool-min", "int",
+                              iothread_get_poll_param,
+                              iothread_set_thread_pool_param,
+                              NULL, &thread_pool_min_info);
+    object_class_property_add(klass, "thread-pool-max", "int",
+                              iothread_get_poll_param,
+                              iothread_set_thread_pool_param,
+                              NULL, &thread_pool_max_info);
+    object_class_property_add(klass, "thread-pool-idle-timeout", "int",
+                              iothread_get_poll_param,
+                              iothread_set_thread_pool_param,
+                              NULL, &thread_pool_idle_timeout_info);
+    object_class_property_add(klass, "thread-pool-cpus", "uint16List",
+                              iothread_get_thread_pool_cpus,
+                              iothread_set_thread_pool_cpus,
+                              NULL, NULL);
+    object_class_property_add_bool(klass, "io-uring-sqpoll",
+                                   iothread_get_io_uring_sqpoll,
+                                   iothread_set_io_uring_sqpoll);
+    object_class_property_add(klass, "io-uring-sqpoll-cpu", "int",
+                              iothread_get_io_uring_sqpoll_cpu,
+                              iothread_set_io_uring_sqpoll_cpu,
+                              NULL, NULL);
 }
 
 static const TypeInfo iothread_info = {
@@ -314,6 +544,7 @@ static int query_one_iothread(Object *object, void *opaque)
     IOThreadInfoList *elem;
     IOThreadInfo *info;
     IOThread *iothread;
+    ThreadPoolStats stats;
 
     iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
     if (!iothread) {
@@ -327,6 +558,15 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
 
+    thread_pool_get_stats(qatomic_read(&iothread->ctx->thread_pool), &stats);
+    info->thread_pool_min = iothread->thread_pool_min;
+    info->thread_pool_max = iothread->thread_pool_max;
+    info->thread_pool_threads = stats.cur_threads;
+    info->thread_pool_idle_threads = stats.idle_threads;
+    info->thread_pool_queue_depth = stats.queued;
+    info->thread_pool_completed = stats.completed;
+    info->thread_pool_busy_ns = stats.busy_ns;
+
     elem = g_new0(IOThreadInfoList, 1);
     elem->value = info;
     elem->next = NULL;
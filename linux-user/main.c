@@ -374,6 +374,14 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static void handle_arg_smc_threshold(const char *arg)
+{
+    if (qemu_strtoui(arg, NULL, 0, &tb_smc_threshold) < 0) {
+        fprintf(stderr, "Invalid smc-threshold: %s\n", arg);
+        exit(EXIT_FAILURE);
+    }
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -452,6 +460,8 @@ static const struct qemu_argument arg_table[] = {
      "pagesize",   "set the host page size to 'pagesize'"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
+    {"smc-threshold", "QEMU_SMC_THRESHOLD", true, handle_arg_smc_threshold,
+     "n",          "make code pages written n times check their own code"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
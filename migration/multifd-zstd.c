@@ -67,6 +67,21 @@ static int zstd_send_setup(MultiFDSendParams *p, Error **errp)
                    p->id, ZSTD_getErrorName(res));
         return -1;
     }
+    /*
+     * The stream is only flushed, never ended, between packets, so a
+     * bigger window lets pages refer to data sent in earlier packets.
+     */
+    if (migrate_multifd_zstd_window_log()) {
+        res = ZSTD_CCtx_setParameter(z->zcs, ZSTD_c_windowLog,
+                                     migrate_multifd_zstd_window_log());
+        if (ZSTD_isError(res)) {
+            ZSTD_freeCStream(z->zcs);
+            g_free(z);
+            error_setg(errp, "multifd %d: setting window log failed with "
+                       "error %s", p->id, ZSTD_getErrorName(res));
+            return -1;
+        }
+    }
     /* We will never have more than page_count pages */
     z->zbuff_len = page_count * qemu_target_page_size();
     z->zbuff_len *= 2;
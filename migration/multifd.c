@@ -12,11 +12,15 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
 #include "qemu/error-report.h"
 #include "qapi/error.h"
+#include "qapi/clone-visitor.h"
+#include "qapi/qapi-visit-migration.h"
+#include "qemu/timer.h"
 #include "ram.h"
 #include "migration.h"
 #include "socket.h"
@@ -242,6 +246,7 @@ static MultiFDPages_t *multifd_pages_init(size_t size)
     pages->allocated = size;
     pages->iov = g_new0(struct iovec, size);
     pages->offset = g_new0(ram_addr_t, size);
+    pages->zero_offset = g_new0(ram_addr_t, size);
 
     return pages;
 }
@@ -250,12 +255,15 @@ static void multifd_pages_clear(MultiFDPages_t *pages)
 {
     pages->used = 0;
     pages->allocated = 0;
+    pages->zero_num = 0;
     pages->packet_num = 0;
     pages->block = NULL;
     g_free(pages->iov);
     pages->iov = NULL;
     g_free(pages->offset);
     pages->offset = NULL;
+    g_free(pages->zero_offset);
+    pages->zero_offset = NULL;
     g_free(pages);
 }
 
@@ -267,6 +275,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->flags = cpu_to_be32(p->flags);
     packet->pages_alloc = cpu_to_be32(p->pages->allocated);
     packet->pages_used = cpu_to_be32(p->pages->used);
+    packet->zero_pages = cpu_to_be32(p->pages->zero_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
 
@@ -280,6 +289,12 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+
+    for (i = 0; i < p->pages->zero_num; i++) {
+        uint64_t temp = p->pages->zero_offset[i];
+
+        packet->offset[p->pages->used + i] = cpu_to_be64(temp);
+    }
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -335,10 +350,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->pages->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->pages->zero_num > packet->pages_alloc - p->pages->used) {
+        error_setg(errp, "multifd: received packet "
+                   "with %d zero pages and expected maximum pages are %d",
+                   p->pages->zero_num, packet->pages_alloc - p->pages->used);
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->pages->used == 0) {
+    if (p->pages->used == 0 && p->pages->zero_num == 0) {
         return 0;
     }
 
@@ -364,9 +387,44 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         p->pages->iov[i].iov_len = qemu_target_page_size();
     }
 
+    for (i = 0; i < p->pages->zero_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[p->pages->used + i]);
+
+        if (offset > (block->used_length - qemu_target_page_size())) {
+            error_setg(errp, "multifd: zero page offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, block->max_length);
+            return -1;
+        }
+        p->pages->zero_offset[i] = offset;
+    }
+    p->pages->block = block;
+
     return 0;
 }
 
+/**
+ * multifd_recv_zero_pages: fill in the zero pages of the current packet
+ *
+ * Pages that already read as zero are left alone, so that untouched
+ * destination memory is not allocated.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_recv_zero_pages(MultiFDRecvParams *p)
+{
+    size_t page_size = qemu_target_page_size();
+    int i;
+
+    for (i = 0; i < p->pages->zero_num; i++) {
+        void *host = p->pages->block->host + p->pages->zero_offset[i];
+
+        if (!buffer_is_zero(host, page_size)) {
+            memset(host, 0, page_size);
+        }
+    }
+}
+
 struct {
     MultiFDSendParams *params;
     /* array of pages to sent */
@@ -383,8 +441,13 @@ struct {
     int exiting;
     /* multifd ops */
     MultiFDMethods *ops;
+    /* do zero page detection in the channel threads */
+    bool zero_page;
 } *multifd_send_state;
 
+/* channel statistics of the last outgoing migration */
+static MultiFDChannelStatsList *multifd_send_stats;
+
 /*
  * How we use multifd_send_state->pages and channel->pages?
  *
@@ -403,6 +466,29 @@ struct {
  * false.
  */
 
+/**
+ * multifd_send_account_zero_pages: update counters for detected zero pages
+ *
+ * The migration thread accounts every queued page as a normal page; fix
+ * that up for the pages that the channel found to be zero and did not
+ * send.  Must be called with p->mutex held while the channel is idle.
+ *
+ * @f: QEMUFile where the migration is being sent
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_account_zero_pages(QEMUFile *f,
+                                            MultiFDSendParams *p)
+{
+    uint64_t bytes = (uint64_t)p->zero_pages_pending * qemu_target_page_size();
+
+    ram_counters.duplicate += p->zero_pages_pending;
+    ram_counters.normal -= p->zero_pages_pending;
+    ram_counters.multifd_bytes -= bytes;
+    ram_counters.transferred -= bytes;
+    qemu_file_update_transfer(f, -(int64_t)bytes);
+    p->zero_pages_pending = 0;
+}
+
 static int multifd_send_pages(QEMUFile *f)
 {
     int i;
@@ -439,7 +525,9 @@ static int multifd_send_pages(QEMUFile *f)
         qemu_mutex_unlock(&p->mutex);
     }
     assert(!p->pages->used);
+    assert(!p->pages->zero_num);
     assert(!p->pages->block);
+    multifd_send_account_zero_pages(f, p);
 
     p->packet_num = multifd_send_state->packet_num++;
     multifd_send_state->pages = p->pages;
@@ -523,6 +611,37 @@ static void multifd_send_terminate_threads(Error *err)
     }
 }
 
+static MultiFDChannelStatsList *multifd_build_channel_stats(void)
+{
+    MultiFDChannelStatsList *head = NULL, **tail = &head;
+    int i;
+
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+        MultiFDChannelStatsList *entry = g_new0(MultiFDChannelStatsList, 1);
+        MultiFDChannelStats *st = g_new0(MultiFDChannelStats, 1);
+
+        qemu_mutex_lock(&p->mutex);
+        st->id = p->id;
+        st->packets = p->num_packets;
+        st->pages = p->num_pages;
+        st->zero_pages = p->num_zero_pages;
+        st->uncompressed_size = p->uncompressed_bytes;
+        st->compressed_size = p->compressed_bytes;
+        st->cpu_time = p->cpu_time_ns;
+        qemu_mutex_unlock(&p->mutex);
+        if (st->compressed_size) {
+            st->compression_rate = (double)st->uncompressed_size /
+                                   st->compressed_size;
+        }
+
+        entry->value = st;
+        *tail = entry;
+        tail = &entry->next;
+    }
+    return head;
+}
+
 void multifd_save_cleanup(void)
 {
     int i;
@@ -538,6 +657,8 @@ void multifd_save_cleanup(void)
             qemu_thread_join(&p->thread);
         }
     }
+    qapi_free_MultiFDChannelStatsList(multifd_send_stats);
+    multifd_send_stats = multifd_build_channel_stats();
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
         Error *local_err = NULL;
@@ -611,10 +732,73 @@ void multifd_send_sync_main(QEMUFile *f)
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        qemu_mutex_lock(&p->mutex);
+        multifd_send_account_zero_pages(f, p);
+        qemu_mutex_unlock(&p->mutex);
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
+/**
+ * multifd_send_zero_page_detect: split out the zero pages of a packet
+ *
+ * Zero pages are moved to pages->zero_offset and only their offset is
+ * sent; the remaining pages are compacted at the start of the arrays.
+ * Doing this in the channel threads lets the scan scale with the
+ * number of channels instead of running on the migration thread.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_zero_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t used = 0;
+    uint32_t i;
+
+    for (i = 0; i < pages->used; i++) {
+        if (buffer_is_zero(pages->iov[i].iov_base, page_size)) {
+            pages->zero_offset[pages->zero_num++] = pages->offset[i];
+            continue;
+        }
+        if (used != i) {
+            pages->offset[used] = pages->offset[i];
+            pages->iov[used] = pages->iov[i];
+        }
+        used++;
+    }
+    pages->used = used;
+}
+
+/* CPU time consumed by the calling thread, in ns */
+static uint64_t multifd_thread_cpu_ns(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        return ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+    }
+#endif
+    return get_clock();
+}
+
+/**
+ * multifd_query_channel_stats: statistics of the send channels
+ *
+ * Returns the statistics of the running outgoing migration, or of the
+ * last one once its channels have been cleaned up.  NULL if multifd
+ * was never used for an outgoing migration.
+ */
+MultiFDChannelStatsList *multifd_query_channel_stats(void)
+{
+    if (multifd_send_state) {
+        return multifd_build_channel_stats();
+    }
+    return QAPI_CLONE(MultiFDChannelStatsList, multifd_send_stats);
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
@@ -641,10 +825,17 @@ static void *multifd_send_thread(void *opaque)
         qemu_mutex_lock(&p->mutex);
 
         if (p->pending_job) {
-            uint32_t used = p->pages->used;
+            uint32_t used, zero_num;
             uint64_t packet_num = p->packet_num;
+            uint64_t cpu_start = multifd_thread_cpu_ns();
             flags = p->flags;
 
+            if (multifd_send_state->zero_page) {
+                multifd_send_zero_page_detect(p);
+            }
+            used = p->pages->used;
+            zero_num = p->pages->zero_num;
+
             if (used) {
                 ret = multifd_send_state->ops->send_prepare(p, used,
                                                             &local_err);
@@ -652,16 +843,23 @@ static void *multifd_send_thread(void *opaque)
                     qemu_mutex_unlock(&p->mutex);
                     break;
                 }
+                p->uncompressed_bytes += (uint64_t)used *
+                                         qemu_target_page_size();
+                p->compressed_bytes += p->next_packet_size;
             }
+            p->cpu_time_ns += multifd_thread_cpu_ns() - cpu_start;
             multifd_send_fill_packet(p);
             p->flags = 0;
             p->num_packets++;
             p->num_pages += used;
+            p->num_zero_pages += zero_num;
+            p->zero_pages_pending += zero_num;
             p->pages->used = 0;
+            p->pages->zero_num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, used, flags,
+            trace_multifd_send(p->id, packet_num, used, zero_num, flags,
                                p->next_packet_size);
 
             ret = qio_channel_write_all(p->c, (void *)p->packet,
@@ -715,7 +913,8 @@ out:
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->num_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->num_pages,
+                                  p->num_zero_pages);
 
     return NULL;
 }
@@ -869,6 +1068,7 @@ int multifd_save_setup(Error **errp)
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
     qatomic_set(&multifd_send_state->exiting, 0);
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    multifd_send_state->zero_page = migrate_multifd_zero_page();
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -1060,10 +1260,11 @@ static void *multifd_recv_thread(void *opaque)
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, used, flags,
-                           p->next_packet_size);
+        trace_multifd_recv(p->id, p->packet_num, used, p->pages->zero_num,
+                           flags, p->next_packet_size);
         p->num_packets++;
         p->num_pages += used;
+        p->num_zero_pages += p->pages->zero_num;
         qemu_mutex_unlock(&p->mutex);
 
         if (used) {
@@ -1073,6 +1274,8 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        multifd_recv_zero_pages(p);
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1088,7 +1291,8 @@ static void *multifd_recv_thread(void *opaque)
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->num_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->num_pages,
+                                  p->num_zero_pages);
 
     return NULL;
 }
@@ -294,6 +294,40 @@ struct RAMSrcPageRequest {
     QSIMPLEQ_ENTRY(RAMSrcPageRequest) next_req;
 };
 
+/*
+ * RAM blocks are synchronized in chunks of this many pages when the dirty
+ * bitmap is synchronized by several threads.  It is a multiple of
+ * BITS_PER_LONG, so that two chunks never share a word of the bitmaps.
+ */
+#define DIRTY_SYNC_CHUNK_PAGES (1 << 18)
+
+typedef struct {
+    RAMBlock *rb;
+    ram_addr_t start;
+    ram_addr_t length;
+} DirtySyncChunk;
+
+/* Threads helping the migration thread to synchronize the dirty bitmap */
+typedef struct {
+    QemuThread *threads;
+    int thread_count;
+    /* Protects all the fields below */
+    QemuMutex lock;
+    /* Signalled when there are new chunks, or when the threads must quit */
+    QemuCond work_cond;
+    /* Signalled when the last chunk of a synchronization is done */
+    QemuCond done_cond;
+    /* Chunks of the current synchronization */
+    GArray *chunks;
+    /* Index of the next chunk to synchronize */
+    guint next_chunk;
+    /* Number of chunks being synchronized right now */
+    guint running;
+    /* Number of new dirty pages found in the done chunks */
+    uint64_t num_dirty;
+    bool quit;
+} DirtySyncState;
+
 /* State of RAM for migration */
 struct RAMState {
     /* QEMUFile used for this migration */
@@ -347,6 +381,8 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
+    /* Dirty bitmap synchronization threads, NULL if there is only one */
+    DirtySyncState *dirty_sync;
 };
 typedef struct RAMState RAMState;
 
@@ -860,6 +896,185 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * Synchronize the next chunk if there is one left.
+ *
+ * Returns true if a chunk was synchronized
+ *
+ * Called with ds->lock held, which is released while the chunk is
+ * synchronized.
+ */
+static bool dirty_sync_chunk(DirtySyncState *ds)
+{
+    DirtySyncChunk *chunk;
+    uint64_t num_dirty;
+
+    if (ds->next_chunk >= ds->chunks->len) {
+        return false;
+    }
+
+    chunk = &g_array_index(ds->chunks, DirtySyncChunk, ds->next_chunk++);
+    ds->running++;
+    qemu_mutex_unlock(&ds->lock);
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        num_dirty = cpu_physical_memory_sync_dirty_bitmap(chunk->rb,
+                                                          chunk->start,
+                                                          chunk->length);
+    }
+    trace_migration_dirty_sync_chunk(chunk->rb->idstr, chunk->start,
+                                     chunk->length, num_dirty);
+
+    qemu_mutex_lock(&ds->lock);
+    ds->num_dirty += num_dirty;
+    if (!--ds->running && ds->next_chunk == ds->chunks->len) {
+        qemu_cond_signal(&ds->done_cond);
+    }
+    return true;
+}
+
+static void *dirty_sync_thread(void *opaque)
+{
+    DirtySyncState *ds = opaque;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&ds->lock);
+    while (!ds->quit) {
+        if (!dirty_sync_chunk(ds)) {
+            qemu_cond_wait(&ds->work_cond, &ds->lock);
+        }
+    }
+    qemu_mutex_unlock(&ds->lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void dirty_sync_setup(RAMState *rs)
+{
+    int thread_count = migrate_dirty_sync_threads();
+    DirtySyncState *ds;
+    int i;
+
+    /* The migration thread is one of the threads */
+    if (thread_count <= 1) {
+        return;
+    }
+
+    ds = g_new0(DirtySyncState, 1);
+    ds->thread_count = thread_count - 1;
+    ds->threads = g_new0(QemuThread, ds->thread_count);
+    ds->chunks = g_array_new(false, false, sizeof(DirtySyncChunk));
+    qemu_mutex_init(&ds->lock);
+    qemu_cond_init(&ds->work_cond);
+    qemu_cond_init(&ds->done_cond);
+    for (i = 0; i < ds->thread_count; i++) {
+        qemu_thread_create(ds->threads + i, "dirtysync",
+                           dirty_sync_thread, ds, QEMU_THREAD_JOINABLE);
+    }
+    rs->dirty_sync = ds;
+}
+
+static void dirty_sync_cleanup(RAMState *rs)
+{
+    DirtySyncState *ds = rs->dirty_sync;
+    int i;
+
+    if (!ds) {
+        return;
+    }
+
+    qemu_mutex_lock(&ds->lock);
+    ds->quit = true;
+    qemu_cond_broadcast(&ds->work_cond);
+    qemu_mutex_unlock(&ds->lock);
+    for (i = 0; i < ds->thread_count; i++) {
+        qemu_thread_join(ds->threads + i);
+    }
+
+    qemu_cond_destroy(&ds->done_cond);
+    qemu_cond_destroy(&ds->work_cond);
+    qemu_mutex_destroy(&ds->lock);
+    g_array_free(ds->chunks, true);
+    g_free(ds->threads);
+    g_free(ds);
+    rs->dirty_sync = NULL;
+}
+
+/*
+ * Chunks can only be synchronized in parallel when the whole block takes
+ * the word at a time path of cpu_physical_memory_sync_dirty_bitmap(), and
+ * when clearing the dirty log is postponed through the clear bitmap:
+ * clearing it right away calls into the memory listeners, which must not
+ * happen outside of the migration thread.
+ */
+static bool ramblock_can_sync_in_chunks(RAMBlock *rb)
+{
+    ram_addr_t align = BITS_PER_LONG << TARGET_PAGE_BITS;
+
+    return rb->clear_bmap && !(rb->offset & (align - 1)) &&
+           !(rb->used_length & (align - 1));
+}
+
+/*
+ * Split the blocks in chunks and synchronize them with the help of the
+ * dirty sync threads.  Blocks that cannot be split are synchronized by
+ * the migration thread while the other threads start on the chunks.
+ *
+ * Called with RCU critical section
+ */
+static void ramblock_sync_dirty_bitmap_parallel(RAMState *rs)
+{
+    DirtySyncState *ds = rs->dirty_sync;
+    ram_addr_t chunk_size = (ram_addr_t)DIRTY_SYNC_CHUNK_PAGES <<
+                            TARGET_PAGE_BITS;
+    RAMBlock *block;
+    uint64_t num_dirty;
+
+    qemu_mutex_lock(&ds->lock);
+    g_array_set_size(ds->chunks, 0);
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t start;
+
+        if (!ramblock_can_sync_in_chunks(block)) {
+            continue;
+        }
+        for (start = 0; start < block->used_length; start += chunk_size) {
+            DirtySyncChunk chunk = {
+                .rb = block,
+                .start = start,
+                .length = MIN(chunk_size, block->used_length - start),
+            };
+
+            g_array_append_val(ds->chunks, chunk);
+        }
+    }
+    ds->next_chunk = 0;
+    ds->num_dirty = 0;
+    qemu_cond_broadcast(&ds->work_cond);
+    qemu_mutex_unlock(&ds->lock);
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        if (!ramblock_can_sync_in_chunks(block)) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+    }
+
+    qemu_mutex_lock(&ds->lock);
+    while (dirty_sync_chunk(ds)) {
+        /* Help with the chunks that are left */
+    }
+    while (ds->running) {
+        qemu_cond_wait(&ds->done_cond, &ds->lock);
+    }
+    num_dirty = ds->num_dirty;
+    qemu_mutex_unlock(&ds->lock);
+
+    rs->migration_dirty_pages += num_dirty;
+    rs->num_dirty_pages_period += num_dirty;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -971,9 +1186,10 @@ static void migration_trigger_throttle(RAMState *rs)
 static void migration_bitmap_sync(RAMState *rs)
 {
     RAMBlock *block;
-    int64_t end_time;
+    int64_t start_time_us, end_time;
 
     ram_counters.dirty_sync_count++;
+    start_time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
     if (!rs->time_last_bitmap_sync) {
         rs->time_last_bitmap_sync = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
@@ -984,15 +1200,22 @@ static void migration_bitmap_sync(RAMState *rs)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
+        if (rs->dirty_sync) {
+            ramblock_sync_dirty_bitmap_parallel(rs);
+        } else {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                ramblock_sync_dirty_bitmap(rs, block);
+            }
         }
         ram_counters.remaining = ram_bytes_remaining();
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
-    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    ram_counters.dirty_sync_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                                   start_time_us;
+    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period,
+                                    ram_counters.dirty_sync_time);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
@@ -1653,6 +1876,7 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    bool use_multifd;
     int res;
 
     if (control_save_page(rs, block, offset, &res)) {
@@ -1663,6 +1887,20 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return 1;
     }
 
+    /*
+     * Do not use multifd for:
+     * 1. Compression as the first page in the new block should be posted out
+     *    before sending the compressed page
+     * 2. In postcopy as one whole host page should be placed
+     */
+    use_multifd = !save_page_use_compression(rs) && migrate_use_multifd() &&
+                  !migration_in_postcopy();
+
+    /* The multifd channels look for zero pages themselves */
+    if (use_multifd && migrate_multifd_zero_page()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -1677,14 +1915,7 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return res;
     }
 
-    /*
-     * Do not use multifd for:
-     * 1. Compression as the first page in the new block should be posted out
-     *    before sending the compressed page
-     * 2. In postcopy as one whole host page should be placed
-     */
-    if (!save_page_use_compression(rs) && migrate_use_multifd()
-        && !migration_in_postcopy()) {
+    if (use_multifd) {
         return ram_save_multifd_page(rs, block, offset);
     }
 
@@ -1851,6 +2082,7 @@ static void xbzrle_load_cleanup(void)
 static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
+        dirty_sync_cleanup(*rsp);
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
@@ -2292,6 +2524,7 @@ static int ram_state_init(RAMState **rsp)
      */
     (*rsp)->migration_dirty_pages = ram_bytes_total() >> TARGET_PAGE_BITS;
     ram_state_reset(*rsp);
+    dirty_sync_setup(*rsp);
 
     return 0;
 }
@@ -269,6 +269,8 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->normal_bytes >> 10);
         monitor_printf(mon, "dirty sync count: %" PRIu64 "\n",
                        info->ram->dirty_sync_count);
+        monitor_printf(mon, "dirty sync time: %" PRIu64 " microseconds\n",
+                       info->ram->dirty_sync_time);
         monitor_printf(mon, "page size: %" PRIu64 " kbytes\n",
                        info->ram->page_size >> 10);
         monitor_printf(mon, "multifd bytes: %" PRIu64 " kbytes\n",
@@ -325,6 +327,22 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->compression->compression_rate);
     }
 
+    if (info->has_multifd) {
+        MultiFDChannelStatsList *ch;
+
+        for (ch = info->multifd; ch; ch = ch->next) {
+            MultiFDChannelStats *st = ch->value;
+
+            monitor_printf(mon, "multifd channel %u: packets %" PRIu64
+                           " pages %" PRIu64 " zero pages %" PRIu64
+                           " compressed size %" PRIu64 " kbytes"
+                           " compression rate %0.2f cpu time %" PRIu64
+                           " ms\n", st->id, st->packets, st->pages,
+                           st->zero_pages, st->compressed_size >> 10,
+                           st->compression_rate, st->cpu_time / SCALE_MS);
+        }
+    }
+
     if (info->has_cpu_throttle_percentage) {
         monitor_printf(mon, "cpu throttle percentage: %" PRIu64 "\n",
                        info->cpu_throttle_percentage);
@@ -469,6 +487,12 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_COMPRESSION),
             MultiFDCompression_str(params->multifd_compression));
+        monitor_printf(mon, "%s: %" PRId64 "\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_ZSTD_WINDOW_LOG),
+            params->multifd_zstd_window_log);
+        monitor_printf(mon, "%s: %" PRId64 "\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRTY_SYNC_THREADS),
+            params->dirty_sync_threads);
         monitor_printf(mon, "%s: %" PRIu64 " bytes\n",
             MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE),
             params->xbzrle_cache_size);
@@ -1388,6 +1412,14 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_multifd_zstd_level = true;
         visit_type_int(v, param, &p->multifd_zstd_level, &err);
         break;
+    case MIGRATION_PARAMETER_MULTIFD_ZSTD_WINDOW_LOG:
+        p->has_multifd_zstd_window_log = true;
+        visit_type_int(v, param, &p->multifd_zstd_window_log, &err);
+        break;
+    case MIGRATION_PARAMETER_DIRTY_SYNC_THREADS:
+        p->has_dirty_sync_threads = true;
+        visit_type_int(v, param, &p->dirty_sync_threads, &err);
+        break;
     case MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE:
         p->has_xbzrle_cache_size = true;
         if (!visit_type_size(v, param, &cache_size, &err)) {
@@ -1934,6 +1966,20 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-max-ns=%" PRId64 "\n", value->poll_max_ns);
         monitor_printf(mon, "  poll-grow=%" PRId64 "\n", value->poll_grow);
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
+        monitor_printf(mon, "  thread-pool-min=%" PRId64 "\n",
+                       value->thread_pool_min);
+        monitor_printf(mon, "  thread-pool-max=%" PRId64 "\n",
+                       value->thread_pool_max);
+        monitor_printf(mon, "  thread-pool-threads=%" PRId64 "\n",
+                       value->thread_pool_threads);
+        monitor_printf(mon, "  thread-pool-idle-threads=%" PRId64 "\n",
+                       value->thread_pool_idle_threads);
+        monitor_printf(mon, "  thread-pool-queue-depth=%" PRId64 "\n",
+                       value->thread_pool_queue_depth);
+        monitor_printf(mon, "  thread-pool-completed=%" PRId64 "\n",
+                       value->thread_pool_completed);
+        monitor_printf(mon, "  thread-pool-busy-ns=%" PRId64 "\n",
+                       value->thread_pool_busy_ns);
     }
 
     qapi_free_IOThreadInfoList(info_list);
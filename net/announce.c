@@ -150,9 +150,13 @@ static void qemu_announce_self_iter(NICState *nic, void *opaque)
                                   qemu_ether_ntoa(&nic->conf->macaddr), skip);
 
     if (!skip) {
+        NetClientState *nc = qemu_get_queue(nic);
+
         len = announce_self_create(buf, nic->conf->macaddr.a);
 
-        qemu_send_packet_raw(qemu_get_queue(nic), buf, len);
+        qemu_net_client_acquire(nc);
+        qemu_send_packet_raw(nc, buf, len);
+        qemu_net_client_release(nc);
 
         /* if the NIC provides it's own announcement support, use it as well */
         if (nic->ncs->info->announce) {
@@ -156,10 +156,20 @@ void connection_destroy(void *opaque)
 }
 
 Packet *packet_new(const void *data, int size, int vnet_hdr_len)
+{
+    return packet_new_nocopy(g_memdup(data, size), size, vnet_hdr_len);
+}
+
+/*
+ * Like packet_new(), but the packet uses @data in place.  packet_destroy()
+ * frees @data along with the packet, packet_destroy_partial() leaves it to
+ * the caller.
+ */
+Packet *packet_new_nocopy(void *data, int size, int vnet_hdr_len)
 {
     Packet *pkt = g_slice_new(Packet);
 
-    pkt->data = g_memdup(data, size);
+    pkt->data = data;
     pkt->size = size;
     pkt->creation_ms = qemu_clock_get_ms(QEMU_CLOCK_HOST);
     pkt->vnet_hdr_len = vnet_hdr_len;
@@ -61,6 +61,7 @@ static ssize_t filter_buffer_receive_iov(NetFilterState *nf,
                                          unsigned flags,
                                          const struct iovec *iov,
                                          int iovcnt,
+                                         NetPacketBuf *buf,
                                          NetPacketSent *sent_cb)
 {
     FilterBufferState *s = FILTER_BUFFER(nf);
@@ -79,8 +80,12 @@ static ssize_t filter_buffer_receive_iov(NetFilterState *nf,
      * the packets without caring about the receiver. This is suboptimal.
      * May need more thoughts (e.g keeping sent_cb).
      */
-    qemu_net_queue_append_iov(s->incoming_queue, sender, flags,
-                              iov, iovcnt, NULL);
+    if (buf) {
+        qemu_net_queue_append_buf(s->incoming_queue, sender, flags, buf, NULL);
+    } else {
+        qemu_net_queue_append_iov(s->incoming_queue, sender, flags,
+                                  iov, iovcnt, NULL);
+    }
     return iov_size(iov, iovcnt);
 }
 
@@ -50,7 +50,6 @@ static int filter_send(MirrorState *s,
     int ret = 0;
     ssize_t size = 0;
     uint32_t len = 0;
-    char *buf;
 
     size = iov_size(iov, iovcnt);
     if (!size) {
@@ -80,10 +79,18 @@ static int filter_send(MirrorState *s,
         }
     }
 
-    buf = g_malloc(size);
-    iov_to_buf(iov, iovcnt, 0, buf, size);
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)buf, size);
-    g_free(buf);
+    /*
+     * Packets in a NetPacketBuf come in a single element, write those
+     * directly; gather the others so that they still take one write.
+     */
+    if (iovcnt == 1) {
+        ret = qemu_chr_fe_write_all(&s->chr_out, iov->iov_base, size);
+    } else {
+        g_autofree uint8_t *buf = g_malloc(size);
+
+        iov_to_buf(iov, iovcnt, 0, buf, size);
+        ret = qemu_chr_fe_write_all(&s->chr_out, buf, size);
+    }
     if (ret != size) {
         goto err;
     }
@@ -105,12 +112,12 @@ static void redirector_to_filter(NetFilterState *nf,
 
     if (nf->direction == NET_FILTER_DIRECTION_ALL ||
         nf->direction == NET_FILTER_DIRECTION_TX) {
-        qemu_netfilter_pass_to_next(nf->netdev, 0, &iov, 1, nf);
+        qemu_netfilter_pass_to_next(nf->netdev, 0, &iov, 1, NULL, nf);
     }
 
     if (nf->direction == NET_FILTER_DIRECTION_ALL ||
         nf->direction == NET_FILTER_DIRECTION_RX) {
-        qemu_netfilter_pass_to_next(nf->netdev->peer, 0, &iov, 1, nf);
+        qemu_netfilter_pass_to_next(nf->netdev->peer, 0, &iov, 1, NULL, nf);
      }
 }
 
@@ -153,6 +160,7 @@ static ssize_t filter_mirror_receive_iov(NetFilterState *nf,
                                          unsigned flags,
                                          const struct iovec *iov,
                                          int iovcnt,
+                                         NetPacketBuf *buf,
                                          NetPacketSent *sent_cb)
 {
     MirrorState *s = FILTER_MIRROR(nf);
@@ -175,6 +183,7 @@ static ssize_t filter_redirector_receive_iov(NetFilterState *nf,
                                              unsigned flags,
                                              const struct iovec *iov,
                                              int iovcnt,
+                                             NetPacketBuf *buf,
                                              NetPacketSent *sent_cb)
 {
     MirrorState *s = FILTER_REDIRECTOR(nf);
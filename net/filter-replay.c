@@ -34,7 +34,8 @@ static ssize_t filter_replay_receive_iov(NetFilterState *nf,
                                          NetClientState *sndr,
                                          unsigned flags,
                                          const struct iovec *iov,
-                                         int iovcnt, NetPacketSent *sent_cb)
+                                         int iovcnt, NetPacketBuf *buf,
+                                         NetPacketSent *sent_cb)
 {
     NetFilterReplayState *nfrs = FILTER_REPLAY(nf);
     switch (replay_mode) {
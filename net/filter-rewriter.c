@@ -254,24 +254,30 @@ static ssize_t colo_rewriter_receive_iov(NetFilterState *nf,
                                          unsigned flags,
                                          const struct iovec *iov,
                                          int iovcnt,
+                                         NetPacketBuf *buf,
                                          NetPacketSent *sent_cb)
 {
     RewriterState *s = FILTER_REWRITER(nf);
     Connection *conn;
     ConnectionKey key;
     Packet *pkt;
-    ssize_t size = iov_size(iov, iovcnt);
     ssize_t vnet_hdr_len = 0;
-    char *buf = g_malloc0(size);
-
-    iov_to_buf(iov, iovcnt, 0, buf, size);
+    ssize_t ret = 0;
 
     if (s->vnet_hdr) {
         vnet_hdr_len = nf->netdev->vnet_hdr_len;
     }
 
-    pkt = packet_new(buf, size, vnet_hdr_len);
-    g_free(buf);
+    /*
+     * TCP packets are rewritten in place, which is only allowed on a
+     * buffer nobody else holds; work on a copy otherwise.
+     */
+    if (buf && net_packet_buf_writable(buf)) {
+        buf = net_packet_buf_ref(buf);
+    } else {
+        buf = net_packet_buf_new(iov, iovcnt);
+    }
+    pkt = packet_new_nocopy(buf->data, buf->size, vnet_hdr_len);
 
     /*
      * if we get tcp packet
@@ -303,36 +309,32 @@ static ssize_t colo_rewriter_receive_iov(NetFilterState *nf,
         if (sender == nf->netdev) {
             /* NET_FILTER_DIRECTION_TX */
             if (!handle_primary_tcp_pkt(s, conn, pkt, &key)) {
-                qemu_net_queue_send(s->incoming_queue, sender, 0,
-                (const uint8_t *)pkt->data, pkt->size, NULL);
-                packet_destroy(pkt, NULL);
-                pkt = NULL;
+                qemu_net_queue_send_buf(s->incoming_queue, sender, 0, buf,
+                                        NULL);
                 /*
                  * We block the packet here,after rewrite pkt
                  * and will send it
                  */
-                return 1;
+                ret = 1;
             }
         } else {
             /* NET_FILTER_DIRECTION_RX */
             if (!handle_secondary_tcp_pkt(s, conn, pkt, &key)) {
-                qemu_net_queue_send(s->incoming_queue, sender, 0,
-                (const uint8_t *)pkt->data, pkt->size, NULL);
-                packet_destroy(pkt, NULL);
-                pkt = NULL;
+                qemu_net_queue_send_buf(s->incoming_queue, sender, 0, buf,
+                                        NULL);
                 /*
                  * We block the packet here,after rewrite pkt
                  * and will send it
                  */
-                return 1;
+                ret = 1;
             }
         }
     }
 
 out:
-    packet_destroy(pkt, NULL);
-    pkt = NULL;
-    return 0;
+    packet_destroy_partial(pkt, NULL);
+    net_packet_buf_unref(buf);
+    return ret;
 }
 
 static void reset_seq_offset(gpointer key, gpointer value, gpointer user_data)
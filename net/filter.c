@@ -31,6 +31,7 @@ ssize_t qemu_netfilter_receive(NetFilterState *nf,
                                unsigned flags,
                                const struct iovec *iov,
                                int iovcnt,
+                               NetPacketBuf *buf,
                                NetPacketSent *sent_cb)
 {
     if (qemu_can_skip_netfilter(nf)) {
@@ -39,7 +40,8 @@ ssize_t qemu_netfilter_receive(NetFilterState *nf,
     if (nf->direction == direction ||
         nf->direction == NET_FILTER_DIRECTION_ALL) {
         return NETFILTER_GET_CLASS(OBJECT(nf))->receive_iov(
-                                   nf, sender, flags, iov, iovcnt, sent_cb);
+                                   nf, sender, flags, iov, iovcnt, buf,
+                                   sent_cb);
     }
 
     return 0;
@@ -65,6 +67,7 @@ ssize_t qemu_netfilter_pass_to_next(NetClientState *sender,
                                     unsigned flags,
                                     const struct iovec *iov,
                                     int iovcnt,
+                                    NetPacketBuf *buf,
                                     void *opaque)
 {
     int ret = 0;
@@ -97,7 +100,7 @@ ssize_t qemu_netfilter_pass_to_next(NetClientState *sender,
          * pass NULL to next.
          */
         ret = qemu_netfilter_receive(next, direction, sender, flags, iov,
-                                     iovcnt, NULL);
+                                     iovcnt, buf, NULL);
         if (ret) {
             return ret;
         }
@@ -110,8 +113,13 @@ ssize_t qemu_netfilter_pass_to_next(NetClientState *sender,
      * deleted while we go through filters.
      */
     if (sender && sender->peer) {
-        qemu_net_queue_send_iov(sender->peer->incoming_queue,
-                                sender, flags, iov, iovcnt, NULL);
+        if (buf) {
+            qemu_net_queue_send_buf(sender->peer->incoming_queue,
+                                    sender, flags, buf, NULL);
+        } else {
+            qemu_net_queue_send_iov(sender->peer->incoming_queue,
+                                    sender, flags, iov, iovcnt, NULL);
+        }
     }
 
 out:
@@ -245,6 +253,12 @@ static void netfilter_complete(UserCreatable *uc, Error **errp)
         return;
     }
 
+    if (ncs[0]->aio_context ||
+        (ncs[0]->peer && ncs[0]->peer->aio_context)) {
+        error_setg(errp, "netdev is serviced by an iothread");
+        return;
+    }
+
     if (strcmp(nf->position, "head") && strcmp(nf->position, "tail")) {
         Object *container;
         Object *obj;
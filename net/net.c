@@ -230,6 +230,7 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
                                        unsigned flags,
                                        const struct iovec *iov,
                                        int iovcnt,
+                                       NetPacketBuf *buf,
                                        void *opaque);
 
 static void qemu_net_client_setup(NetClientState *nc,
@@ -338,7 +339,9 @@ static void qemu_cleanup_net_client(NetClientState *nc)
     QTAILQ_REMOVE(&net_clients, nc, next);
 
     if (nc->info->cleanup) {
+        qemu_net_client_acquire(nc);
         nc->info->cleanup(nc);
+        qemu_net_client_release(nc);
     }
 }
 
@@ -563,7 +566,7 @@ static ssize_t filter_receive_iov(NetClientState *nc,
     if (direction == NET_FILTER_DIRECTION_TX) {
         QTAILQ_FOREACH(nf, &nc->filters, next) {
             ret = qemu_netfilter_receive(nf, direction, sender, flags, iov,
-                                         iovcnt, sent_cb);
+                                         iovcnt, NULL, sent_cb);
             if (ret) {
                 return ret;
             }
@@ -571,7 +574,7 @@ static ssize_t filter_receive_iov(NetClientState *nc,
     } else {
         QTAILQ_FOREACH_REVERSE(nf, &nc->filters, next) {
             ret = qemu_netfilter_receive(nf, direction, sender, flags, iov,
-                                         iovcnt, sent_cb);
+                                         iovcnt, NULL, sent_cb);
             if (ret) {
                 return ret;
             }
@@ -631,6 +634,35 @@ void qemu_flush_queued_packets(NetClientState *nc)
     qemu_flush_or_purge_queued_packets(nc, false);
 }
 
+/*
+ * Run the handlers of @nc in the thread of @ctx, or in the main loop if
+ * @ctx is NULL.  The handlers of a client attached to an AioContext hold
+ * its lock while they send or receive packets, and other threads must
+ * take it with qemu_net_client_acquire() before they touch the client.
+ */
+void qemu_net_client_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    if (nc->info->set_aio_context) {
+        nc->info->set_aio_context(nc, ctx);
+    } else {
+        nc->aio_context = ctx;
+    }
+}
+
+void qemu_net_client_acquire(NetClientState *nc)
+{
+    if (nc->aio_context) {
+        aio_context_acquire(nc->aio_context);
+    }
+}
+
+void qemu_net_client_release(NetClientState *nc)
+{
+    if (nc->aio_context) {
+        aio_context_release(nc->aio_context);
+    }
+}
+
 static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
                                                  unsigned flags,
                                                  const uint8_t *buf, int size,
@@ -674,6 +706,43 @@ ssize_t qemu_send_packet_async(NetClientState *sender,
                                              buf, size, sent_cb);
 }
 
+/*
+ * Send @count packets, each in a single buffer of @pkts, from @sender.
+ * When its peer takes batches of packets, and no filter or queued
+ * packet is in the way, they are handed over in one go; the rest are
+ * sent one by one.  Returns 0 if some packets were queued, in which
+ * case @sent_cb will be called like for qemu_send_packet_async(), and
+ * @count otherwise.
+ */
+int qemu_send_packet_batch_async(NetClientState *sender,
+                                 const struct iovec *pkts, int count,
+                                 NetPacketSent *sent_cb)
+{
+    NetClientState *peer = sender->peer;
+    int ret = count;
+    int i = 0;
+
+    if (sender->link_down || !peer) {
+        return count;
+    }
+
+    if (peer->info->receive_batch && !peer->link_down &&
+        QTAILQ_EMPTY(&sender->filters) && QTAILQ_EMPTY(&peer->filters) &&
+        qemu_net_queue_idle(peer->incoming_queue) &&
+        qemu_can_send_packet(sender)) {
+        i = peer->info->receive_batch(peer, pkts, count);
+    }
+
+    /* Whatever the peer did not take goes the usual way.  */
+    for (; i < count; i++) {
+        if (qemu_send_packet_async(sender, pkts[i].iov_base,
+                                   pkts[i].iov_len, sent_cb) == 0) {
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
 ssize_t qemu_send_packet(NetClientState *nc, const uint8_t *buf, int size)
 {
     return qemu_send_packet_async(nc, buf, size, NULL);
@@ -720,6 +789,7 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
                                        unsigned flags,
                                        const struct iovec *iov,
                                        int iovcnt,
+                                       NetPacketBuf *buf,
                                        void *opaque)
 {
     NetClientState *nc = opaque;
@@ -964,6 +1034,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1052,6 +1125,9 @@ void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
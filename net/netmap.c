@@ -104,13 +104,23 @@ static struct nm_desc *netmap_open(const NetdevNetmapOptions *nm_opts,
 static void netmap_send(void *opaque);
 static void netmap_writable(void *opaque);
 
+static void netmap_set_fd_handler(NetmapState *s, IOHandler *fd_read,
+                                  IOHandler *fd_write)
+{
+    if (s->nc.aio_context) {
+        aio_set_fd_handler(s->nc.aio_context, s->nmd->fd, true,
+                           fd_read, fd_write, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->nmd->fd, fd_read, fd_write, s);
+    }
+}
+
 /* Set the event-loop handlers for the netmap backend. */
 static void netmap_update_fd_handler(NetmapState *s)
 {
-    qemu_set_fd_handler(s->nmd->fd,
-                        s->read_poll ? netmap_send : NULL,
-                        s->write_poll ? netmap_writable : NULL,
-                        s);
+    netmap_set_fd_handler(s,
+                          s->read_poll ? netmap_send : NULL,
+                          s->write_poll ? netmap_writable : NULL);
 }
 
 /* Update the read handler. */
@@ -151,8 +161,10 @@ static void netmap_writable(void *opaque)
 {
     NetmapState *s = opaque;
 
+    qemu_net_client_acquire(&s->nc);
     netmap_write_poll(s, false);
     qemu_flush_queued_packets(&s->nc);
+    qemu_net_client_release(&s->nc);
 }
 
 static ssize_t netmap_receive_iov(NetClientState *nc,
@@ -252,6 +264,8 @@ static void netmap_send(void *opaque)
     struct netmap_ring *ring = s->rx;
     unsigned int tail = ring->tail;
 
+    qemu_net_client_acquire(&s->nc);
+
     /* Keep sending while there are available slots in the netmap
        RX ring and the forwarding path towards the peer is open. */
     while (ring->head != tail) {
@@ -294,6 +308,8 @@ static void netmap_send(void *opaque)
             break;
         }
     }
+
+    qemu_net_client_release(&s->nc);
 }
 
 /* Flush and close. */
@@ -383,6 +399,20 @@ static void netmap_set_offload(NetClientState *nc, int csum, int tso4, int tso6,
     }
 }
 
+/* Move the fd handlers to @ctx, or back to the main loop. */
+static void netmap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetmapState *s = DO_UPCAST(NetmapState, nc, nc);
+
+    if (s->nmd) {
+        netmap_set_fd_handler(s, NULL, NULL);
+    }
+    nc->aio_context = ctx;
+    if (s->nmd) {
+        netmap_update_fd_handler(s);
+    }
+}
+
 /* NetClientInfo methods */
 static NetClientInfo net_netmap_info = {
     .type = NET_CLIENT_DRIVER_NETMAP,
@@ -397,6 +427,7 @@ static NetClientInfo net_netmap_info = {
     .using_vnet_hdr = netmap_using_vnet_hdr,
     .set_offload = netmap_set_offload,
     .set_vnet_hdr_len = netmap_set_vnet_hdr_len,
+    .set_aio_context = netmap_set_aio_context,
 };
 
 /* The exported init function
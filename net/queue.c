@@ -23,6 +23,7 @@
 
 #include "qemu/osdep.h"
 #include "net/queue.h"
+#include "qemu/iov.h"
 #include "qemu/queue.h"
 #include "net/net.h"
 
@@ -44,9 +45,8 @@ struct NetPacket {
     QTAILQ_ENTRY(NetPacket) entry;
     NetClientState *sender;
     unsigned flags;
-    int size;
     NetPacketSent *sent_cb;
-    uint8_t data[];
+    NetPacketBuf *buf;
 };
 
 struct NetQueue {
@@ -60,6 +60,35 @@ struct NetQueue {
     unsigned delivering : 1;
 };
 
+NetPacketBuf *net_packet_buf_new(const struct iovec *iov, int iovcnt)
+{
+    size_t size = iov_size(iov, iovcnt);
+    NetPacketBuf *buf = g_malloc(sizeof(NetPacketBuf) + size);
+
+    buf->refcnt = 1;
+    buf->size = iov_to_buf(iov, iovcnt, 0, buf->data, size);
+    return buf;
+}
+
+NetPacketBuf *net_packet_buf_ref(NetPacketBuf *buf)
+{
+    qatomic_inc(&buf->refcnt);
+    return buf;
+}
+
+void net_packet_buf_unref(NetPacketBuf *buf)
+{
+    if (qatomic_fetch_dec(&buf->refcnt) == 1) {
+        g_free(buf);
+    }
+}
+
+static void qemu_net_packet_free(NetPacket *packet)
+{
+    net_packet_buf_unref(packet->buf);
+    g_free(packet);
+}
+
 NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque)
 {
     NetQueue *queue;
@@ -84,35 +113,46 @@ void qemu_del_net_queue(NetQueue *queue)
 
     QTAILQ_FOREACH_SAFE(packet, &queue->packets, entry, next) {
         QTAILQ_REMOVE(&queue->packets, packet, entry);
-        g_free(packet);
+        qemu_net_packet_free(packet);
     }
 
     g_free(queue);
 }
 
-static void qemu_net_queue_append(NetQueue *queue,
+/* Queue a packet, taking over the reference to @buf */
+static void qemu_net_queue_insert(NetQueue *queue,
                                   NetClientState *sender,
                                   unsigned flags,
-                                  const uint8_t *buf,
-                                  size_t size,
+                                  NetPacketBuf *buf,
                                   NetPacketSent *sent_cb)
 {
     NetPacket *packet;
 
-    if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
-        return; /* drop if queue full and no callback */
-    }
-    packet = g_malloc(sizeof(NetPacket) + size);
+    packet = g_new(NetPacket, 1);
     packet->sender = sender;
     packet->flags = flags;
-    packet->size = size;
     packet->sent_cb = sent_cb;
-    memcpy(packet->data, buf, size);
+    packet->buf = buf;
 
     queue->nq_count++;
     QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
 }
 
+static void qemu_net_queue_append(NetQueue *queue,
+                                  NetClientState *sender,
+                                  unsigned flags,
+                                  const uint8_t *buf,
+                                  size_t size,
+                                  NetPacketSent *sent_cb)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size
+    };
+
+    qemu_net_queue_append_iov(queue, sender, flags, &iov, 1, sent_cb);
+}
+
 void qemu_net_queue_append_iov(NetQueue *queue,
                                NetClientState *sender,
                                unsigned flags,
@@ -120,39 +160,32 @@ void qemu_net_queue_append_iov(NetQueue *queue,
                                int iovcnt,
                                NetPacketSent *sent_cb)
 {
-    NetPacket *packet;
-    size_t max_len = 0;
-    int i;
-
     if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
         return; /* drop if queue full and no callback */
     }
-    for (i = 0; i < iovcnt; i++) {
-        max_len += iov[i].iov_len;
-    }
-
-    packet = g_malloc(sizeof(NetPacket) + max_len);
-    packet->sender = sender;
-    packet->sent_cb = sent_cb;
-    packet->flags = flags;
-    packet->size = 0;
-
-    for (i = 0; i < iovcnt; i++) {
-        size_t len = iov[i].iov_len;
+    qemu_net_queue_insert(queue, sender, flags,
+                          net_packet_buf_new(iov, iovcnt), sent_cb);
+}
 
-        memcpy(packet->data + packet->size, iov[i].iov_base, len);
-        packet->size += len;
+void qemu_net_queue_append_buf(NetQueue *queue,
+                               NetClientState *sender,
+                               unsigned flags,
+                               NetPacketBuf *buf,
+                               NetPacketSent *sent_cb)
+{
+    if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
+        return; /* drop if queue full and no callback */
     }
-
-    queue->nq_count++;
-    QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
+    qemu_net_queue_insert(queue, sender, flags, net_packet_buf_ref(buf),
+                          sent_cb);
 }
 
 static ssize_t qemu_net_queue_deliver(NetQueue *queue,
                                       NetClientState *sender,
                                       unsigned flags,
                                       const uint8_t *data,
-                                      size_t size)
+                                      size_t size,
+                                      NetPacketBuf *buf)
 {
     ssize_t ret = -1;
     struct iovec iov = {
@@ -161,7 +194,7 @@ static ssize_t qemu_net_queue_deliver(NetQueue *queue,
     };
 
     queue->delivering = 1;
-    ret = queue->deliver(sender, flags, &iov, 1, queue->opaque);
+    ret = queue->deliver(sender, flags, &iov, 1, buf, queue->opaque);
     queue->delivering = 0;
 
     return ret;
@@ -176,7 +209,7 @@ static ssize_t qemu_net_queue_deliver_iov(NetQueue *queue,
     ssize_t ret = -1;
 
     queue->delivering = 1;
-    ret = queue->deliver(sender, flags, iov, iovcnt, queue->opaque);
+    ret = queue->deliver(sender, flags, iov, iovcnt, NULL, queue->opaque);
     queue->delivering = 0;
 
     return ret;
@@ -196,7 +229,7 @@ ssize_t qemu_net_queue_send(NetQueue *queue,
         return 0;
     }
 
-    ret = qemu_net_queue_deliver(queue, sender, flags, data, size);
+    ret = qemu_net_queue_deliver(queue, sender, flags, data, size, NULL);
     if (ret == 0) {
         qemu_net_queue_append(queue, sender, flags, data, size, sent_cb);
         return 0;
@@ -232,6 +265,44 @@ ssize_t qemu_net_queue_send_iov(NetQueue *queue,
     return ret;
 }
 
+/*
+ * Like qemu_net_queue_send(), but a packet that has to wait in the queue
+ * keeps a reference to @buf instead of a copy of its data.
+ */
+ssize_t qemu_net_queue_send_buf(NetQueue *queue,
+                                NetClientState *sender,
+                                unsigned flags,
+                                NetPacketBuf *buf,
+                                NetPacketSent *sent_cb)
+{
+    ssize_t ret;
+
+    if (queue->delivering || !qemu_can_send_packet(sender)) {
+        qemu_net_queue_append_buf(queue, sender, flags, buf, sent_cb);
+        return 0;
+    }
+
+    ret = qemu_net_queue_deliver(queue, sender, flags, buf->data, buf->size,
+                                 buf);
+    if (ret == 0) {
+        qemu_net_queue_append_buf(queue, sender, flags, buf, sent_cb);
+        return 0;
+    }
+
+    qemu_net_queue_flush(queue);
+
+    return ret;
+}
+
+/*
+ * Whether a packet can be handed to the receiver without overtaking
+ * one that is queued or being delivered.
+ */
+bool qemu_net_queue_idle(NetQueue *queue)
+{
+    return !queue->delivering && QTAILQ_EMPTY(&queue->packets);
+}
+
 void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
 {
     NetPacket *packet, *next;
@@ -243,7 +314,7 @@ void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
             if (packet->sent_cb) {
                 packet->sent_cb(packet->sender, 0);
             }
-            g_free(packet);
+            qemu_net_packet_free(packet);
         }
     }
 }
@@ -264,8 +335,9 @@ bool qemu_net_queue_flush(NetQueue *queue)
         ret = qemu_net_queue_deliver(queue,
                                      packet->sender,
                                      packet->flags,
-                                     packet->data,
-                                     packet->size);
+                                     packet->buf->data,
+                                     packet->buf->size,
+                                     packet->buf);
         if (ret == 0) {
             queue->nq_count++;
             QTAILQ_INSERT_HEAD(&queue->packets, packet, entry);
@@ -276,7 +348,7 @@ bool qemu_net_queue_flush(NetQueue *queue)
             packet->sent_cb(packet->sender, ret);
         }
 
-        g_free(packet);
+        qemu_net_packet_free(packet);
     }
     return true;
 }
@@ -49,12 +49,22 @@ typedef struct NetSocketState {
 static void net_socket_accept(void *opaque);
 static void net_socket_writable(void *opaque);
 
+static void net_socket_set_fd_handler(NetSocketState *s, IOHandler *fd_read,
+                                      IOHandler *fd_write)
+{
+    if (s->nc.aio_context) {
+        aio_set_fd_handler(s->nc.aio_context, s->fd, true,
+                           fd_read, fd_write, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
+}
+
 static void net_socket_update_fd_handler(NetSocketState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll ? s->send_fn : NULL,
-                        s->write_poll ? net_socket_writable : NULL,
-                        s);
+    net_socket_set_fd_handler(s,
+                              s->read_poll ? s->send_fn : NULL,
+                              s->write_poll ? net_socket_writable : NULL);
 }
 
 static void net_socket_read_poll(NetSocketState *s, bool enable)
@@ -73,9 +83,11 @@ static void net_socket_writable(void *opaque)
 {
     NetSocketState *s = opaque;
 
+    qemu_net_client_acquire(&s->nc);
     net_socket_write_poll(s, false);
 
     qemu_flush_queued_packets(&s->nc);
+    qemu_net_client_release(&s->nc);
 }
 
 static ssize_t net_socket_receive(NetClientState *nc, const uint8_t *buf, size_t size)
@@ -163,6 +175,7 @@ static void net_socket_send(void *opaque)
     uint8_t buf1[NET_BUFSIZE];
     const uint8_t *buf;
 
+    qemu_net_client_acquire(&s->nc);
     size = qemu_recv(s->fd, buf1, sizeof(buf1), 0);
     if (size < 0) {
         if (errno != EWOULDBLOCK)
@@ -182,7 +195,7 @@ static void net_socket_send(void *opaque)
         s->nc.link_down = true;
         memset(s->nc.info_str, 0, sizeof(s->nc.info_str));
 
-        return;
+        goto out;
     }
     buf = buf1;
 
@@ -191,6 +204,9 @@ static void net_socket_send(void *opaque)
     if (ret == -1) {
         goto eoc;
     }
+
+out:
+    qemu_net_client_release(&s->nc);
 }
 
 static void net_socket_send_dgram(void *opaque)
@@ -198,19 +214,24 @@ static void net_socket_send_dgram(void *opaque)
     NetSocketState *s = opaque;
     int size;
 
+    qemu_net_client_acquire(&s->nc);
     size = qemu_recv(s->fd, s->rs.buf, sizeof(s->rs.buf), 0);
-    if (size < 0)
-        return;
+    if (size < 0) {
+        goto out;
+    }
     if (size == 0) {
         /* end of connection */
         net_socket_read_poll(s, false);
         net_socket_write_poll(s, false);
-        return;
+        goto out;
     }
     if (qemu_send_packet_async(&s->nc, s->rs.buf, size,
                                net_socket_send_completed) == 0) {
         net_socket_read_poll(s, false);
     }
+
+out:
+    qemu_net_client_release(&s->nc);
 }
 
 static int net_socket_mcast_create(struct sockaddr_in *mcastaddr,
@@ -322,11 +343,28 @@ static void net_socket_cleanup(NetClientState *nc)
     }
 }
 
+/* Move the fd handlers to @ctx, or back to the main loop */
+static void net_socket_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+    /* a stream socket that is not connected yet waits in the main loop */
+    bool connected = s->fd >= 0 && s->send_fn;
+
+    if (connected) {
+        net_socket_set_fd_handler(s, NULL, NULL);
+    }
+    nc->aio_context = ctx;
+    if (connected) {
+        net_socket_update_fd_handler(s);
+    }
+}
+
 static NetClientInfo net_dgram_socket_info = {
     .type = NET_CLIENT_DRIVER_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
@@ -410,8 +448,13 @@ err:
 static void net_socket_connect(void *opaque)
 {
     NetSocketState *s = opaque;
+
+    /* drop the handler that waited for the connection in the main loop */
+    qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    qemu_net_client_acquire(&s->nc);
     s->send_fn = net_socket_send;
     net_socket_read_poll(s, true);
+    qemu_net_client_release(&s->nc);
 }
 
 static NetClientInfo net_socket_info = {
@@ -419,6 +462,7 @@ static NetClientInfo net_socket_info = {
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_stream(NetClientState *peer,
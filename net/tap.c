@@ -47,12 +47,16 @@
 
 #include "net/vhost_net.h"
 
+/* Packets read from the tap device in one go for peers that take batches */
+#define TAP_RECV_BATCH 16
+
 typedef struct TAPState {
     NetClientState nc;
     int fd;
     char down_script[1024];
     char down_script_arg[128];
     uint8_t buf[NET_BUFSIZE];
+    uint8_t *batch_buf;
     bool read_poll;
     bool write_poll;
     bool using_vnet_hdr;
@@ -69,12 +73,22 @@ static void launch_script(const char *setup_script, const char *ifname,
 static void tap_send(void *opaque);
 static void tap_writable(void *opaque);
 
+static void tap_set_fd_handler(TAPState *s, IOHandler *fd_read,
+                               IOHandler *fd_write)
+{
+    if (s->nc.aio_context) {
+        aio_set_fd_handler(s->nc.aio_context, s->fd, true,
+                           fd_read, fd_write, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
+}
+
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    tap_set_fd_handler(s,
+                       s->read_poll && s->enabled ? tap_send : NULL,
+                       s->write_poll && s->enabled ? tap_writable : NULL);
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -93,9 +107,11 @@ static void tap_writable(void *opaque)
 {
     TAPState *s = opaque;
 
+    qemu_net_client_acquire(&s->nc);
     tap_write_poll(s, false);
 
     qemu_flush_queued_packets(&s->nc);
+    qemu_net_client_release(&s->nc);
 }
 
 static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt)
@@ -181,12 +197,67 @@ static void tap_send_completed(NetClientState *nc, ssize_t len)
     tap_read_poll(s, true);
 }
 
+/*
+ * Read packets into a ring of TAP_RECV_BATCH buffers, and hand them
+ * to the peer a ringful at a time.
+ */
+static void tap_send_batch(TAPState *s)
+{
+    struct iovec pkts[TAP_RECV_BATCH];
+    int packets = 0;
+
+    if (!s->batch_buf) {
+        s->batch_buf = g_malloc(TAP_RECV_BATCH * NET_BUFSIZE);
+    }
+
+    while (true) {
+        int n;
+
+        for (n = 0; n < TAP_RECV_BATCH; n++) {
+            uint8_t *buf = s->batch_buf + n * NET_BUFSIZE;
+            int size = tap_read_packet(s->fd, buf, NET_BUFSIZE);
+
+            if (size <= 0) {
+                break;
+            }
+
+            if (s->host_vnet_hdr_len && !s->using_vnet_hdr) {
+                buf  += s->host_vnet_hdr_len;
+                size -= s->host_vnet_hdr_len;
+            }
+            pkts[n].iov_base = buf;
+            pkts[n].iov_len = size;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        if (qemu_send_packet_batch_async(&s->nc, pkts, n,
+                                         tap_send_completed) == 0) {
+            tap_read_poll(s, false);
+            break;
+        }
+
+        /* The device is drained, or we have had our share; see tap_send. */
+        packets += n;
+        if (n < TAP_RECV_BATCH || packets >= 50) {
+            break;
+        }
+    }
+}
+
 static void tap_send(void *opaque)
 {
     TAPState *s = opaque;
     int size;
     int packets = 0;
 
+    qemu_net_client_acquire(&s->nc);
+    if (s->nc.peer && s->nc.peer->info->receive_batch) {
+        tap_send_batch(s);
+        goto out;
+    }
+
     while (true) {
         uint8_t *buf = s->buf;
 
@@ -219,6 +290,9 @@ static void tap_send(void *opaque)
             break;
         }
     }
+
+out:
+    qemu_net_client_release(&s->nc);
 }
 
 static bool tap_has_ufo(NetClientState *nc)
@@ -328,6 +402,8 @@ static void tap_cleanup(NetClientState *nc)
     tap_write_poll(s, false);
     close(s->fd);
     s->fd = -1;
+    g_free(s->batch_buf);
+    s->batch_buf = NULL;
 }
 
 static void tap_poll(NetClientState *nc, bool enable)
@@ -346,6 +422,20 @@ int tap_get_fd(NetClientState *nc)
 
 /* fd support */
 
+/* Move the fd handlers to @ctx, or back to the main loop */
+static void tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+
+    if (s->fd >= 0) {
+        tap_set_fd_handler(s, NULL, NULL);
+    }
+    nc->aio_context = ctx;
+    if (s->fd >= 0) {
+        tap_update_fd_handler(s);
+    }
+}
+
 static NetClientInfo net_tap_info = {
     .type = NET_CLIENT_DRIVER_TAP,
     .size = sizeof(TAPState),
@@ -362,6 +452,7 @@ static NetClientInfo net_tap_info = {
     .set_vnet_hdr_len = tap_set_vnet_hdr_len,
     .set_vnet_le = tap_set_vnet_le,
     .set_vnet_be = tap_set_vnet_be,
+    .set_aio_context = tap_set_aio_context,
 };
 
 static TAPState *net_tap_fd_init(NetClientState *peer,
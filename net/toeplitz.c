@@ -0,0 +1,59 @@
+/*
+ * Toeplitz hash for receive side scaling
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "net/toeplitz.h"
+
+void net_toeplitz_init(NetToeplitz *t, const uint8_t *key, size_t key_len)
+{
+    uint8_t k[NET_TOEPLITZ_KEY_SIZE + 4] = { 0 };
+    int i, v;
+
+    memcpy(k, key, MIN(key_len, NET_TOEPLITZ_KEY_SIZE));
+
+    for (i = 0; i < NET_TOEPLITZ_MAX_INPUT; i++) {
+        uint64_t window = ldq_be_p(&k[i]);
+        uint32_t bits[8];
+        int j;
+
+        /*
+         * Bit j of the byte, from the most significant one, selects key
+         * bits 8 * i + j to 8 * i + j + 31.
+         */
+        for (j = 0; j < 8; j++) {
+            bits[j] = window >> (32 - j);
+        }
+
+        t->table[i][0] = 0;
+        for (v = 1; v < 256; v++) {
+            t->table[i][v] = t->table[i][v & (v - 1)] ^ bits[7 - ctz32(v)];
+        }
+    }
+}
+
+uint32_t net_toeplitz_hash(const NetToeplitz *t, const uint8_t *input,
+                           size_t len)
+{
+    uint32_t h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+    size_t i;
+
+    assert(len <= NET_TOEPLITZ_MAX_INPUT);
+
+    /* Four independent chains, so that the loads overlap */
+    for (i = 0; i + 4 <= len; i += 4) {
+        h0 ^= t->table[i][input[i]];
+        h1 ^= t->table[i + 1][input[i + 1]];
+        h2 ^= t->table[i + 2][input[i + 2]];
+        h3 ^= t->table[i + 3][input[i + 3]];
+    }
+    for (; i < len; i++) {
+        h0 ^= t->table[i][input[i]];
+    }
+    return h0 ^ h1 ^ h2 ^ h3;
+}
@@ -115,7 +115,14 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                dirty-ring-size=n (KVM dirty ring entries per vCPU, default=0)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-cache=file (load and save TCG translations across runs)\n"
+    "                hot-threshold=n (build TCG superblocks from hot code, default=0)\n"
+    "                smc-threshold=n (self-checking TCG code on pages written n times, default=0)\n"
+    "                spec-threads=n (threads translating ahead of the vCPUs, default=0)\n"
+    "                jmp-cache-bits=n (log2 of the TCG jump cache entries per vCPU, default=12)\n"
+    "                jmp-cache-resize=on|off (resize TCG jump caches with their miss rate, default=off)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -140,9 +147,70 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``dirty-ring-size=n``
+        When the KVM accelerator is used, it controls the size of the
+        per-vCPU dirty page ring buffer (number of entries for each
+        vCPU). It should be a power of two, with a suggested minimum of
+        1024. When it is set, dirty pages are collected from the rings
+        instead of the per-slot dirty bitmaps, so the cost of a dirty
+        log synchronization depends on the number of pages written
+        rather than on the size of the guest. Defaults to 0, which
+        keeps using the bitmaps.
+
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-cache=file``
+        Loads translated code from file at startup and saves it there
+        on exit, so that repeated runs skip translating the same guest
+        code again. Each block is checked against the guest code it was
+        translated from before being used. The file is only usable by
+        the same QEMU binary started with the same command line and the
+        same host address space layout, which in practice requires
+        address space randomization to be disabled (e.g. with
+        ``setarch -R``); otherwise it is ignored and overwritten.
+
+    ``hot-threshold=n``
+        When non-zero, each translation block counts its executions.
+        Once a block has run n times, it is translated again together
+        with the blocks it most often jumps to directly, as a single
+        superblock that the TCG optimizer can work on as a whole. Only
+        blocks that follow the first one on the same guest page are
+        joined. Profiling is disabled with icount, gdb breakpoints and
+        TCG plugins that instrument translations. Defaults to 0 (off).
+
+    ``smc-threshold=n``
+        When non-zero, counts for each guest page the writes that hit
+        translated code. Once a page has taken n such writes, as happens
+        with JIT compilers and other self-modifying guests, it is no
+        longer write-protected: its translation blocks instead check that
+        their guest code is unchanged each time they run, and are
+        translated again when it is not. A block that overwrites its own
+        instructions still runs them as they were translated. Defaults to
+        0 (off).
+
+    ``spec-threads=n``
+        Starts n threads, up to 16, that translate the fall-through and
+        direct branch targets of each new translation block before the
+        vCPUs first run them, which shortens the time spent translating
+        cold code, e.g. while the guest boots. Only targets on the same
+        guest page are translated ahead. Requires ``thread=multi``, and
+        a target whose translator depends only on the state that keys
+        the translation blocks, which is currently only 32-bit Arm
+        (``qemu-system-arm``); defaults to 0 (off).
+
+    ``jmp-cache-bits=n``
+        Sets the size of the cache each vCPU uses to find the translation
+        block of the next guest pc without a hash table lookup, to 2^n
+        entries. n ranges from 8 to 16 and defaults to 12. Guests whose
+        working set of code does not fit in the default cache show a low
+        jump cache hit rate in the ``info jit`` monitor command.
+
+    ``jmp-cache-resize=on|off``
+        Lets each vCPU double its jump cache, up to 2^16 entries, when more
+        than one lookup in eight misses it, and shrink it back, but never
+        below ``jmp-cache-bits``, once it is mostly unused. Defaults to off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefor taking advantage of
@@ -2459,6 +2527,15 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m]\n"
+    "                attach to the existing network interface 'name' with AF_XDP socket\n"
+    "                use 'mode=MODE' to specify an XDP program attach mode\n"
+    "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
+    "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
+    "                use 'start-queue=m' to specify the first queue that should be used\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2483,6 +2560,9 @@ DEF("nic", HAS_ARG, QEMU_OPTION_nic,
 #ifdef CONFIG_NETMAP
     "netmap|"
 #endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
+#endif
 #ifdef CONFIG_POSIX
     "vhost-user|"
 #endif
@@ -2507,12 +2587,15 @@ DEF("net", HAS_ARG, QEMU_OPTION_net,
 #endif
 #ifdef CONFIG_NETMAP
     "netmap|"
+#endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
 #endif
     "socket][,option][,option][,...]\n"
     "                old way to initialize a host network interface\n"
     "                (use the -netdev option if possible instead)\n", QEMU_ARCH_ALL)
 SRST
-``-nic [tap|bridge|user|l2tpv3|vde|netmap|vhost-user|socket][,...][,mac=macaddr][,model=mn]``
+``-nic [tap|bridge|user|l2tpv3|vde|netmap|af-xdp|vhost-user|socket][,...][,mac=macaddr][,model=mn]``
     This option is a shortcut for configuring both the on-board
     (default) guest NIC hardware and the host network backend in one go.
     The host backend options are the same as with the corresponding
@@ -2926,6 +3009,39 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m]``
+    Configure AF_XDP backend to connect to a network interface 'name'
+    using AF_XDP socket.  A specific program attach mode for a default
+    XDP program can be forced with 'mode', defaults to best-effort,
+    where the likely most performant mode will be in use.  Number of
+    queues 'n' should generally match the number of queues in the
+    interface, defaults to 1.  Traffic arriving on non-configured device
+    queues will not be delivered to the network backend.  Each queue is
+    served by its own AF_XDP socket, with a UMEM whose frames are shared
+    between the socket's receive and transmit rings.  Zero-copy is used
+    when the driver supports it, unless 'force-copy=on' is given.
+
+    .. parsed-literal::
+
+        # set number of queues to 4
+        ethtool -L eth0 combined 4
+        # launch QEMU instance
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1,mq=on \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=4
+
+    'start-queue' option can be specified if a particular range of queues
+    [m, m + n - 1] should be in use.  For example, this is necessary in order
+    to use MLX devices in zero-copy mode.  A pair of veth devices can be
+    used for testing without dedicated hardware:
+
+    .. parsed-literal::
+
+        ip link add veth0 type veth peer name veth1
+        ip link set veth0 up
+        ip link set veth1 up
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
+            -netdev af-xdp,id=n1,ifname=veth0,mode=skb
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -5090,7 +5206,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,thread-pool-min=min,thread-pool-max=max,thread-pool-idle-timeout=ms,thread-pool-cpus=cpus,io-uring-sqpoll=on|off,io-uring-sqpoll-cpu=cpu``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -5102,6 +5218,24 @@ SRST
         Multiple devices can be assigned to an IOThread. Note that not
         all devices support an ``iothread`` parameter.
 
+        virtio-blk devices can additionally spread their virtqueues
+        across several IOThreads with ``len-vq-iothreads=n`` and
+        ``vq-iothreads[i]=id``. Virtqueue i is then serviced by
+        ``vq-iothreads[i % n]``, which takes its requests from the ring
+        and returns them to the guest. Block I/O itself is still
+        submitted and completed in the ``iothread`` of the device, so the
+        block layer remains limited to that thread.
+
+        virtio-net devices run their queue pairs in IOThreads with
+        ``len-iothreads=n`` and ``iothreads[i]=id``. Queue pair i is
+        serviced by ``iothreads[i % n]``, together with the tap, netmap
+        or socket netdev queue it is connected to, so that packets are
+        transmitted and received without the main event loop. With RSS
+        enabled by the guest, each packet is hashed in the IOThread that
+        reads it and handed over to the IOThread of the queue pair it is
+        steered to. Netdevs with filters, and other netdev types, keep
+        running in the main event loop.
+
         The ``query-iothreads`` QMP command lists IOThreads and reports
         their thread IDs so that the user can configure host CPU
         pinning/affinity.
@@ -5133,6 +5267,29 @@ SRST
         ::
 
             (qemu) qom-set /objects/iothread1 poll-max-ns 100000
+
+        Blocking work that is offloaded from the IOThread, such as
+        ``aio=threads`` I/O or qcow2 compression and encryption, runs in
+        a pool of worker threads. ``thread-pool-min`` and
+        ``thread-pool-max`` bound the number of workers (default 0 and
+        64), and ``thread-pool-idle-timeout`` is the number of
+        milliseconds an idle worker above the minimum waits before it
+        exits (default 10000). ``thread-pool-cpus`` restricts the
+        workers to a list of host CPUs, for example the CPUs of the NUMA
+        node that holds the guest memory. These parameters can also be
+        changed at run-time with ``qom-set``. ``query-iothreads`` reports
+        the queue depth and the time workers spent processing requests.
+
+        The ``io-uring-sqpoll`` parameter creates the IOThread's io_uring
+        instances (for file descriptor monitoring and for ``aio=io_uring``
+        block I/O) in submission queue polling mode. A kernel thread then
+        picks up new requests without an ``io_uring_enter`` system call
+        per batch, at the cost of a host CPU that is busy while requests
+        are being submitted. The ``io-uring-sqpoll-cpu`` parameter binds
+        that kernel thread to a host CPU. Both parameters can only be set
+        when the IOThread is created. Linux 5.11 or later is recommended
+        because older kernels restrict SQPOLL to privileged processes and
+        registered files.
 ERST
 
 
@@ -74,7 +74,7 @@ void replay_event_net_run(void *opaque)
     assert(event->id < network_filters_count);
 
     qemu_netfilter_pass_to_next(network_filters[event->id]->netdev,
-        event->flags, &iov, 1, network_filters[event->id]);
+        event->flags, &iov, 1, NULL, network_filters[event->id]);
 
     g_free(event->data);
     g_free(event);
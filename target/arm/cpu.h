@@ -3379,6 +3379,16 @@ static inline bool arm_cpu_bswap_data(CPUARMState *env)
 void cpu_get_tb_cpu_state(CPUARMState *env, target_ulong *pc,
                           target_ulong *cs_base, uint32_t *flags);
 
+/*
+ * The AArch32 translator reads no CPU state that can change at run time
+ * besides what cpu_get_tb_cpu_state() returns, so that its TBs can be
+ * translated ahead of the vCPU by another thread.  The AArch64 one checks
+ * for BTI guarded pages in the TLB of the vCPU.
+ */
+#ifndef TARGET_AARCH64
+#define TARGET_TB_FLAGS_COMPLETE
+#endif
+
 enum {
     QEMU_PSCI_CONDUIT_DISABLED = 0,
     QEMU_PSCI_CONDUIT_SMC = 1,
@@ -57,15 +57,13 @@ static hppa_tlb_entry *hppa_find_tlb(CPUHPPAState *env, vaddr addr)
 static void hppa_flush_tlb_ent(CPUHPPAState *env, hppa_tlb_entry *ent)
 {
     CPUState *cs = env_cpu(env);
-    unsigned i, n = 1 << (2 * ent->page_size);
-    uint64_t addr = ent->va_b;
+    unsigned n = 1 << (2 * ent->page_size);
 
     trace_hppa_tlb_flush_ent(env, ent, ent->va_b, ent->va_e, ent->pa);
 
-    for (i = 0; i < n; ++i, addr += TARGET_PAGE_SIZE) {
-        /* Do not flush MMU_PHYS_IDX.  */
-        tlb_flush_page_by_mmuidx(cs, addr, 0xf);
-    }
+    /* Do not flush MMU_PHYS_IDX.  */
+    tlb_flush_range_by_mmuidx(cs, ent->va_b, n * TARGET_PAGE_SIZE, 0xf,
+                              TARGET_LONG_BITS);
 
     memset(ent, 0, sizeof(*ent));
     ent->va_b = -1;
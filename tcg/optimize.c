@@ -166,6 +166,149 @@ static bool args_are_copies(TCGArg arg1, TCGArg arg2)
     return ts_are_copies(arg_temp(arg1), arg_temp(arg2));
 }
 
+/* Constants held by globals and local temps on the edges into a label.  */
+struct tcg_label_info {
+    unsigned nb_preds;
+    TCGTempSet known;
+    tcg_target_ulong *val;
+    tcg_target_ulong *mask;
+};
+
+/* Forget the temps that are dead past the end of a basic block.  */
+static void reset_bb_temps(TCGContext *s, TCGTempSet *temps_used)
+{
+    size_t nb_temps = s->nb_temps;
+    size_t i;
+
+    for (i = find_next_bit(temps_used->l, nb_temps, s->nb_globals);
+         i < nb_temps;
+         i = find_next_bit(temps_used->l, nb_temps, i + 1)) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (!ts->temp_local) {
+            reset_ts(ts);
+            clear_bit(i, temps_used->l);
+        }
+    }
+}
+
+/* Intersect the constants known on one more edge into a label.  */
+static void label_add_pred(TCGContext *s, struct tcg_label_info *li,
+                           TCGTempSet *temps_used)
+{
+    size_t nb_temps = s->nb_temps;
+    size_t i;
+
+    if (li->nb_preds++ == 0) {
+        li->val = tcg_malloc(sizeof(tcg_target_ulong) * nb_temps);
+        li->mask = tcg_malloc(sizeof(tcg_target_ulong) * nb_temps);
+        bitmap_zero(li->known.l, nb_temps);
+        for (i = find_first_bit(temps_used->l, nb_temps);
+             i < nb_temps;
+             i = find_next_bit(temps_used->l, nb_temps, i + 1)) {
+            TCGTemp *ts = &s->temps[i];
+
+            if ((ts->temp_global || ts->temp_local) && ts_is_const(ts)) {
+                set_bit(i, li->known.l);
+                li->val[i] = ts_info(ts)->val;
+                li->mask[i] = ts_info(ts)->mask;
+            }
+        }
+        return;
+    }
+
+    for (i = find_first_bit(li->known.l, nb_temps);
+         i < nb_temps;
+         i = find_next_bit(li->known.l, nb_temps, i + 1)) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (!test_bit(i, temps_used->l) || !ts_is_const(ts)
+            || ts_info(ts)->val != li->val[i]) {
+            clear_bit(i, li->known.l);
+        }
+    }
+}
+
+/* Start the basic block at label @l with what holds on all its edges.  */
+static void label_enter(TCGContext *s, struct tcg_temp_info *infos,
+                        struct tcg_label_info *li, TCGTempSet *temps_used,
+                        TCGLabel *l, bool fallthrough)
+{
+    size_t nb_temps = s->nb_temps;
+    size_t i;
+
+    if (fallthrough) {
+        label_add_pred(s, li, temps_used);
+    }
+    bitmap_zero(temps_used->l, nb_temps);
+
+    /* A backward branch to @l has not been seen yet, so know nothing.  */
+    if (li->nb_preds == 0 || li->nb_preds != l->refs + fallthrough) {
+        return;
+    }
+
+    for (i = find_first_bit(li->known.l, nb_temps);
+         i < nb_temps;
+         i = find_next_bit(li->known.l, nb_temps, i + 1)) {
+        TCGTemp *ts = &s->temps[i];
+        struct tcg_temp_info *ti;
+
+        init_ts_info(infos, temps_used, ts);
+        ti = ts_info(ts);
+        ti->is_const = true;
+        ti->val = li->val[i];
+        ti->mask = li->mask[i];
+    }
+}
+
+/*
+ * Update what is known at the end of a basic block.  The fallthrough of
+ * a conditional branch is in the same extended basic block and keeps
+ * what is known about globals and local temps; labels start with the
+ * constants known on all their incoming edges, provided that they are
+ * only reached by forward branches.  *@fallthrough tells whether the
+ * next op can be reached from @op.
+ */
+static void finish_bb(TCGContext *s, TCGOp *op, struct tcg_temp_info *infos,
+                      struct tcg_label_info *linfo, TCGTempSet *temps_used,
+                      bool *fallthrough)
+{
+    TCGLabel *l;
+
+    switch (op->opc) {
+    case INDEX_op_set_label:
+        l = arg_label(op->args[0]);
+        label_enter(s, infos, &linfo[l->id], temps_used, l, *fallthrough);
+        *fallthrough = true;
+        break;
+    case INDEX_op_br:
+        l = arg_label(op->args[0]);
+        label_add_pred(s, &linfo[l->id], temps_used);
+        bitmap_zero(temps_used->l, s->nb_temps);
+        *fallthrough = false;
+        break;
+    case INDEX_op_brcond_i32:
+    case INDEX_op_brcond_i64:
+        l = arg_label(op->args[3]);
+        reset_bb_temps(s, temps_used);
+        label_add_pred(s, &linfo[l->id], temps_used);
+        break;
+    case INDEX_op_brcond2_i32:
+        l = arg_label(op->args[5]);
+        reset_bb_temps(s, temps_used);
+        label_add_pred(s, &linfo[l->id], temps_used);
+        break;
+    case INDEX_op_exit_tb:
+    case INDEX_op_goto_ptr:
+        bitmap_zero(temps_used->l, s->nb_temps);
+        *fallthrough = false;
+        break;
+    default:
+        bitmap_zero(temps_used->l, s->nb_temps);
+        break;
+    }
+}
+
 static void tcg_opt_gen_movi(TCGContext *s, TCGOp *op, TCGArg dst, TCGArg val)
 {
     const TCGOpDef *def;
@@ -600,7 +743,9 @@ void tcg_optimize(TCGContext *s)
     int nb_temps, nb_globals;
     TCGOp *op, *op_next, *prev_mb = NULL;
     struct tcg_temp_info *infos;
+    struct tcg_label_info *linfo;
     TCGTempSet temps_used;
+    bool fallthrough = true;
 
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
@@ -611,6 +756,8 @@ void tcg_optimize(TCGContext *s)
     nb_globals = s->nb_globals;
     bitmap_zero(temps_used.l, nb_temps);
     infos = tcg_malloc(sizeof(struct tcg_temp_info) * nb_temps);
+    linfo = tcg_malloc(sizeof(struct tcg_label_info) * s->nb_labels);
+    memset(linfo, 0, sizeof(struct tcg_label_info) * s->nb_labels);
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
         tcg_target_ulong mask, partmask, affected;
@@ -1096,6 +1243,15 @@ void tcg_optimize(TCGContext *s)
             tcg_opt_gen_mov(s, op, op->args[0], op->args[1]);
             break;
         CASE_OP_32_64(movi):
+            /* A guest register may be set to the constant it already
+               holds, e.g. on both paths to a label.  Drop the store.  */
+            if (arg_is_const(op->args[0])
+                && arg_info(op->args[0])->val == op->args[1]) {
+                tcg_op_remove(s, op);
+                break;
+            }
+            tcg_opt_gen_movi(s, op, op->args[0], op->args[1]);
+            break;
         case INDEX_op_dupi_vec:
             tcg_opt_gen_movi(s, op, op->args[0], op->args[1]);
             break;
@@ -1249,9 +1405,9 @@ void tcg_optimize(TCGContext *s)
                                            op->args[1], op->args[2]);
             if (tmp != 2) {
                 if (tmp) {
-                    bitmap_zero(temps_used.l, nb_temps);
                     op->opc = INDEX_op_br;
                     op->args[0] = op->args[3];
+                    finish_bb(s, op, infos, linfo, &temps_used, &fallthrough);
                 } else {
                     tcg_op_remove(s, op);
                 }
@@ -1332,9 +1488,9 @@ void tcg_optimize(TCGContext *s)
             if (tmp != 2) {
                 if (tmp) {
             do_brcond_true:
-                    bitmap_zero(temps_used.l, nb_temps);
                     op->opc = INDEX_op_br;
                     op->args[0] = op->args[5];
+                    finish_bb(s, op, infos, linfo, &temps_used, &fallthrough);
                 } else {
             do_brcond_false:
                     tcg_op_remove(s, op);
@@ -1348,12 +1504,12 @@ void tcg_optimize(TCGContext *s)
                 /* Simplify LT/GE comparisons vs zero to a single compare
                    vs the high word of the input.  */
             do_brcond_high:
-                bitmap_zero(temps_used.l, nb_temps);
                 op->opc = INDEX_op_brcond_i32;
                 op->args[0] = op->args[1];
                 op->args[1] = op->args[3];
                 op->args[2] = op->args[4];
                 op->args[3] = op->args[5];
+                finish_bb(s, op, infos, linfo, &temps_used, &fallthrough);
             } else if (op->args[4] == TCG_COND_EQ) {
                 /* Simplify EQ comparisons where one of the pairs
                    can be simplified.  */
@@ -1374,11 +1530,11 @@ void tcg_optimize(TCGContext *s)
                     goto do_default;
                 }
             do_brcond_low:
-                bitmap_zero(temps_used.l, nb_temps);
                 op->opc = INDEX_op_brcond_i32;
                 op->args[1] = op->args[2];
                 op->args[2] = op->args[4];
                 op->args[3] = op->args[5];
+                finish_bb(s, op, infos, linfo, &temps_used, &fallthrough);
             } else if (op->args[4] == TCG_COND_NE) {
                 /* Simplify NE comparisons where one of the pairs
                    can be simplified.  */
@@ -1490,11 +1646,11 @@ void tcg_optimize(TCGContext *s)
         do_default:
             /* Default case: we know nothing about operation (or were unable
                to compute the operation result) so no propagation is done.
-               We trash everything if the operation is the end of a basic
-               block, otherwise we only trash the output args.  "mask" is
+               If the operation is the end of a basic block, see finish_bb,
+               otherwise we only trash the output args.  "mask" is
                the non-zero bits mask for the first output arg.  */
             if (def->flags & TCG_OPF_BB_END) {
-                bitmap_zero(temps_used.l, nb_temps);
+                finish_bb(s, op, infos, linfo, &temps_used, &fallthrough);
             } else {
         do_reset_output:
                 for (i = 0; i < nb_oargs; i++) {
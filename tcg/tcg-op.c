@@ -2666,8 +2666,20 @@ void tcg_gen_extr32_i64(TCGv_i64 lo, TCGv_i64 hi, TCGv_i64 arg)
 
 void tcg_gen_exit_tb(TranslationBlock *tb, unsigned idx)
 {
-    uintptr_t val = (uintptr_t)tb + idx;
+    uintptr_t val;
 
+    if (tb && tcg_ctx->trace_tb) {
+        /* Only the last block of a superblock has chained exits */
+        if (tcg_ctx->trace_next && idx <= TB_EXIT_IDXMAX) {
+            if (idx != tcg_ctx->trace_hot_exit) {
+                tcg_gen_lookup_and_goto_ptr();
+            }
+            return;
+        }
+        tb = tcg_ctx->trace_tb;
+    }
+
+    val = (uintptr_t)tb + idx;
     if (tb == NULL) {
         tcg_debug_assert(idx == 0);
     } else if (idx <= TB_EXIT_IDXMAX) {
@@ -2693,6 +2705,13 @@ void tcg_gen_goto_tb(unsigned idx)
 {
     /* We only support two chained exits.  */
     tcg_debug_assert(idx <= TB_EXIT_IDXMAX);
+    /* Inside a superblock, continue with the next block; see above */
+    if (tcg_ctx->trace_next) {
+        if (idx == tcg_ctx->trace_hot_exit) {
+            tcg_gen_br(tcg_ctx->trace_next);
+        }
+        return;
+    }
 #ifdef CONFIG_DEBUG_TCG
     /* Verify that we havn't seen this numbered exit before.  */
     tcg_debug_assert((tcg_ctx->goto_tb_issue_mask & (1 << idx)) == 0);
@@ -160,6 +160,7 @@ static int tcg_out_ldst_finalize(TCGContext *s);
 static TCGContext **tcg_ctxs;
 static unsigned int n_tcg_ctxs;
 TCGv_env cpu_env = 0;
+unsigned int tcg_spec_threads;
 
 struct tcg_region_tree {
     QemuMutex lock;
@@ -187,6 +188,14 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    void *reserved_end; /* start of the next allocation, if not NULL */
+    /* ring of full regions not in use by any context, oldest first */
+    size_t *full;
+    size_t full_head;
+    size_t n_full;
+    /* stack of regions emptied by tcg_region_evict() */
+    size_t *free;
+    size_t n_free;
 };
 
 static struct tcg_region_state region;
@@ -400,22 +409,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+static size_t tc_ptr_to_region_idx(void *p)
 {
-    size_t region_idx;
-
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
     }
-    return region_trees + region_idx * tree_size;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+{
+    return region_trees + tc_ptr_to_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -559,14 +569,29 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
+    if (region.n_free) {
+        tcg_region_assign(s, region.free[--region.n_free]);
+        return false;
+    }
     if (region.current == region.n) {
         return true;
     }
     tcg_region_assign(s, region.current);
+    if (region.reserved_end) {
+        s->code_gen_ptr = region.reserved_end;
+        region.reserved_end = NULL;
+    }
     region.current++;
     return false;
 }
 
+static void tcg_region_push_full__locked(size_t curr_region)
+{
+    g_assert(region.n_full < region.n);
+    region.full[(region.full_head + region.n_full) % region.n] = curr_region;
+    region.n_full++;
+}
+
 /*
  * Request a new region once the one in use has filled up.
  * Returns true on error.
@@ -574,13 +599,15 @@ static bool tcg_region_alloc__locked(TCGContext *s)
 static bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
-    /* read the region size now; alloc__locked will overwrite it on success */
+    /* read the region now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t prev_region = tc_ptr_to_region_idx(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        tcg_region_push_full__locked(prev_region);
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -604,6 +631,10 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.reserved_end = NULL;
+    region.full_head = 0;
+    region.n_full = 0;
+    region.n_free = 0;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -635,10 +666,16 @@ static size_t tcg_n_regions(void)
     /* Use a single region if all we have is one vCPU thread */
 #if !defined(CONFIG_USER_ONLY)
     MachineState *ms = MACHINE(qdev_get_machine());
-    unsigned int max_cpus = ms->smp.max_cpus;
+    unsigned int max_cpus = ms->smp.max_cpus + tcg_spec_threads;
 #endif
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        /*
+         * One region is enough for a single TCG thread, but a few more
+         * let tcg_region_evict() reclaim the oldest code instead of
+         * flushing all of it.
+         */
+        return MAX(1, MIN(8, tcg_init_ctx.code_gen_buffer_size /
+                             (2 * 1024u * 1024)));
     }
 
     /* Try to have more regions than max_cpus, with each region being >= 2 MB */
@@ -668,8 +705,10 @@ static size_t tcg_n_regions(void)
  * and then assigning regions to TCG threads so that the threads can translate
  * code in parallel without synchronization.
  *
- * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * In softmmu the number of TCG threads is bounded by max_cpus, plus the
+ * tcg_spec_threads that translate ahead of the vCPUs, so we use at least
+ * that many regions in MTTCG. In !MTTCG we use a handful of regions,
+ * so that the oldest ones can be evicted when the buffer fills up.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
@@ -715,6 +754,8 @@ void tcg_region_init(void)
     /* init the region struct */
     qemu_mutex_init(&region.lock);
     region.n = n_regions;
+    region.full = g_new(size_t, n_regions);
+    region.free = g_new(size_t, n_regions);
     region.size = region_size - page_size;
     region.stride = region_size;
     region.start = buf;
@@ -746,6 +787,83 @@ void tcg_region_init(void)
 #endif
 }
 
+/*
+ * Mark the code_gen_buffer as used up to @end, so that the first region
+ * allocation hands out space past it.  Must be called after
+ * tcg_region_init() and before any TCG context performs its initial
+ * allocation.  The reservation lasts until the next tcg_region_reset_all().
+ * Returns false if @end leaves no usable space in the buffer.
+ */
+bool tcg_region_reserve(void *end)
+{
+    size_t agg_size_full = 0;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    g_assert(region.current == 0 && !region.reserved_end);
+
+    for (i = 0; i < region.n; i++) {
+        void *start, *rend;
+
+        tcg_region_bounds(i, &start, &rend);
+        if (end < rend - TCG_HIGHWATER) {
+            size_t j;
+
+            region.current = i;
+            region.agg_size_full = agg_size_full;
+            region.reserved_end = end > start ? end : NULL;
+            /* the regions before are full, and the first to be evicted */
+            for (j = 0; j < i; j++) {
+                tcg_region_push_full__locked(j);
+            }
+            break;
+        }
+        agg_size_full += rend - start - TCG_HIGHWATER;
+    }
+    qemu_mutex_unlock(&region.lock);
+    return i < region.n;
+}
+
+/*
+ * Evict the oldest full region that no context is using: @func is called
+ * on each of the TBs it contains, and must invalidate them; the region is
+ * then emptied and handed out again by later region allocations.
+ * Returns the size of the evicted region, or 0 if there is no such region.
+ *
+ * Call from a safe-work context.
+ */
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data)
+{
+    struct tcg_region_tree *rt;
+    void *start, *end;
+    size_t curr_region;
+
+    qemu_mutex_lock(&region.lock);
+    if (!region.n_full) {
+        qemu_mutex_unlock(&region.lock);
+        return 0;
+    }
+    curr_region = region.full[region.full_head];
+    region.full_head = (region.full_head + 1) % region.n;
+    region.n_full--;
+    qemu_mutex_unlock(&region.lock);
+
+    rt = region_trees + curr_region * tree_size;
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, func, user_data);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    tcg_region_bounds(curr_region, &start, &end);
+    qemu_mutex_lock(&region.lock);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    region.free[region.n_free++] = curr_region;
+    qemu_mutex_unlock(&region.lock);
+    return end - start;
+}
+
 static void alloc_tcg_plugin_context(TCGContext *s)
 {
 #ifdef CONFIG_PLUGIN
@@ -796,7 +914,7 @@ void tcg_register_thread(void)
 
     /* Claim an entry in tcg_ctxs */
     n = qatomic_fetch_inc(&n_tcg_ctxs);
-    g_assert(n < ms->smp.max_cpus);
+    g_assert(n < ms->smp.max_cpus + tcg_spec_threads);
     qatomic_set(&tcg_ctxs[n], s);
 
     if (n > 0) {
@@ -1002,7 +1120,8 @@ void tcg_context_init(TCGContext *s)
      * In user-mode we simply share the init context among threads, since we
      * use a single region. See the documentation tcg_region_init() for the
      * reasoning behind this.
-     * In softmmu we will have at most max_cpus TCG threads.
+     * In softmmu we will have at most max_cpus TCG threads, plus
+     * tcg_spec_threads.
      */
 #ifdef CONFIG_USER_ONLY
     tcg_ctxs = &tcg_ctx;
@@ -1010,7 +1129,7 @@ void tcg_context_init(TCGContext *s)
 #else
     MachineState *ms = MACHINE(qdev_get_machine());
     unsigned int max_cpus = ms->smp.max_cpus;
-    tcg_ctxs = g_new(TCGContext *, max_cpus);
+    tcg_ctxs = g_new(TCGContext *, max_cpus + tcg_spec_threads);
 #endif
 
     tcg_debug_assert(!tcg_regset_test_reg(s->reserved_regs, TCG_AREG0));
@@ -1137,6 +1256,8 @@ void tcg_func_start(TCGContext *s)
     s->nb_ops = 0;
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
+    s->trace_tb = NULL;
+    s->trace_next = NULL;
 
 #ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
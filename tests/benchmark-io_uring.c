@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * io_uring submission latency benchmark
+ *
+ * Measures the per-request latency of small reads through the aio=io_uring
+ * block backend with and without IORING_SETUP_SQPOLL.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "block/aio.h"
+#include "block/raw-aio.h"
+#include "qemu/coroutine.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+
+#define BENCH_REQUESTS  100000
+#define BENCH_BUF_SIZE  4096
+
+typedef struct {
+    bool sqpoll;
+    int cpu;
+} BenchOpts;
+
+typedef struct {
+    LuringState *s;
+    int fd;
+    void *buf;
+    int64_t total_ns;
+    bool done;
+} BenchState;
+
+static void coroutine_fn bench_co(void *opaque)
+{
+    BenchState *b = opaque;
+    QEMUIOVector qiov;
+    int i;
+
+    qemu_iovec_init_buf(&qiov, b->buf, BENCH_BUF_SIZE);
+
+    for (i = 0; i < BENCH_REQUESTS; i++) {
+        int64_t start = get_clock();
+        int ret;
+
+        ret = luring_co_submit(NULL, b->s, b->fd, 0, &qiov, QEMU_AIO_READ);
+        g_assert_cmpint(ret, ==, 0);
+        b->total_ns += get_clock() - start;
+    }
+
+    b->done = true;
+}
+
+static void test_submit_latency(const void *opaque)
+{
+    const BenchOpts *opts = opaque;
+    Error *local_err = NULL;
+    BenchState b = {};
+    AioContext *ctx;
+    Coroutine *co;
+    char *path;
+
+    ctx = aio_context_new(&error_abort);
+    if (opts->sqpoll) {
+        aio_context_set_io_uring_sqpoll(ctx, opts->cpu, &local_err);
+        if (local_err) {
+            g_test_skip(error_get_pretty(local_err));
+            error_free(local_err);
+            aio_context_unref(ctx);
+            return;
+        }
+    }
+
+    b.s = aio_setup_linux_io_uring(ctx, &local_err);
+    if (!b.s) {
+        g_test_skip(error_get_pretty(local_err));
+        error_free(local_err);
+        aio_context_unref(ctx);
+        return;
+    }
+
+    b.fd = g_file_open_tmp("qemu-benchmark-io_uring-XXXXXX", &path, NULL);
+    g_assert(b.fd >= 0);
+    unlink(path);
+    g_free(path);
+
+    b.buf = qemu_memalign(BENCH_BUF_SIZE, BENCH_BUF_SIZE);
+    memset(b.buf, 0xaa, BENCH_BUF_SIZE);
+    g_assert_cmpint(pwrite(b.fd, b.buf, BENCH_BUF_SIZE, 0), ==,
+                    BENCH_BUF_SIZE);
+
+    co = qemu_coroutine_create(bench_co, &b);
+    aio_context_acquire(ctx);
+    aio_co_enter(ctx, co);
+    while (!b.done) {
+        aio_poll(ctx, true);
+    }
+    aio_context_release(ctx);
+
+    g_test_message("io_uring %s: %d reads of %d bytes, %.0f ns/request",
+                   opts->sqpoll ? "sqpoll" : "default", BENCH_REQUESTS,
+                   BENCH_BUF_SIZE, (double)b.total_ns / BENCH_REQUESTS);
+
+    qemu_vfree(b.buf);
+    close(b.fd);
+    aio_context_unref(ctx);
+}
+
+int main(int argc, char **argv)
+{
+    static const BenchOpts opts_default = { .sqpoll = false, .cpu = -1 };
+    static const BenchOpts opts_sqpoll = { .sqpoll = true, .cpu = -1 };
+
+    qemu_init_main_loop(&error_fatal);
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_data_func("/io_uring/benchmark/latency/default",
+                         &opts_default, test_submit_latency);
+    g_test_add_data_func("/io_uring/benchmark/latency/sqpoll",
+                         &opts_sqpoll, test_submit_latency);
+
+    return g_test_run();
+}
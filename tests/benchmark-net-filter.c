@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Net filter chain speed benchmark
+ *
+ * Passes TCP packets from a netdev through filter-buffer, filter-mirror
+ * (to a null chardev) and filter-rewriter on their way to the NIC.  The
+ * filters are the real QOM objects, set up as with -object, and pass the
+ * packets along with qemu_netfilter_pass_to_next().  The netdev and the
+ * NIC are bare NetClientStates, since net/net.c is not linked in.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/iov.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "qom/object.h"
+#include "chardev/char.h"
+#include "net/eth.h"
+#include "net/filter.h"
+#include "net/net.h"
+#include "net/queue.h"
+#include "net/vhost_net.h"
+
+#define BENCH_PACKETS   (1000 * 1000)
+#define BENCH_BURST     64
+#define BENCH_VNET_HDR  12
+#define BENCH_NETDEV    "bench-netdev"
+
+static NetClientState netdev, nic;
+static uint64_t received;
+
+/* net/queue.c only asks whether the receiver can take packets */
+int qemu_can_send_packet(NetClientState *sender)
+{
+    return 1;
+}
+
+/* The filters look up their netdev by id */
+int qemu_find_net_clients_except(const char *id, NetClientState **ncs,
+                                 NetClientDriver type, int max)
+{
+    if (strcmp(id, BENCH_NETDEV) || max < 1) {
+        return 0;
+    }
+    ncs[0] = &netdev;
+    return 1;
+}
+
+VHostNetState *get_vhost_net(NetClientState *nc)
+{
+    return NULL;
+}
+
+/* filter-redirector, which is not used, reads from a chardev */
+void net_socket_rs_init(SocketReadState *rs,
+                        SocketReadStateFinalize *finalize,
+                        bool vnet_hdr)
+{
+    abort();
+}
+
+int net_fill_rstate(SocketReadState *rs, const uint8_t *buf, int size)
+{
+    abort();
+}
+
+static ssize_t bench_receive(NetClientState *sender, unsigned flags,
+                             const struct iovec *iov, int iovcnt,
+                             NetPacketBuf *buf, void *opaque)
+{
+    received++;
+    return iov_size(iov, iovcnt);
+}
+
+/* An established TCP connection sending data, after the vnet header */
+static void bench_fill_packet(uint8_t *data, size_t size)
+{
+    struct eth_header *eh = (struct eth_header *)data;
+    struct ip_header *ip = (struct ip_header *)(eh + 1);
+    tcp_header *tcp = (tcp_header *)(ip + 1);
+
+    memset(eh->h_dest, 0x52, ETH_ALEN);
+    memset(eh->h_source, 0x54, ETH_ALEN);
+    eh->h_proto = cpu_to_be16(ETH_P_IP);
+
+    ip->ip_ver_len = IP_HEADER_VERSION_4 << 4 | sizeof(*ip) / 4;
+    ip->ip_len = cpu_to_be16(size - sizeof(*eh));
+    ip->ip_ttl = 64;
+    ip->ip_p = IP_PROTO_TCP;
+    ip->ip_src = cpu_to_be32(0x0a000002);
+    ip->ip_dst = cpu_to_be32(0x0a000001);
+
+    tcp->th_sport = cpu_to_be16(40000);
+    tcp->th_dport = cpu_to_be16(5201);
+    tcp->th_seq = cpu_to_be32(1);
+    tcp->th_ack = cpu_to_be32(1);
+    tcp->th_offset_flags = cpu_to_be16(sizeof(*tcp) / 4 << 12 | TH_ACK);
+}
+
+static Object *bench_filter_new(const char *type, const char *id, ...)
+{
+    Object *obj;
+    va_list vargs;
+
+    va_start(vargs, id);
+    obj = object_new_with_propv(type, object_get_objects_root(), id,
+                                &error_abort, vargs);
+    va_end(vargs);
+    return obj;
+}
+
+static void test_net_filter_speed(const void *opaque)
+{
+    size_t size = (uintptr_t)opaque;
+    uint8_t *data = g_malloc0(BENCH_VNET_HDR + size);
+    struct iovec iov[2] = {
+        { .iov_base = data, .iov_len = BENCH_VNET_HDR },
+        { .iov_base = data + BENCH_VNET_HDR, .iov_len = size },
+    };
+    Object *buffer, *mirror, *rewriter;
+    Chardev *chr;
+    NetFilterState *head;
+    int i, j;
+
+    bench_fill_packet(data + BENCH_VNET_HDR, size);
+
+    netdev.peer = &nic;
+    netdev.vnet_hdr_len = BENCH_VNET_HDR;
+    QTAILQ_INIT(&netdev.filters);
+    nic.peer = &netdev;
+    nic.incoming_queue = qemu_new_net_queue(bench_receive, &nic);
+    received = 0;
+
+    chr = qemu_chr_new("bench-out", "null", NULL);
+    g_assert_nonnull(chr);
+    buffer = bench_filter_new("filter-buffer", "bench-buffer",
+                              "netdev", BENCH_NETDEV,
+                              "queue", "tx",
+                              "interval", "1",
+                              NULL);
+    mirror = bench_filter_new("filter-mirror", "bench-mirror",
+                              "netdev", BENCH_NETDEV,
+                              "queue", "tx",
+                              "outdev", "bench-out",
+                              "vnet_hdr_support", "on",
+                              NULL);
+    rewriter = bench_filter_new("filter-rewriter", "bench-rewriter",
+                                "netdev", BENCH_NETDEV,
+                                "queue", "tx",
+                                "vnet_hdr_support", "on",
+                                NULL);
+    head = QTAILQ_FIRST(&netdev.filters);
+    g_assert(head == NETFILTER(buffer));
+
+    /*
+     * filter-buffer holds each burst until its timer releases it, which
+     * is when the packets go through the rest of the chain.
+     */
+    g_test_timer_start();
+    for (i = 0; i < BENCH_PACKETS / BENCH_BURST; i++) {
+        for (j = 0; j < BENCH_BURST; j++) {
+            qemu_netfilter_receive(head, NET_FILTER_DIRECTION_TX, &netdev, 0,
+                                   iov, ARRAY_SIZE(iov), NULL, NULL);
+        }
+        while (received < (uint64_t)(i + 1) * BENCH_BURST) {
+            qemu_clock_run_timers(QEMU_CLOCK_VIRTUAL);
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_assert_cmpint(received, ==, BENCH_PACKETS / BENCH_BURST * BENCH_BURST);
+    g_test_message("net filter chain: %zu bytes %.2f Mpackets/sec",
+                   size, received / g_test_timer_last() / 1e6);
+
+    object_unparent(rewriter);
+    object_unparent(mirror);
+    object_unparent(buffer);
+    object_unparent(OBJECT(chr));
+    qemu_del_net_queue(nic.incoming_queue);
+    g_free(data);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 64, 1514, 65535 };
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+    qemu_init_main_loop(&error_abort);
+    module_call_init(MODULE_INIT_QOM);
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        g_autofree char *path =
+            g_strdup_printf("/net/benchmark/filter-chain/%zu", sizes[i]);
+
+        g_test_add_data_func(path, (void *)(uintptr_t)sizes[i],
+                             test_net_filter_speed);
+    }
+
+    return g_test_run();
+}
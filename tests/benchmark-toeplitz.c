@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Toeplitz RSS hash speed benchmark
+ *
+ * Compares the bit at a time net_toeplitz_add() with the lookup tables of
+ * net_toeplitz_hash(), for the inputs of IPv4 and IPv6 TCP packets.
+ */
+
+#include "qemu/osdep.h"
+#include "net/checksum.h"
+#include "net/toeplitz.h"
+
+#define BENCH_HASHES    (4 * 1000 * 1000)
+#define BENCH_INPUTS    1024
+
+typedef struct {
+    size_t len;
+    bool table;
+} BenchOpts;
+
+static uint8_t key[NET_TOEPLITZ_KEY_SIZE];
+static uint8_t inputs[BENCH_INPUTS][NET_TOEPLITZ_MAX_INPUT];
+
+static uint32_t hash_bitwise(const uint8_t *input, size_t len)
+{
+    net_toeplitz_key key_data;
+    uint32_t hash = 0;
+
+    net_toeplitz_key_init(&key_data, key);
+    net_toeplitz_add(&hash, (uint8_t *)input, len, &key_data);
+    return hash;
+}
+
+static void test_toeplitz_speed(const void *opaque)
+{
+    const BenchOpts *opts = opaque;
+    NetToeplitz *t = g_new(NetToeplitz, 1);
+    uint32_t sum = 0;
+    int i;
+
+    net_toeplitz_init(t, key, sizeof(key));
+    for (i = 0; i < BENCH_INPUTS; i++) {
+        g_assert_cmphex(net_toeplitz_hash(t, inputs[i], opts->len), ==,
+                        hash_bitwise(inputs[i], opts->len));
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < BENCH_HASHES; i++) {
+        const uint8_t *input = inputs[i % BENCH_INPUTS];
+
+        if (opts->table) {
+            sum += net_toeplitz_hash(t, input, opts->len);
+        } else {
+            sum += hash_bitwise(input, opts->len);
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("toeplitz(%s): input %zu bytes %.2f Mhashes/sec (%x)",
+                   opts->table ? "table" : "bitwise", opts->len,
+                   BENCH_HASHES / g_test_timer_last() / 1e6, sum);
+    g_free(t);
+}
+
+int main(int argc, char **argv)
+{
+    static const BenchOpts opts_ip4_bitwise = { .len = 12, .table = false };
+    static const BenchOpts opts_ip4_table = { .len = 12, .table = true };
+    static const BenchOpts opts_ip6_bitwise = { .len = 36, .table = false };
+    static const BenchOpts opts_ip6_table = { .len = 36, .table = true };
+    int i, j;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < sizeof(key); i++) {
+        key[i] = g_test_rand_int();
+    }
+    for (i = 0; i < BENCH_INPUTS; i++) {
+        for (j = 0; j < NET_TOEPLITZ_MAX_INPUT; j++) {
+            inputs[i][j] = g_test_rand_int();
+        }
+    }
+
+    g_test_add_data_func("/net/benchmark/toeplitz/ipv4-tcp/bitwise",
+                         &opts_ip4_bitwise, test_toeplitz_speed);
+    g_test_add_data_func("/net/benchmark/toeplitz/ipv4-tcp/table",
+                         &opts_ip4_table, test_toeplitz_speed);
+    g_test_add_data_func("/net/benchmark/toeplitz/ipv6-tcp/bitwise",
+                         &opts_ip6_bitwise, test_toeplitz_speed);
+    g_test_add_data_func("/net/benchmark/toeplitz/ipv6-tcp/table",
+                         &opts_ip6_table, test_toeplitz_speed);
+
+    return g_test_run();
+}
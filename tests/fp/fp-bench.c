@@ -14,6 +14,7 @@
 #include <math.h>
 #include <fenv.h>
 #include "qemu/timer.h"
+#include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
 /* amortize the computation of random inputs */
@@ -33,6 +34,9 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_CVT,
+    OP_TOINT,
+    OP_FROMINT,
     OP_MAX_NR,
 };
 
@@ -44,6 +48,9 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_CVT] = "cvt",
+    [OP_TOINT] = "toInt",
+    [OP_FROMINT] = "fromInt",
     [OP_MAX_NR] = NULL,
 };
 
@@ -78,6 +85,27 @@ enum tester {
     TESTER_MAX_NR,
 };
 
+/*
+ * How guests use the FP status, which decides which paths of softfloat
+ * they take:
+ *  x86: the exception flags accumulate until the guest clears them
+ *  arm: default NaN and flush-to-zero, as for Neon's "standard FPSCR"
+ *  ppc: the exception flags are cleared before every operation
+ */
+enum guest {
+    GUEST_X86,
+    GUEST_ARM,
+    GUEST_PPC,
+    GUEST_MAX_NR,
+};
+
+static const char * const guest_names[] = {
+    [GUEST_X86] = "x86",
+    [GUEST_ARM] = "arm",
+    [GUEST_PPC] = "ppc",
+    [GUEST_MAX_NR] = NULL,
+};
+
 static const char * const tester_names[] = {
     [TESTER_SOFT] = "soft",
     [TESTER_HOST] = "host",
@@ -117,6 +145,8 @@ static float_status soft_status;
 static enum precision precision;
 static enum op operation;
 static enum tester tester;
+static bool all_ops;
+static bool clear_flags;
 static uint64_t n_completed_ops;
 static unsigned int duration = DEFAULT_DURATION_SECS;
 static int64_t ns_elapsed;
@@ -163,8 +193,13 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * With @small, the operands are between 2^-8 and 2^20 in magnitude, as
+ * the values that programs convert to integers and to the other precision
+ * usually are.
+ */
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        bool no_neg, bool small)
 {
     int i;
 
@@ -176,6 +211,11 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
             if (no_neg && float32_is_neg(ops[i].f32)) {
                 ops[i].f32 = float32_chs(ops[i].f32);
             }
+            if (small) {
+                ops[i].f32 = make_float32(
+                    deposit32(float32_val(ops[i].f32), 23, 8,
+                              0x7f - 8 + random_ops[i] % 29));
+            }
             break;
         case PREC_DOUBLE:
         case PREC_FLOAT64:
@@ -183,6 +223,11 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
             if (no_neg && float64_is_neg(ops[i].f64)) {
                 ops[i].f64 = float64_chs(ops[i].f64);
             }
+            if (small) {
+                ops[i].f64 = make_float64(
+                    deposit64(float64_val(ops[i].f64), 52, 11,
+                              0x3ff - 8 + random_ops[i] % 29));
+            }
             break;
         default:
             g_assert_not_reached();
@@ -194,19 +239,22 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
  * The main benchmark function. Instead of (ab)using macros, we rely
  * on the compiler to unfold this at compile-time.
  */
-static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
+static void bench(enum precision prec, enum op op, int n_ops, bool no_neg,
+                  bool small)
 {
     int64_t tf = get_clock() + duration * 1000000000LL;
 
     while (get_clock() < tf) {
         union fp ops[MAX_OPERANDS];
         int64_t t0;
+        /* small integers, as converted from loop counters and the like */
+        int32_t n = (int32_t)random_ops[0] >> 12;
         int i;
 
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, small);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -235,13 +283,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_CVT:
+                    res.d = a;
+                    break;
+                case OP_TOINT:
+                    res.u64 = llrintf(a);
+                    break;
+                case OP_FROMINT:
+                    res.f = n;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, small);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -270,19 +327,31 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_CVT:
+                    res.f = a;
+                    break;
+                case OP_TOINT:
+                    res.u64 = llrint(a);
+                    break;
+                case OP_FROMINT:
+                    res.d = n;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, small);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
                 float32 b = ops[1].f32;
                 float32 c = ops[2].f32;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f32 = float32_add(a, b, &soft_status);
@@ -305,19 +374,31 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f64 = float32_to_float64(a, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float32_to_int64(a, &soft_status);
+                    break;
+                case OP_FROMINT:
+                    res.f32 = int32_to_float32(n, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, small);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
                 float64 b = ops[1].f64;
                 float64 c = ops[2].f64;
 
+                if (clear_flags) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f64 = float64_add(a, b, &soft_status);
@@ -340,6 +421,15 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f32 = float64_to_float32(a, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
+                case OP_FROMINT:
+                    res.f64 = int32_to_float64(n, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -356,13 +446,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
 #define GEN_BENCH(name, type, prec, op, n_ops)          \
     static void __attribute__((flatten)) name(void)     \
     {                                                   \
-        bench(prec, op, n_ops, false);                  \
+        bench(prec, op, n_ops, false, false);           \
     }
 
 #define GEN_BENCH_NO_NEG(name, type, prec, op, n_ops)   \
     static void __attribute__((flatten)) name(void)     \
     {                                                   \
-        bench(prec, op, n_ops, true);                   \
+        bench(prec, op, n_ops, true, false);            \
+    }
+
+#define GEN_BENCH_SMALL(name, type, prec, op, n_ops)    \
+    static void __attribute__((flatten)) name(void)     \
+    {                                                   \
+        bench(prec, op, n_ops, false, true);            \
     }
 
 #define GEN_BENCH_ALL_TYPES(opname, op, n_ops)                          \
@@ -388,6 +484,18 @@ GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
 GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
 #undef GEN_BENCH_ALL_TYPES_NO_NEG
 
+#define GEN_BENCH_ALL_TYPES_SMALL(name, op, n)                          \
+    GEN_BENCH_SMALL(bench_ ## name ## _float, float, PREC_SINGLE, op, n) \
+    GEN_BENCH_SMALL(bench_ ## name ## _double, double, PREC_DOUBLE, op, n) \
+    GEN_BENCH_SMALL(bench_ ## name ## _float32, float32, PREC_FLOAT32, op, n) \
+    GEN_BENCH_SMALL(bench_ ## name ## _float64, float64, PREC_FLOAT64, op, n)
+
+GEN_BENCH_ALL_TYPES_SMALL(cvt, OP_CVT, 1)
+GEN_BENCH_ALL_TYPES_SMALL(toint, OP_TOINT, 1)
+GEN_BENCH_ALL_TYPES_SMALL(fromint, OP_FROMINT, 1)
+#undef GEN_BENCH_ALL_TYPES_SMALL
+
+#undef GEN_BENCH_SMALL
 #undef GEN_BENCH_NO_NEG
 #undef GEN_BENCH
 
@@ -407,6 +515,9 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(cvt, OP_CVT),
+    GEN_BENCH_FUNCS(toint, OP_TOINT),
+    GEN_BENCH_FUNCS(fromint, OP_FROMINT),
 };
 
 #undef GEN_BENCH_FUNCS
@@ -420,6 +531,59 @@ static void run_bench(void)
     f();
 }
 
+static double mflops(void)
+{
+    return (double)n_completed_ops / ns_elapsed * 1e3;
+}
+
+/* Run every op in both precisions, and print their MFlops in a table */
+static void run_bench_all(void)
+{
+    enum precision precs[2];
+    enum op op;
+    int i;
+
+    if (tester == TESTER_SOFT) {
+        precs[0] = PREC_FLOAT32;
+        precs[1] = PREC_FLOAT64;
+    } else {
+        precs[0] = PREC_SINGLE;
+        precs[1] = PREC_DOUBLE;
+    }
+
+    printf("%-8s %12s %12s\n", "op", "single", "double");
+    for (op = 0; op < OP_MAX_NR; op++) {
+        printf("%-8s", op_names[op]);
+        for (i = 0; i < ARRAY_SIZE(precs); i++) {
+            n_completed_ops = 0;
+            ns_elapsed = 0;
+            soft_status.float_exception_flags = 0;
+            bench_funcs[op][precs[i]]();
+            printf(" %12.2f", mflops());
+        }
+        printf("\n");
+    }
+    printf("(MFlops)\n");
+}
+
+static void set_guest(enum guest guest)
+{
+    switch (guest) {
+    case GUEST_X86:
+        break;
+    case GUEST_ARM:
+        soft_status.default_nan_mode = true;
+        soft_status.flush_to_zero = true;
+        soft_status.flush_inputs_to_zero = true;
+        break;
+    case GUEST_PPC:
+        clear_flags = true;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 /* @arr must be NULL-terminated */
 static int find_name(const char * const *arr, const char *name)
 {
@@ -437,11 +601,17 @@ static void usage_complete(int argc, char *argv[])
 {
     gchar *op_list = g_strjoinv(", ", (gchar **)op_names);
     gchar *tester_list = g_strjoinv(", ", (gchar **)tester_names);
+    gchar *guest_list = g_strjoinv(", ", (gchar **)guest_names);
 
     fprintf(stderr, "Usage: %s [options]\n", argv[0]);
     fprintf(stderr, "options:\n");
+    fprintf(stderr, " -a = run all operations in both precisions, and "
+            "print a table.\n");
     fprintf(stderr, " -d = duration, in seconds. Default: %d\n",
             DEFAULT_DURATION_SECS);
+    fprintf(stderr, " -g = guest whose use of the FP status to mimic (%s) "
+            "(soft tester only). Default: %s\n",
+            guest_list, guest_names[0]);
     fprintf(stderr, " -h = show this help message.\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
@@ -456,6 +626,7 @@ static void usage_complete(int argc, char *argv[])
     fprintf(stderr, " -Z = flush output to zero (soft tester only). "
             "Default: disabled\n");
 
+    g_free(guest_list);
     g_free(tester_list);
     g_free(op_list);
 }
@@ -541,14 +712,25 @@ static void parse_args(int argc, char *argv[])
     int rounding = ROUND_EVEN;
 
     for (;;) {
-        c = getopt(argc, argv, "d:ho:p:r:t:zZ");
+        c = getopt(argc, argv, "ad:g:ho:p:r:t:zZ");
         if (c < 0) {
             break;
         }
         switch (c) {
+        case 'a':
+            all_ops = true;
+            break;
         case 'd':
             duration = atoi(optarg);
             break;
+        case 'g':
+            val = find_name(guest_names, optarg);
+            if (val < 0) {
+                fprintf(stderr, "Unsupported guest '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            set_guest(val);
+            break;
         case 'h':
             usage_complete(argc, argv);
             exit(EXIT_SUCCESS);
@@ -619,12 +801,16 @@ static void parse_args(int argc, char *argv[])
 
 static void pr_stats(void)
 {
-    printf("%.2f MFlops\n", (double)n_completed_ops / ns_elapsed * 1e3);
+    printf("%.2f MFlops\n", mflops());
 }
 
 int main(int argc, char *argv[])
 {
     parse_args(argc, argv);
+    if (all_ops) {
+        run_bench_all();
+        return 0;
+    }
     run_bench();
     pr_stats();
     return 0;
@@ -166,6 +166,22 @@ static void stop_cont_test(void *obj, void *data, QGuestAllocator *t_alloc)
     rx_stop_cont_test(dev, t_alloc, rx, sv[0]);
 }
 
+static void iothread_send_recv_test(void *obj, void *data,
+                                    QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *dev = obj;
+
+    send_recv_test(&dev->net, data, t_alloc);
+}
+
+static void iothread_stop_cont_test(void *obj, void *data,
+                                    QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *dev = obj;
+
+    stop_cont_test(&dev->net, data, t_alloc);
+}
+
 #endif
 
 static void hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
@@ -282,6 +298,15 @@ static void *virtio_net_test_setup(GString *cmd_line, void *arg)
     return sv;
 }
 
+#ifndef _WIN32
+/* Queue pair 0 runs in thread0 once the driver is ready */
+static void *virtio_net_test_setup_iothread(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line, " -object iothread,id=thread0 ");
+    return virtio_net_test_setup(cmd_line, arg);
+}
+#endif
+
 static void large_tx(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioNet *dev = obj;
@@ -326,6 +351,17 @@ static void register_virtio_net_test(void)
 #endif
     qos_add_test("announce-self", "virtio-net", announce_self, &opts);
 
+#ifndef _WIN32
+    /* ioeventfd, which iothreads need, is only available on PCI in qtest */
+    opts.before = virtio_net_test_setup_iothread;
+    opts.edge.extra_device_opts = "len-iothreads=1,iothreads[0]=thread0";
+    qos_add_test("iothread/basic", "virtio-net-pci",
+                 iothread_send_recv_test, &opts);
+    qos_add_test("iothread/rx_stop_cont", "virtio-net-pci",
+                 iothread_stop_cont_test, &opts);
+    opts.edge.extra_device_opts = NULL;
+#endif
+
     /* These tests do not need a loopback backend.  */
     opts.before = virtio_net_test_setup_nosocket;
     opts.arg = (gpointer)UINT_MAX;
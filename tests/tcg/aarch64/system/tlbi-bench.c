@@ -0,0 +1,71 @@
+/*
+ * Cost of broadcast TLB invalidation
+ *
+ * Times TLBI VALE1IS, which flushes a page from the TLB of every vCPU,
+ * in bursts the size of a typical munmap() shootdown.  The secondary
+ * vCPUs stay powered off, but each of them still has to wake up and
+ * run the flushes, so comparing runs with different -smp shows how the
+ * cost of a shootdown grows with the number of vCPUs.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <inttypes.h>
+#include <minilib.h>
+
+#define BURST 32        /* pages per shootdown */
+#define ROUNDS 1000
+
+/* Away from the 2mb blocks that boot.S maps, so not a large page. */
+#define BASE (1ull << 32)
+
+static inline uint64_t read_cntvct(void)
+{
+    uint64_t r;
+
+    asm volatile("isb\n\t"
+                 "mrs %0, cntvct_el0" : "=r"(r));
+    return r;
+}
+
+static inline uint64_t read_cntfrq(void)
+{
+    uint64_t r;
+
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(r));
+    return r;
+}
+
+static void shootdown(uint64_t va)
+{
+    int i;
+
+    for (i = 0; i < BURST; i++, va += 4096) {
+        asm volatile("tlbi vale1is, %0" : : "r"(va >> 12));
+    }
+    asm volatile("dsb ish\n\t"
+                 "isb" : : : "memory");
+}
+
+int main(void)
+{
+    uint64_t freq = read_cntfrq();
+    uint64_t start, ticks, ns;
+    int r;
+
+    if (!freq) {
+        ml_printf("FAIL: counter frequency is not set\n");
+        return 1;
+    }
+
+    start = read_cntvct();
+    for (r = 0; r < ROUNDS; r++) {
+        shootdown(BASE + (uint64_t)(r % 64) * BURST * 4096);
+    }
+    ticks = read_cntvct() - start;
+    ns = ticks * 1000000000ull / freq;
+
+    ml_printf("%d shootdowns of %d pages in %lld ns: %lld ns per page\n",
+              ROUNDS, BURST, ns, ns / (ROUNDS * BURST));
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Self-modifying code throughput, in the style of a JIT compiler.
+ *
+ * Each phase checks the values returned by the code it generates and
+ * prints how many operations per second it ran:
+ *
+ *  patch: rewrite the immediate operand of a function, then call it
+ *  data:  write data that shares a page with a hot function, then call it
+ *  jit:   emit functions across several pages once, then call them often
+ *
+ * Compare runs with and without -smc-threshold.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define PAGE 4096
+#define JIT_PAGES 16
+#define JIT_SLOT 16
+#define JIT_FUNCS (JIT_PAGES * PAGE / JIT_SLOT)
+
+#define PATCH_ITERS 20000
+#define DATA_ITERS 50000
+#define JIT_ROUNDS 64
+
+typedef uint32_t (*func_t)(void);
+
+static void emit_func(uint8_t *p, uint32_t val)
+{
+    p[0] = 0xb8;                /* mov $val, %eax */
+    memcpy(p + 1, &val, 4);
+    p[5] = 0xc3;                /* ret */
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, unsigned long ops, double start)
+{
+    double secs = now() - start;
+
+    printf("%-6s %10lu ops %10.0f ops/s\n", name, ops,
+           secs > 0 ? ops / secs : 0);
+}
+
+static int test_patch(uint8_t *code)
+{
+    func_t f = (func_t)code;
+    double start = now();
+    uint32_t i;
+
+    emit_func(code, 0);
+    for (i = 0; i < PATCH_ITERS; i++) {
+        memcpy(code + 1, &i, 4);
+        if (f() != i) {
+            printf("FAIL: patch: iteration %u\n", i);
+            return 1;
+        }
+    }
+    report("patch", PATCH_ITERS, start);
+    return 0;
+}
+
+static int test_data(uint8_t *code)
+{
+    volatile uint32_t *counter = (uint32_t *)(code + PAGE / 2);
+    func_t f = (func_t)code;
+    double start = now();
+    uint32_t i, sum = 0;
+
+    emit_func(code, 3);
+    *counter = 0;
+    for (i = 0; i < DATA_ITERS; i++) {
+        *counter += 1;
+        sum += f();
+    }
+    if (*counter != DATA_ITERS || sum != DATA_ITERS * 3) {
+        printf("FAIL: data: counter %u sum %u\n", *counter, sum);
+        return 1;
+    }
+    report("data", DATA_ITERS, start);
+    return 0;
+}
+
+static int test_jit(uint8_t *code)
+{
+    double start = now();
+    uint32_t expect = 0, sum = 0;
+    int i, r;
+
+    for (i = 0; i < JIT_FUNCS; i++) {
+        emit_func(code + i * JIT_SLOT, i);
+        expect += i;
+    }
+    for (r = 0; r < JIT_ROUNDS; r++) {
+        for (i = 0; i < JIT_FUNCS; i++) {
+            sum += ((func_t)(code + i * JIT_SLOT))();
+        }
+    }
+    if (sum != expect * JIT_ROUNDS) {
+        printf("FAIL: jit: sum %u, expected %u\n", sum, expect * JIT_ROUNDS);
+        return 1;
+    }
+    report("jit", (unsigned long)JIT_FUNCS * JIT_ROUNDS, start);
+    return 0;
+}
+
+int main(void)
+{
+    uint8_t *code;
+    int err = 0;
+
+    code = mmap(NULL, JIT_PAGES * PAGE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    err |= test_patch(code);
+    err |= test_data(code + PAGE);
+    err |= test_jit(code);
+
+    munmap(code, JIT_PAGES * PAGE);
+    return err;
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# Report how many host instructions TCG emits per guest instruction
+#
+# Run a linux-user test binary with -d in_asm,out_asm and count the
+# disassembled guest and host instructions of every translated block.
+# Give several --qemu binaries, e.g. builds before and after a change to
+# the TCG optimizer, to compare them on the same guest code.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+import argparse
+import os
+import re
+import shlex
+import subprocess
+import sys
+from tempfile import TemporaryDirectory
+
+INSN_RE = re.compile(r"^0x[0-9a-fA-F]+:\s")
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description="TCG code expansion report")
+    parser.add_argument("--qemu", help="QEMU binary, may be repeated",
+                        action="append", required=True)
+    parser.add_argument("--qargs", help="QEMU arguments", default="")
+    parser.add_argument("binary", help="Guest binary to run")
+    parser.add_argument("args", nargs="*", help="Guest binary arguments")
+    return parser.parse_args()
+
+
+def count_insns(log):
+    """Return the number of guest and host instructions in a log"""
+    guest = host = tbs = 0
+    section = None
+
+    for line in log:
+        if line.startswith("IN:"):
+            section = "in"
+            tbs += 1
+        elif line.startswith("OUT:"):
+            section = "out"
+        elif line.startswith("  data:") or not line.strip():
+            section = None
+        elif INSN_RE.match(line):
+            if section == "in":
+                guest += 1
+            elif section == "out":
+                host += 1
+    return tbs, guest, host
+
+
+def run(qemu, args, tmpdir):
+    logfile = os.path.join(tmpdir, "%s.log" % os.path.basename(qemu))
+    cmd = [qemu] + shlex.split(args.qargs) + \
+          ["-d", "in_asm,out_asm", "-D", logfile, args.binary] + args.args
+
+    result = subprocess.run(cmd, stdout=subprocess.DEVNULL)
+    if result.returncode != 0:
+        print("%s failed with %d" % (" ".join(cmd), result.returncode))
+        sys.exit(1)
+    with open(logfile) as log:
+        return count_insns(log)
+
+
+def main():
+    args = get_args()
+    status = 0
+
+    with TemporaryDirectory("qemu-tcg-expansion") as tmpdir:
+        print("%-40s %8s %10s %10s %8s" % ("qemu", "TBs", "guest", "host",
+                                           "ratio"))
+        for qemu in args.qemu:
+            tbs, guest, host = run(qemu, args, tmpdir)
+            if not guest or not host:
+                # out_asm needs a disassembler for the host
+                print("%-40s no instructions found in the log" % qemu)
+                status = 1
+                continue
+            print("%-40s %8d %10d %10d %8.2f" % (qemu, tbs, guest, host,
+                                                 host / guest))
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
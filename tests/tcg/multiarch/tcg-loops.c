@@ -0,0 +1,191 @@
+/*
+ * Integer loop kernels, in the style of the SPEC CPU integer benchmarks
+ *
+ * Each kernel is a hot loop with forward branches in its body, which is
+ * where the TCG optimizer can carry constants and copies of guest
+ * registers across basic blocks.  Run it with tcg-expansion.py to see
+ * how many host instructions TCG emits per guest instruction.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define N 4096
+#define SIEVE 16384
+#define MAT 24
+
+static uint32_t data[N];
+static uint8_t sieve[SIEVE];
+static int32_t ma[MAT][MAT], mb[MAT][MAT], mc[MAT][MAT];
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+/* bitwise CRC-32, as in compression benchmarks */
+static uint32_t crc32_bitwise(const uint32_t *buf, int n)
+{
+    uint32_t crc = ~0u;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        crc ^= buf[i];
+        for (j = 0; j < 32; j++) {
+            if (crc & 1) {
+                crc = (crc >> 1) ^ 0xedb88320;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return ~crc;
+}
+
+/* number of primes below the size of the sieve */
+static int count_primes(void)
+{
+    int i, j, count = 0;
+
+    memset(sieve, 1, sizeof(sieve));
+    for (i = 2; i < SIEVE; i++) {
+        if (!sieve[i]) {
+            continue;
+        }
+        count++;
+        for (j = i * 2; j < SIEVE; j += i) {
+            sieve[j] = 0;
+        }
+    }
+    return count;
+}
+
+/* saturating sum with a data-dependent branch, as in codecs */
+static int64_t clamp_sum(const uint32_t *buf, int n)
+{
+    int64_t sum = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        int32_t v = (int32_t)(buf[i] & 0xffff) - 0x8000;
+
+        if (v > 0x4000) {
+            v = 0x4000;
+        } else if (v < -0x4000) {
+            v = -0x4000;
+        }
+        sum += v;
+    }
+    return sum;
+}
+
+static int64_t matmul(void)
+{
+    int64_t trace = 0;
+    int i, j, k;
+
+    for (i = 0; i < MAT; i++) {
+        for (j = 0; j < MAT; j++) {
+            int32_t acc = 0;
+
+            for (k = 0; k < MAT; k++) {
+                acc += ma[i][k] * mb[k][j];
+            }
+            mc[i][j] = acc;
+        }
+    }
+    for (i = 0; i < MAT; i++) {
+        trace += mc[i][i];
+    }
+    return trace;
+}
+
+/* a tiny interpreter loop, as in the perl and python benchmarks */
+static uint32_t interpret(const uint32_t *code, int n)
+{
+    uint32_t acc = 0, x = 1;
+    int pc;
+
+    for (pc = 0; pc < n; pc++) {
+        switch (code[pc] & 7) {
+        case 0:
+            acc += x;
+            break;
+        case 1:
+            acc -= x;
+            break;
+        case 2:
+            x = (x << 1) | 1;
+            break;
+        case 3:
+            x >>= 1;
+            break;
+        case 4:
+            acc ^= code[pc];
+            break;
+        case 5:
+            acc = (acc << 3) | (acc >> 29);
+            break;
+        default:
+            x += acc & 0xff;
+            break;
+        }
+    }
+    return acc ^ x;
+}
+
+int main(void)
+{
+    uint32_t state = 1;
+    uint32_t crc, insn;
+    int64_t sum, trace;
+    int i, j, primes, err = 0;
+
+    for (i = 0; i < N; i++) {
+        data[i] = next_rand(&state);
+    }
+    for (i = 0; i < MAT; i++) {
+        for (j = 0; j < MAT; j++) {
+            ma[i][j] = (int32_t)(next_rand(&state) & 0xff) - 0x80;
+            mb[i][j] = (int32_t)(next_rand(&state) & 0xff) - 0x80;
+        }
+    }
+
+    crc = crc32_bitwise(data, N);
+    primes = count_primes();
+    sum = clamp_sum(data, N);
+    trace = matmul();
+    insn = interpret(data, N);
+
+    printf("crc32   %08x\n", crc);
+    printf("primes  %d\n", primes);
+    printf("clamp   %lld\n", (long long)sum);
+    printf("matmul  %lld\n", (long long)trace);
+    printf("interp  %08x\n", insn);
+
+    if (crc != 0x34687f25) {
+        printf("FAIL: crc32\n");
+        err = 1;
+    }
+    if (primes != 1900) {
+        printf("FAIL: primes\n");
+        err = 1;
+    }
+    if (sum != -33168LL) {
+        printf("FAIL: clamp\n");
+        err = 1;
+    }
+    if (trace != -162550LL) {
+        printf("FAIL: matmul\n");
+        err = 1;
+    }
+    if (insn != 0x9debf645) {
+        printf("FAIL: interp\n");
+        err = 1;
+    }
+    return err;
+}
@@ -232,6 +232,47 @@ static void test_cancel_async(void)
     do_test_cancel(false);
 }
 
+static void test_stats(void)
+{
+    WorkerTestData data = { .n = 0 };
+    ThreadPoolStats stats;
+    uint64_t completed;
+
+    thread_pool_get_stats(pool, &stats);
+    completed = stats.completed;
+
+    thread_pool_submit(pool, worker_cb, &data);
+    do {
+        aio_poll(ctx, true);
+        thread_pool_get_stats(pool, &stats);
+    } while (stats.completed == completed);
+
+    g_assert_cmpint(data.n, ==, 1);
+    g_assert_cmpint(stats.completed, ==, completed + 1);
+    g_assert_cmpint(stats.queued, ==, 0);
+    g_assert_cmpint(stats.busy_ns, >=, 0);
+}
+
+static void test_min_threads(void)
+{
+    ThreadPoolStats stats;
+
+    aio_context_set_thread_pool_params(ctx, 4, 8,
+                                       THREAD_POOL_IDLE_TIMEOUT_MS_DEFAULT,
+                                       &error_abort);
+
+    /* Workers are started from a bottom half, one after another */
+    do {
+        aio_poll(ctx, false);
+        thread_pool_get_stats(pool, &stats);
+    } while (stats.idle_threads < 4);
+    g_assert_cmpint(stats.cur_threads, >=, 4);
+
+    aio_context_set_thread_pool_params(ctx, 0, THREAD_POOL_MAX_THREADS_DEFAULT,
+                                       THREAD_POOL_IDLE_TIMEOUT_MS_DEFAULT,
+                                       &error_abort);
+}
+
 int main(int argc, char **argv)
 {
     qemu_init_main_loop(&error_abort);
@@ -245,6 +286,8 @@ int main(int argc, char **argv)
     g_test_add_func("/thread-pool/submit-many", test_submit_many);
     g_test_add_func("/thread-pool/cancel", test_cancel);
     g_test_add_func("/thread-pool/cancel-async", test_cancel_async);
+    g_test_add_func("/thread-pool/stats", test_stats);
+    g_test_add_func("/thread-pool/min-threads", test_min_threads);
 
     return g_test_run();
 }
@@ -174,6 +174,127 @@ static void test_encode_decode(void)
     }
 }
 
+/*
+ * Fill @test with a copy of @buffer where about @percent percent of the
+ * bytes are changed, in runs of 1 to 64 bytes.
+ */
+static void dirty_page(const uint8_t *buffer, uint8_t *test, int percent)
+{
+    int i = 0;
+
+    memcpy(test, buffer, PAGE_SIZE);
+    if (!percent) {
+        return;
+    }
+    while (i < PAGE_SIZE) {
+        int len = g_test_rand_int_range(1, 65);
+        int gap = len * (100 - percent) / percent;
+
+        for (; len && i < PAGE_SIZE; len--, i++) {
+            test[i] = ~buffer[i];
+        }
+        i += g_test_rand_int_range(0, 2 * gap + 1);
+    }
+}
+
+static void test_encode_accel(void)
+{
+    uint8_t *buffer = g_malloc(PAGE_SIZE);
+    uint8_t *test = g_malloc(PAGE_SIZE);
+    uint8_t *ref = g_malloc(PAGE_SIZE);
+    uint8_t *compressed = g_malloc(PAGE_SIZE);
+    uint8_t *decoded = g_malloc(PAGE_SIZE);
+    int i, ref_len, dlen, rc;
+
+    for (i = 0; i < 1000; i++) {
+        int j;
+
+        for (j = 0; j < PAGE_SIZE; j++) {
+            buffer[j] = g_test_rand_int();
+        }
+        dirty_page(buffer, test, g_test_rand_int_range(1, 101));
+
+        /* The most preferred implementation is the reference */
+        ref_len = xbzrle_encode_buffer(buffer, test, PAGE_SIZE, ref,
+                                       PAGE_SIZE);
+        while (test_xbzrle_encode_next_accel()) {
+            dlen = xbzrle_encode_buffer(buffer, test, PAGE_SIZE, compressed,
+                                        PAGE_SIZE);
+            g_assert_cmpint(dlen, ==, ref_len);
+            if (dlen > 0) {
+                g_assert(memcmp(compressed, ref, dlen) == 0);
+            }
+        }
+        if (ref_len > 0) {
+            memcpy(decoded, buffer, PAGE_SIZE);
+            rc = xbzrle_decode_buffer(ref, ref_len, decoded, PAGE_SIZE);
+            g_assert_cmpint(rc, >, 0);
+            g_assert(memcmp(decoded, test, PAGE_SIZE) == 0);
+        }
+        test_xbzrle_encode_reset_accel();
+    }
+
+    g_free(buffer);
+    g_free(test);
+    g_free(ref);
+    g_free(compressed);
+    g_free(decoded);
+}
+
+/*
+ * Throughput of each encoder implementation for several dirtying
+ * patterns, enabled with -m perf.
+ */
+static void test_encode_perf(void)
+{
+    static const int percents[] = { 0, 1, 5, 20, 50 };
+    const int npages = 4096;
+    uint8_t *old_pages = g_malloc(npages * PAGE_SIZE);
+    uint8_t *new_pages = g_malloc(npages * PAGE_SIZE);
+    uint8_t *compressed = g_malloc(PAGE_SIZE);
+    int accel = 0;
+    int i, p;
+
+    for (i = 0; i < npages * PAGE_SIZE; i++) {
+        old_pages[i] = g_test_rand_int();
+    }
+
+    do {
+        for (p = 0; p < ARRAY_SIZE(percents); p++) {
+            uint64_t encoded = 0;
+            double elapsed;
+            int round;
+
+            for (i = 0; i < npages; i++) {
+                dirty_page(old_pages + i * PAGE_SIZE,
+                           new_pages + i * PAGE_SIZE, percents[p]);
+            }
+
+            g_test_timer_start();
+            for (round = 0; round < 4; round++) {
+                for (i = 0; i < npages; i++) {
+                    int dlen = xbzrle_encode_buffer(old_pages + i * PAGE_SIZE,
+                                                    new_pages + i * PAGE_SIZE,
+                                                    PAGE_SIZE, compressed,
+                                                    PAGE_SIZE);
+                    encoded += dlen > 0 ? dlen : 0;
+                }
+            }
+            elapsed = g_test_timer_elapsed();
+
+            g_test_message("accel %d dirty %2d%%: %.1f MB/s "
+                           "(%" PRIu64 " bytes encoded)", accel, percents[p],
+                           4.0 * npages * PAGE_SIZE / elapsed / 1e6, encoded);
+        }
+        accel++;
+    } while (test_xbzrle_encode_next_accel());
+    test_xbzrle_encode_reset_accel();
+
+    g_free(old_pages);
+    g_free(new_pages);
+    g_free(compressed);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +307,10 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
+    if (g_test_perf()) {
+        g_test_add_func("/xbzrle/encode_perf", test_encode_perf);
+    }
 
     return g_test_run();
 }
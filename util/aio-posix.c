@@ -14,6 +14,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qapi/error.h"
 #include "block/block.h"
 #include "qemu/main-loop.h"
 #include "qemu/rcu.h"
@@ -675,6 +676,9 @@ void aio_context_setup(AioContext *ctx)
 {
     ctx->fdmon_ops = &fdmon_poll_ops;
     ctx->epollfd = -1;
+#ifdef CONFIG_LINUX_IO_URING
+    ctx->io_uring_sqpoll_cpu = -1;
+#endif
 
     /* Use the fastest fd monitoring implementation if available */
     if (fdmon_io_uring_setup(ctx)) {
@@ -703,6 +707,71 @@ void aio_context_use_g_source(AioContext *ctx)
     aio_free_deleted_handlers(ctx);
 }
 
+void aio_context_set_io_uring_sqpoll(AioContext *ctx, int cpu, Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    int ret;
+
+    assert(!ctx->linux_io_uring);
+
+    ctx->io_uring_sqpoll = true;
+    ctx->io_uring_sqpoll_cpu = cpu;
+
+    ret = fdmon_io_uring_reinit(ctx);
+    if (ret == -ENOTSUP) {
+        ctx->io_uring_sqpoll = false;
+        error_setg(errp, "io_uring SQPOLL is not supported by the host "
+                   "kernel for unregistered files (needs Linux 5.11)");
+    } else if (ret < 0) {
+        ctx->io_uring_sqpoll = false;
+        error_setg_errno(errp, -ret, "Failed to enable io_uring SQPOLL");
+    }
+#else
+    error_setg(errp, "io_uring is not supported in this build");
+#endif
+}
+
+#ifdef CONFIG_LINUX_IO_URING
+/* Missing from liburing before 2.0 */
+#ifndef IORING_FEAT_SQPOLL_NONFIXED
+#define IORING_FEAT_SQPOLL_NONFIXED (1U << 7)
+#endif
+
+int aio_context_io_uring_queue_init(AioContext *ctx, unsigned entries,
+                                    struct io_uring *ring)
+{
+    struct io_uring_params params;
+    int ret;
+
+    memset(&params, 0, sizeof(params));
+
+    if (ctx->io_uring_sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = AIO_IO_URING_SQ_THREAD_IDLE_MS;
+        if (ctx->io_uring_sqpoll_cpu >= 0) {
+            params.flags |= IORING_SETUP_SQ_AFF;
+            params.sq_thread_cpu = ctx->io_uring_sqpoll_cpu;
+        }
+    }
+
+    ret = io_uring_queue_init_params(entries, ring, &params);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /*
+     * Before Linux 5.11, SQPOLL rings only accept requests on registered
+     * files, while file descriptor monitoring and block I/O use any.
+     */
+    if ((params.flags & IORING_SETUP_SQPOLL) &&
+        !(params.features & IORING_FEAT_SQPOLL_NONFIXED)) {
+        io_uring_queue_exit(ring);
+        return -ENOTSUP;
+    }
+    return 0;
+}
+#endif
+
 void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink, Error **errp)
 {
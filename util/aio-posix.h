@@ -64,8 +64,15 @@ static inline void fdmon_epoll_disable(AioContext *ctx)
 }
 #endif /* !CONFIG_EPOLL_CREATE1 */
 
+/*
+ * How long the kernel submission polling thread keeps spinning after the
+ * last request before it goes to sleep and needs an io_uring_enter wakeup.
+ */
+#define AIO_IO_URING_SQ_THREAD_IDLE_MS 10
+
 #ifdef CONFIG_LINUX_IO_URING
 bool fdmon_io_uring_setup(AioContext *ctx);
+int fdmon_io_uring_reinit(AioContext *ctx);
 void fdmon_io_uring_destroy(AioContext *ctx);
 #else
 static inline bool fdmon_io_uring_setup(AioContext *ctx)
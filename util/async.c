@@ -29,6 +29,7 @@
 #include "block/thread-pool.h"
 #include "qemu/main-loop.h"
 #include "qemu/atomic.h"
+#include "qemu/bitmap.h"
 #include "qemu/rcu_queue.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine_int.h"
@@ -315,6 +316,7 @@ aio_ctx_finalize(GSource     *source)
     unsigned flags;
 
     thread_pool_free(ctx->thread_pool);
+    g_free(ctx->thread_pool_cpus);
 
 #ifdef CONFIG_LINUX_AIO
     if (ctx->linux_aio) {
@@ -367,6 +369,49 @@ GSource *aio_get_g_source(AioContext *ctx)
     return &ctx->source;
 }
 
+void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
+                                        int64_t max, int64_t idle_timeout_ms,
+                                        Error **errp)
+{
+    if (min < 0 || max <= 0 || min > max || max > INT_MAX) {
+        error_setg(errp, "thread pool size must satisfy "
+                   "0 <= min <= max, 0 < max <= %d", INT_MAX);
+        return;
+    }
+    if (idle_timeout_ms <= 0 || idle_timeout_ms > INT_MAX) {
+        error_setg(errp, "thread pool idle timeout must be in range [1, %d]",
+                   INT_MAX);
+        return;
+    }
+
+    ctx->thread_pool_min = min;
+    ctx->thread_pool_max = max;
+    ctx->thread_pool_idle_timeout_ms = idle_timeout_ms;
+
+    if (ctx->thread_pool) {
+        thread_pool_update_params(ctx->thread_pool, ctx);
+    }
+}
+
+void aio_context_set_thread_pool_affinity(AioContext *ctx,
+                                          const unsigned long *host_cpus,
+                                          unsigned long nbits)
+{
+    g_free(ctx->thread_pool_cpus);
+    ctx->thread_pool_cpus = NULL;
+    ctx->thread_pool_cpus_nbits = 0;
+
+    if (host_cpus && !bitmap_empty(host_cpus, nbits)) {
+        ctx->thread_pool_cpus = bitmap_new(nbits);
+        bitmap_copy(ctx->thread_pool_cpus, host_cpus, nbits);
+        ctx->thread_pool_cpus_nbits = nbits;
+    }
+
+    if (ctx->thread_pool) {
+        thread_pool_update_params(ctx->thread_pool, ctx);
+    }
+}
+
 ThreadPool *aio_get_thread_pool(AioContext *ctx)
 {
     if (!ctx->thread_pool) {
@@ -401,7 +446,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(ctx, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -537,6 +582,10 @@ AioContext *aio_context_new(Error **errp)
     ctx->poll_grow = 0;
     ctx->poll_shrink = 0;
 
+    ctx->thread_pool_min = 0;
+    ctx->thread_pool_max = THREAD_POOL_MAX_THREADS_DEFAULT;
+    ctx->thread_pool_idle_timeout_ms = THREAD_POOL_IDLE_TIMEOUT_MS_DEFAULT;
+
     return ctx;
 fail:
     g_source_destroy(&ctx->source);
@@ -325,7 +325,8 @@ bool fdmon_io_uring_setup(AioContext *ctx)
 {
     int ret;
 
-    ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ctx->fdmon_io_uring, 0);
+    ret = aio_context_io_uring_queue_init(ctx, FDMON_IO_URING_ENTRIES,
+                                          &ctx->fdmon_io_uring);
     if (ret != 0) {
         return false;
     }
@@ -335,6 +336,31 @@ bool fdmon_io_uring_setup(AioContext *ctx)
     return true;
 }
 
+/*
+ * Replace the ring with one created by aio_context_io_uring_queue_init()
+ * with the current settings of @ctx.  Only called before the AioContext is
+ * polled for the first time, so nothing has been submitted to the old ring
+ * yet and the AioHandlers on ctx->submit_list are still pending.
+ */
+int fdmon_io_uring_reinit(AioContext *ctx)
+{
+    struct io_uring ring;
+    int ret;
+
+    if (ctx->fdmon_ops != &fdmon_io_uring_ops) {
+        return 0;
+    }
+
+    ret = aio_context_io_uring_queue_init(ctx, FDMON_IO_URING_ENTRIES, &ring);
+    if (ret != 0) {
+        return ret;
+    }
+
+    io_uring_queue_exit(&ctx->fdmon_io_uring);
+    ctx->fdmon_io_uring = ring;
+    return 0;
+}
+
 void fdmon_io_uring_destroy(AioContext *ctx)
 {
     if (ctx->fdmon_ops == &fdmon_io_uring_ops) {
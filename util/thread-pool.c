@@ -18,6 +18,8 @@
 #include "qemu/queue.h"
 #include "qemu/thread.h"
 #include "qemu/coroutine.h"
+#include "qemu/bitmap.h"
+#include "qemu/timer.h"
 #include "trace.h"
 #include "block/thread-pool.h"
 #include "qemu/main-loop.h"
@@ -58,7 +60,6 @@ struct ThreadPool {
     QemuMutex lock;
     QemuCond worker_stopped;
     QemuSemaphore sem;
-    int max_threads;
     QEMUBH *new_thread_bh;
 
     /* The following variables are only accessed from one AioContext. */
@@ -70,37 +71,83 @@ struct ThreadPool {
     int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
     int pending_threads; /* threads created but not running yet */
+    int queued;          /* length of request_list */
     bool stopping;
+
+    /* Parameters copied from the AioContext, also protected by lock. */
+    int min_threads;
+    int max_threads;
+    int idle_timeout_ms;
+    unsigned long *cpus;
+    unsigned long cpus_nbits;
+    unsigned cpus_gen;   /* incremented whenever cpus changes */
+
+    /* Statistics, protected by lock.  */
+    uint64_t completed;
+    int64_t busy_ns;
 };
 
+/* Called with lock taken after a worker's semaphore wait returned @ret */
+static bool back_to_sleep(ThreadPool *pool, int ret)
+{
+    /*
+     * On timeout, keep waiting if we raced with a new request or if the pool
+     * must keep a minimum number of threads around.
+     */
+    return ret == -1 && (!QTAILQ_EMPTY(&pool->request_list) ||
+                         pool->cur_threads <= pool->min_threads);
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
+    unsigned cpus_gen = 0;
+    QemuThread self;
+
+    qemu_thread_get_self(&self);
 
     qemu_mutex_lock(&pool->lock);
     pool->pending_threads--;
     do_spawn_thread(pool);
 
-    while (!pool->stopping) {
+    while (!pool->stopping && pool->cur_threads <= pool->max_threads) {
         ThreadPoolElement *req;
+        int64_t start;
         int ret;
 
+        if (cpus_gen != pool->cpus_gen) {
+            cpus_gen = pool->cpus_gen;
+            if (pool->cpus) {
+                qemu_thread_set_affinity(&self, pool->cpus, pool->cpus_nbits);
+            }
+        }
+
         do {
             pool->idle_threads++;
             qemu_mutex_unlock(&pool->lock);
-            ret = qemu_sem_timedwait(&pool->sem, 10000);
+            ret = qemu_sem_timedwait(&pool->sem, pool->idle_timeout_ms);
             qemu_mutex_lock(&pool->lock);
             pool->idle_threads--;
-        } while (ret == -1 && !QTAILQ_EMPTY(&pool->request_list));
+        } while (back_to_sleep(pool, ret));
         if (ret == -1 || pool->stopping) {
             break;
         }
 
+        /*
+         * thread_pool_update_params() posts the semaphore without queuing a
+         * request to make surplus threads exit.
+         */
         req = QTAILQ_FIRST(&pool->request_list);
+        if (!req) {
+            continue;
+        }
+
         QTAILQ_REMOVE(&pool->request_list, req, reqs);
+        pool->queued--;
         req->state = THREAD_ACTIVE;
         qemu_mutex_unlock(&pool->lock);
 
+        start = get_clock();
         ret = req->func(req->arg);
 
         req->ret = ret;
@@ -109,6 +156,8 @@ static void *worker_thread(void *opaque)
         req->state = THREAD_DONE;
 
         qemu_mutex_lock(&pool->lock);
+        pool->busy_ns += get_clock() - start;
+        pool->completed++;
 
         qemu_bh_schedule(pool->completion_bh);
     }
@@ -219,6 +268,7 @@ static void thread_pool_cancel(BlockAIOCB *acb)
          */
         qemu_sem_timedwait(&pool->sem, 0) == 0) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
+        pool->queued--;
         qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
@@ -261,6 +311,7 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         spawn_thread(pool);
     }
     QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
+    pool->queued++;
     qemu_mutex_unlock(&pool->lock);
     qemu_sem_post(&pool->sem);
     return &req->common;
@@ -306,11 +357,61 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     qemu_mutex_init(&pool->lock);
     qemu_cond_init(&pool->worker_stopped);
     qemu_sem_init(&pool->sem, 0);
-    pool->max_threads = 64;
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
     QTAILQ_INIT(&pool->request_list);
+
+    thread_pool_update_params(pool, ctx);
+}
+
+void thread_pool_update_params(ThreadPool *pool, AioContext *ctx)
+{
+    int i;
+
+    qemu_mutex_lock(&pool->lock);
+
+    pool->min_threads = ctx->thread_pool_min;
+    pool->max_threads = ctx->thread_pool_max;
+    pool->idle_timeout_ms = ctx->thread_pool_idle_timeout_ms;
+
+    g_free(pool->cpus);
+    pool->cpus = NULL;
+    pool->cpus_nbits = ctx->thread_pool_cpus_nbits;
+    if (ctx->thread_pool_cpus) {
+        pool->cpus = bitmap_new(pool->cpus_nbits);
+        bitmap_copy(pool->cpus, ctx->thread_pool_cpus, pool->cpus_nbits);
+    }
+    pool->cpus_gen++;
+
+    /*
+     * Start threads until there are at least min_threads, and wake up
+     * idle threads so that the ones above max_threads exit and the others
+     * pick up the new affinity.
+     */
+    for (i = pool->cur_threads; i < pool->min_threads; i++) {
+        spawn_thread(pool);
+    }
+    for (i = 0; i < pool->idle_threads; i++) {
+        qemu_sem_post(&pool->sem);
+    }
+
+    qemu_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_get_stats(ThreadPool *pool, ThreadPoolStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!pool) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&pool->lock);
+    stats->cur_threads = pool->cur_threads;
+    stats->idle_threads = pool->idle_threads;
+    stats->queued = pool->queued;
+    stats->completed = pool->completed;
+    stats->busy_ns = pool->busy_ns;
 }
 
 ThreadPool *thread_pool_new(AioContext *ctx)
@@ -345,6 +446,7 @@ void thread_pool_free(ThreadPool *pool)
     qemu_mutex_unlock(&pool->lock);
 
     qemu_bh_delete(pool->completion_bh);
+    g_free(pool->cpus);
     qemu_sem_destroy(&pool->sem);
     qemu_cond_destroy(&pool->worker_stopped);
     qemu_mutex_destroy(&pool->lock);